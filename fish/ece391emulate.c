@@ -1,7 +1,12 @@
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <termios.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -225,3 +230,68 @@ ece391_close (int32_t fd)
     return 0;
 }
 
+int32_t
+ece391_ioctl (int32_t fd, int32_t request, int32_t arg)
+{
+    struct termios t;
+    int32_t flags;
+
+    switch (request) {
+	case IOCTL_SET_NONBLOCK:
+	    flags = fcntl (fd, F_GETFL);
+	    if (arg)
+	        flags |= O_NONBLOCK;
+	    else
+	        flags &= ~O_NONBLOCK;
+	    return fcntl (fd, F_SETFL, flags);
+	case IOCTL_TERM_SET_MODE:
+	    if (-1 == tcgetattr (fd, &t))
+	        return -1;
+	    if (TERM_MODE_RAW == arg)
+	        t.c_lflag &= ~(ICANON | ECHO);
+	    else
+	        t.c_lflag |= (ICANON | ECHO);
+	    return tcsetattr (fd, TCSANOW, &t);
+    }
+    return -1;
+}
+
+int32_t
+ece391_poll (struct ece391_pollfd* fds, int32_t nfds, int32_t timeout)
+{
+    int32_t ret;
+
+    /* struct ece391_pollfd has the same layout as struct pollfd */
+    ret = poll ((struct pollfd*)fds, nfds, timeout);
+
+    /* like the kernel, a signal handler ends the wait with 0 */
+    if (-1 == ret && EINTR == errno)
+        return 0;
+    return ret;
+}
+
+int32_t
+ece391_set_handler (int32_t signum, void* handler)
+{
+    /* only ALARM is passed on, as SIGALRM; the kernel ignores it by default */
+    if (ALARM != signum)
+        return -1;
+    if (SIG_ERR == signal (SIGALRM, NULL == handler ? SIG_IGN : (void (*)(int))handler))
+        return -1;
+    return 0;
+}
+
+int32_t
+ece391_setitimer (uint32_t ticks, uint32_t interval)
+{
+    struct itimerval it, old;
+
+    /* a PIT tick is 10 ms */
+    it.it_value.tv_sec = ticks / 100;
+    it.it_value.tv_usec = (ticks % 100) * 10000;
+    it.it_interval.tv_sec = interval / 100;
+    it.it_interval.tv_usec = (interval % 100) * 10000;
+    if (-1 == setitimer (ITIMER_REAL, &it, &old))
+        return -1;
+    return old.it_value.tv_sec * 100 + old.it_value.tv_usec / 10000;
+}
@@ -5,9 +5,10 @@
 
 #define NULL 0
 #define WAIT 100
+#define FRAME_TICKS 3   /* PIT ticks between frames, about 32 a second */
 uint8_t *vmem_base_addr;
 uint8_t *mp1_set_video_mode (void);
-void add_frames(uint8_t *, uint8_t *, int32_t);
+void add_frames(uint8_t *, uint8_t *);
 void ece391_memset(void* memory, char c, int n);
 int32_t ece391_memcpy(void* dest, const void* src, int32_t n);
 
@@ -18,11 +19,17 @@ uint8_t file1[] = "frame1.txt";
 extern int mp1_ioctl(unsigned long arg, unsigned long cmd);
 extern void mp1_rtc_tasklet(unsigned long trash);
 
+static int32_t run_frames(int32_t n);
+static void alarm_handler(int32_t signum);
+
 static struct mp1_blink_struct blink_array[80*25];
 
+/* Frames due, counted by the ALARM handler, and frames drawn */
+static volatile int32_t frames_due;
+static int32_t frames_drawn;
+
 int main(void)
 {
-    int rtc_fd, ret_val, i, garbage;
     struct mp1_blink_struct blink_struct;
 
     ece391_memset(blink_array, 0, sizeof(struct mp1_blink_struct)*80*25);
@@ -31,17 +38,16 @@ int main(void)
         return -1;
     }
 
-    rtc_fd = ece391_open((uint8_t*)"rtc");
+    add_frames(file0, file1);
 
-    add_frames(file0, file1, rtc_fd);
+    ece391_set_handler(ALARM, alarm_handler);
+    ece391_setitimer(FRAME_TICKS, FRAME_TICKS);
 
-    ret_val = 32;
-    ret_val = ece391_write(rtc_fd, &ret_val, 4);
+    /* Any key quits, so take keystrokes as they are typed */
+    ece391_ioctl(0, IOCTL_TERM_SET_MODE, TERM_MODE_RAW);
 
-    for(i=0; i<WAIT; i++) {
-        ece391_read(rtc_fd, &garbage, 4);
-        mp1_rtc_tasklet(garbage);
-    }
+    if (run_frames(WAIT))
+        goto quit;
 
     blink_struct.on_char = 'I';
     blink_struct.off_char = 'M';
@@ -51,32 +57,71 @@ int main(void)
 
     mp1_ioctl((unsigned long)&blink_struct, RTC_ADD);
 
-    for(i=0; i<WAIT; i++) {
-        ece391_read(rtc_fd, &garbage, 4);
-        mp1_rtc_tasklet(garbage);
-    }
+    if (run_frames(WAIT))
+        goto quit;
 
     mp1_ioctl((40 << 16 | (6*80+60)), RTC_SYNC);
 
-    for(i=0; i<WAIT; i++) {
-        ece391_read(rtc_fd, &garbage, 4);
-        mp1_rtc_tasklet(garbage);
-    }
+    if (run_frames(WAIT))
+        goto quit;
 
     mp1_ioctl(6*80+60, RTC_REMOVE);
 
-    for(i=0; i<WAIT; i++) {
-        ece391_read(rtc_fd, &garbage, 4);
-        mp1_rtc_tasklet(garbage);
-    }
+    run_frames(WAIT);
 
-    ece391_close(rtc_fd);
+quit:
+    ece391_setitimer(0, 0);
+    ece391_ioctl(0, IOCTL_TERM_SET_MODE, TERM_MODE_COOKED);
+
+    return 0;
+}
 
+/* run_frames
+ * Runs the blink tasklet for each of the next n frames the interval
+ * timer asks for, waiting on the keyboard in between. The tasklet runs
+ * here rather than in the handler, so it never interrupts mp1_ioctl.
+ * Returns 1 if a key was pressed, 0 after n frames
+ */
+static int32_t
+run_frames(int32_t n)
+{
+    struct ece391_pollfd pfd;
+    int32_t i = 0;
+    uint8_t key;
+
+    while (i < n) {
+        while (i < n && frames_drawn != frames_due) {
+            frames_drawn++;
+            mp1_rtc_tasklet(0);
+            i++;
+        }
+        if (i == n)
+            break;
+
+        /* returns 0 once the ALARM handler has run */
+        pfd.fd = 0;
+        pfd.events = POLLIN;
+        if (ece391_poll(&pfd, 1, -1) < 0)
+            return 1;
+        if (pfd.revents & POLLIN) {
+            ece391_read(0, &key, 1);
+            return 1;
+        }
+    }
     return 0;
 }
 
+/* alarm_handler
+ * Counts a frame each time the interval timer goes off
+ */
+static void
+alarm_handler(int32_t signum)
+{
+    frames_due++;
+}
+
 void
-add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
+add_frames(uint8_t *f0, uint8_t *f1)
 {
     int32_t row, col, offset = 40, eof0 = 0, eof1 = 0, num_bytes;
     int32_t fd0, fd1;
@@ -0,0 +1,520 @@
+/* apic.c - Local APIC and IO-APIC
+ * If the processor has a local APIC and the firmware describes an IO-APIC,
+ * in the ACPI MADT or in the older MP tables, the ISA IRQs are routed
+ * through the IO-APIC to the vectors the 8259 used, the local APIC timer
+ * drives scheduling and an EOI is one register write. Otherwise the 8259
+ * stays in charge. i8259.c passes its calls on here once apic_enabled. */
+
+#include "apic.h"
+#include "i8259.h"
+#include "lib.h"
+#include "timer.h"
+#include "scheduling.h"
+
+#define CPUID_APIC          0x200       // cpuid 1, edx: the processor has a local APIC
+
+#define LAPIC_SVR_ENABLE    0x100
+#define LAPIC_MASKED        0x10000
+#define LAPIC_PERIODIC      0x20000
+#define LAPIC_DIV_16        0x3
+#define LAPIC_ID_SHIFT      24
+#define LAPIC_ICR_PENDING   0x1000
+
+#define IOAPIC_REGSEL       0x00
+#define IOAPIC_WIN          0x10
+#define IOAPIC_VER          0x01        // bits 16-23: number of inputs - 1
+#define IOAPIC_REDTBL       0x10        // two registers per input, low word first
+#define IOAPIC_ACTIVE_LOW   0x2000
+#define IOAPIC_LEVEL        0x8000
+#define IOAPIC_MASKED       0x10000
+#define NO_GSI              0xFFFFFFFF  // the IRQ isn't wired to the IO-APIC
+
+/* MPS INTI flags, used by both the MADT and the MP tables */
+#define INTI_POLARITY       0x3
+#define INTI_ACTIVE_LOW     0x3
+#define INTI_TRIGGER        0xC
+#define INTI_LEVEL          0xC
+
+/* Where the firmware may leave the root pointers */
+#define BIOS_EBDA_SEG       0x40E       // word holding the EBDA's segment
+#define BASE_MEM_LAST_KB    0x9FC00
+#define BIOS_ROM_START      0xE0000
+#define BIOS_ROM_END        0x100000
+#define SCAN_KB             1024
+#define SCAN_ALIGN          16
+
+#define MADT_LAPIC          0
+#define MADT_IOAPIC         1
+#define MADT_OVERRIDE       2
+
+#define MP_PROCESSOR        0
+#define MP_BUS              1
+#define MP_IOAPIC           2
+#define MP_IOINT            3
+#define MP_PROCESSOR_SIZE   20
+#define MP_ENTRY_SIZE       8
+#define MP_IMCR             0x80        // features[1]: the IMCR routes IRQs to the 8259
+#define IMCR_SELECT         0x22
+#define IMCR_DATA           0x23
+#define IMCR_REG            0x70
+#define IMCR_APIC           0x01
+
+/* ACPI root pointer */
+typedef struct rsdp {
+    int8_t signature[8];            // "RSD PTR "
+    uint8_t checksum;
+    int8_t oem[6];
+    uint8_t revision;
+    uint32_t rsdt;
+} __attribute__ ((packed)) rsdp_t;
+
+/* Header of every ACPI table */
+typedef struct sdt_header {
+    int8_t signature[4];
+    uint32_t length;                // of the whole table
+    uint8_t revision;
+    uint8_t checksum;
+    int8_t oem[6];
+    int8_t oem_table[8];
+    uint32_t oem_revision;
+    uint32_t creator;
+    uint32_t creator_revision;
+} __attribute__ ((packed)) sdt_header_t;
+
+/* ACPI MADT ("APIC"), followed by entries of {type, length, ...} */
+typedef struct madt {
+    sdt_header_t header;
+    uint32_t lapic;
+    uint32_t flags;
+} __attribute__ ((packed)) madt_t;
+
+/* MP floating pointer */
+typedef struct mp_float {
+    int8_t signature[4];            // "_MP_"
+    uint32_t config;
+    uint8_t length;                 // in 16-byte units
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t features[5];            // features[0] != 0: a default configuration, no table
+} __attribute__ ((packed)) mp_float_t;
+
+/* MP configuration table ("PCMP"), followed by its entries */
+typedef struct mp_config {
+    int8_t signature[4];
+    uint16_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    int8_t oem[8];
+    int8_t product[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entries;
+    uint32_t lapic;
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__ ((packed)) mp_config_t;
+
+int32_t apic_enabled = 0;
+uint32_t lapic_phys = 0;
+uint32_t ioapic_phys = 0;
+uint8_t apic_cpu_ids[MAX_CPUS];
+uint32_t apic_num_cpus = 0;
+uint32_t lapic_timer_count = 0;
+
+static volatile uint32_t *lapic;
+static volatile uint32_t *ioapic;
+static uint32_t ioapic_gsi_base;
+static int32_t imcr_present;
+/* IO-APIC input and polarity/trigger bits of each ISA IRQ */
+static uint32_t irq_gsi[ISA_IRQS];
+static uint32_t irq_redir[ISA_IRQS];
+
+// Private helper functions
+static uint8_t checksum(const void *p, uint32_t len);
+static void *scan(uint32_t start, uint32_t end, const int8_t *sig, uint32_t siglen, uint32_t sumlen);
+static void *find_root(const int8_t *sig, uint32_t siglen, uint32_t sumlen);
+static int32_t parse_madt(void);
+static int32_t parse_mp(void);
+static void add_cpu(uint8_t id);
+static void add_ioapic(uint32_t addr, uint32_t gsi_base);
+static void isa_override(uint32_t irq, uint32_t gsi, uint32_t inti);
+static uint32_t ioapic_read(uint32_t reg);
+static void ioapic_write(uint32_t reg, uint32_t val);
+
+/** apic_init
+ * Looks for a local APIC and an IO-APIC and switches the interrupt path
+ * over to them: every ISA IRQ goes to vector IRQ_VECTOR_BASE + irq on
+ * this processor, masked until enable_irq, and the 8259 is masked off.
+ * Leaves the 8259 in use if either is missing.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Must run with paging off, before any device enables its
+ *               IRQ. Sets apic_enabled
+ */
+void apic_init(void) {
+    uint32_t i, eax, ebx, ecx, edx, id, max, gsi;
+    uint8_t tmp;
+
+    for (i = 0; i < ISA_IRQS; i++) {
+        irq_gsi[i] = i;
+        irq_redir[i] = 0;           // ISA: edge triggered, active high
+    }
+
+    asm volatile ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    if (!(edx & CPUID_APIC)) return;
+    if (parse_madt() != 0 && parse_mp() != 0) return;
+    if (lapic_phys == 0 || ioapic_phys == 0) return;
+
+    lapic = (volatile uint32_t*) lapic_phys;
+    ioapic = (volatile uint32_t*) ioapic_phys;
+
+    // The boot processor goes first in the list
+    id = lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT;
+    for (i = 0; i < apic_num_cpus && apic_cpu_ids[i] != id; i++);
+    if (i == apic_num_cpus) add_cpu(id);
+    if (i < apic_num_cpus) {
+        tmp = apic_cpu_ids[0];
+        apic_cpu_ids[0] = apic_cpu_ids[i];
+        apic_cpu_ids[i] = tmp;
+    }
+
+    lapic_init_cpu();
+
+    max = (ioapic_read(IOAPIC_VER) >> 16) & 0xFF;
+    for (i = 0; i <= max; i++) {
+        ioapic_write(IOAPIC_REDTBL + 2 * i, IOAPIC_MASKED);
+        ioapic_write(IOAPIC_REDTBL + 2 * i + 1, 0);
+    }
+    for (i = 0; i < ISA_IRQS; i++) {
+        if (irq_gsi[i] == NO_GSI) continue;
+        gsi = irq_gsi[i] - ioapic_gsi_base;
+        if (irq_gsi[i] < ioapic_gsi_base || gsi > max) {
+            irq_gsi[i] = NO_GSI;
+            continue;
+        }
+        ioapic_write(IOAPIC_REDTBL + 2 * gsi + 1, id << LAPIC_ID_SHIFT);
+        ioapic_write(IOAPIC_REDTBL + 2 * gsi, IOAPIC_MASKED | irq_redir[i] | (IRQ_VECTOR_BASE + i));
+    }
+
+    // Take the IRQ lines away from the 8259
+    if (imcr_present) {
+        outb(IMCR_REG, IMCR_SELECT);
+        outb(IMCR_APIC, IMCR_DATA);
+    }
+    outb(0xFF, MASTER_8259_IMR);
+    outb(0xFF, SLAVE_8259_IMR);
+
+    apic_enabled = 1;
+}
+
+/** apic_timer_init
+ * Starts the local APIC timer raising the PIT's vector PIT_HZ times a
+ * second. Its rate is measured against the TSC, so tsc_init must run
+ * first.
+ * Inputs: none
+ * Return value: 0 on success, -1 if there is no APIC to use
+ * Side effects: Busy-waits for one tick. Sets lapic_timer_count
+ */
+int32_t apic_timer_init(void) {
+    uint64_t start;
+    uint32_t count;
+
+    if (!apic_enabled || tsc_per_tick == 0) return -1;
+
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    start = rdtsc();
+    while (rdtsc() - start < tsc_per_tick);
+    count = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+    if (count == 0) return -1;
+
+    lapic_timer_count = count;
+    lapic_timer_start();
+    return 0;
+}
+
+/** lapic_init_cpu
+ * Enables this processor's local APIC: every priority accepted, spurious
+ * interrupts to their own vector, the timer stopped.
+ * Inputs: none
+ * Return value: none
+ * Side effects: none
+ */
+void lapic_init_cpu(void) {
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_MASKED);
+}
+
+/** lapic_timer_start
+ * Starts this processor's local APIC timer raising the PIT's vector every
+ * lapic_timer_count counts, once per PIT tick.
+ * Inputs: none
+ * Return value: none
+ * Side effects: none
+ */
+void lapic_timer_start(void) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_PERIODIC | (IRQ_VECTOR_BASE + PIT_IRQ_VECTOR));
+    lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+}
+
+/** lapic_send_ipi
+ * Sends an interprocessor interrupt and waits until the local APIC has
+ * passed it on.
+ * Inputs: apic_id -- Local APIC id of the processor to send it to
+ *         icr -- Low word of the interrupt command
+ * Return value: none
+ * Side effects: none
+ */
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr) {
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t) apic_id << LAPIC_ID_SHIFT);
+    lapic_write(LAPIC_ICR_LOW, icr);
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING);
+}
+
+/** lapic_read
+ * Inputs: reg -- Register offset
+ * Return value: The local APIC register's value
+ * Side effects: none
+ */
+uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg >> 2];
+}
+
+/** lapic_write
+ * Inputs: reg -- Register offset
+ *         val -- Value to write
+ * Return value: none
+ * Side effects: Writes a local APIC register
+ */
+void lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg >> 2] = val;
+}
+
+/** lapic_eoi
+ * Tells the local APIC the current interrupt has been handled.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Lets interrupts of the same or lower priority through
+ */
+void lapic_eoi(void) {
+    lapic[LAPIC_EOI >> 2] = 0;
+}
+
+/** ioapic_set_mask
+ * Masks or unmasks an ISA IRQ at the IO-APIC.
+ * Inputs: irq_num -- IRQ number, 0-15
+ *         masked -- 1 to mask, 0 to unmask
+ * Return value: none
+ * Side effects: none
+ */
+void ioapic_set_mask(uint32_t irq_num, int32_t masked) {
+    uint32_t reg, val, flags;
+
+    if (irq_num >= ISA_IRQS || irq_gsi[irq_num] == NO_GSI) return;
+    reg = IOAPIC_REDTBL + 2 * (irq_gsi[irq_num] - ioapic_gsi_base);
+
+    cli_and_save(flags);
+    val = ioapic_read(reg);
+    ioapic_write(reg, masked ? (val | IOAPIC_MASKED) : (val & ~IOAPIC_MASKED));
+    restore_flags(flags);
+}
+
+/** static checksum
+ * Inputs: p -- Firmware table
+ *         len -- Its length in bytes
+ * Return value: The byte sum, 0 for a valid table
+ */
+static uint8_t checksum(const void *p, uint32_t len) {
+    const uint8_t *b = p;
+    uint8_t sum = 0;
+
+    while (len-- > 0) sum += *b++;
+    return sum;
+}
+
+/** static scan
+ * Inputs: start, end -- Physical memory to search, 16-byte aligned
+ *         sig, siglen -- Signature to look for
+ *         sumlen -- Bytes covered by the structure's checksum
+ * Return value: The first valid structure with the signature, NULL if none
+ */
+static void *scan(uint32_t start, uint32_t end, const int8_t *sig, uint32_t siglen, uint32_t sumlen) {
+    uint32_t addr;
+
+    for (addr = start; addr + sumlen <= end; addr += SCAN_ALIGN) {
+        if (!strncmp((const int8_t*) addr, sig, siglen) && checksum((void*) addr, sumlen) == 0) {
+            return (void*) addr;
+        }
+    }
+    return NULL;
+}
+
+/** static find_root
+ * Searches where the firmware leaves its root pointers: the first KB of
+ * the EBDA, the last KB of base memory and the BIOS ROM.
+ * Inputs: sig, siglen, sumlen -- As for scan
+ * Return value: The structure, NULL if not found
+ */
+static void *find_root(const int8_t *sig, uint32_t siglen, uint32_t sumlen) {
+    uint32_t ebda = (uint32_t)(*(uint16_t*) BIOS_EBDA_SEG) << 4;
+    void *p;
+
+    if (ebda != 0 && (p = scan(ebda, ebda + SCAN_KB, sig, siglen, sumlen)) != NULL) return p;
+    if ((p = scan(BASE_MEM_LAST_KB, BASE_MEM_LAST_KB + SCAN_KB, sig, siglen, sumlen)) != NULL) return p;
+    return scan(BIOS_ROM_START, BIOS_ROM_END, sig, siglen, sumlen);
+}
+
+/** static parse_madt
+ * Reads the processors, IO-APIC and ISA IRQ overrides from the ACPI MADT.
+ * Inputs: none
+ * Return value: 0 if found, -1 otherwise
+ */
+static int32_t parse_madt(void) {
+    rsdp_t *rsdp = find_root((const int8_t*) "RSD PTR ", 8, sizeof(rsdp_t));
+    sdt_header_t *rsdt, *t;
+    madt_t *madt = NULL;
+    uint32_t i, n, *tables;
+    uint8_t *p, *end;
+
+    if (rsdp == NULL) return -1;
+    rsdt = (sdt_header_t*) rsdp->rsdt;
+    if (strncmp(rsdt->signature, (const int8_t*) "RSDT", 4) || checksum(rsdt, rsdt->length)) return -1;
+
+    tables = (uint32_t*)(rsdt + 1);
+    n = (rsdt->length - sizeof(sdt_header_t)) / sizeof(uint32_t);
+    for (i = 0; i < n && madt == NULL; i++) {
+        t = (sdt_header_t*) tables[i];
+        if (!strncmp(t->signature, (const int8_t*) "APIC", 4) && checksum(t, t->length) == 0) {
+            madt = (madt_t*) t;
+        }
+    }
+    if (madt == NULL) return -1;
+
+    lapic_phys = madt->lapic;
+    end = (uint8_t*) madt + madt->header.length;
+    for (p = (uint8_t*)(madt + 1); p + 2 <= end && p[1] >= 2; p += p[1]) {
+        switch (p[0]) {
+            case MADT_LAPIC:        // processor id, APIC id, flags (bit 0: usable)
+                if (*(uint32_t*)(p + 4) & 1) add_cpu(p[3]);
+                break;
+            case MADT_IOAPIC:       // id, reserved, address, first GSI
+                add_ioapic(*(uint32_t*)(p + 4), *(uint32_t*)(p + 8));
+                break;
+            case MADT_OVERRIDE:     // bus (0 = ISA), IRQ, GSI, INTI flags
+                if (p[2] == 0) isa_override(p[3], *(uint32_t*)(p + 4), *(uint16_t*)(p + 8));
+                break;
+        }
+    }
+    return 0;
+}
+
+/** static parse_mp
+ * Reads the processors, IO-APIC and ISA IRQ wiring from the MP tables.
+ * Inputs: none
+ * Return value: 0 if found, -1 otherwise
+ */
+static int32_t parse_mp(void) {
+    mp_float_t *mpf = find_root((const int8_t*) "_MP_", 4, sizeof(mp_float_t));
+    mp_config_t *conf;
+    uint32_t i;
+    int32_t isa_bus = -1;
+    uint8_t *p;
+
+    if (mpf == NULL || mpf->config == 0 || mpf->features[0] != 0) return -1;
+    conf = (mp_config_t*) mpf->config;
+    if (strncmp(conf->signature, (const int8_t*) "PCMP", 4) || checksum(conf, conf->length)) return -1;
+
+    lapic_phys = conf->lapic;
+    imcr_present = (mpf->features[1] & MP_IMCR) != 0;
+
+    p = (uint8_t*)(conf + 1);
+    for (i = 0; i < conf->entries; i++) {
+        switch (p[0]) {
+            case MP_PROCESSOR:      // APIC id, version, flags (bit 0: usable)
+                if (p[3] & 1) add_cpu(p[1]);
+                p += MP_PROCESSOR_SIZE;
+                continue;
+            case MP_BUS:            // id, type
+                if (!strncmp((const int8_t*) p + 2, (const int8_t*) "ISA", 3)) isa_bus = p[1];
+                break;
+            case MP_IOAPIC:         // id, version, flags (bit 0: usable), address
+                if (p[3] & 1) add_ioapic(*(uint32_t*)(p + 4), 0);
+                break;
+            case MP_IOINT:          // type (0 = vectored), INTI flags, bus, IRQ, IO-APIC, input
+                if (p[1] == 0 && p[4] == isa_bus) isa_override(p[5], p[7], *(uint16_t*)(p + 2));
+                break;
+        }
+        p += MP_ENTRY_SIZE;
+    }
+    return 0;
+}
+
+/** static add_cpu
+ * Inputs: id -- Local APIC id of a usable processor
+ * Return value: none
+ * Side effects: Adds it to apic_cpu_ids, if there is room
+ */
+static void add_cpu(uint8_t id) {
+    if (apic_num_cpus < MAX_CPUS) apic_cpu_ids[apic_num_cpus++] = id;
+}
+
+/** static add_ioapic
+ * Keeps the first IO-APIC listed, or the one with the ISA IRQs (GSI 0).
+ * Inputs: addr -- Its registers' physical address
+ *         gsi_base -- Its first input's GSI
+ * Return value: none
+ */
+static void add_ioapic(uint32_t addr, uint32_t gsi_base) {
+    if (ioapic_phys == 0 || gsi_base == 0) {
+        ioapic_phys = addr;
+        ioapic_gsi_base = gsi_base;
+    }
+}
+
+/** static isa_override
+ * Records that an ISA IRQ is wired to another IO-APIC input, or not as
+ * an edge-triggered, active high line. An IRQ that was on that input by
+ * default loses it.
+ * Inputs: irq -- ISA IRQ
+ *         gsi -- IO-APIC input
+ *         inti -- MPS INTI polarity and trigger flags
+ * Return value: none
+ */
+static void isa_override(uint32_t irq, uint32_t gsi, uint32_t inti) {
+    uint32_t i;
+
+    if (irq >= ISA_IRQS) return;
+    for (i = 0; i < ISA_IRQS; i++) {
+        if (i != irq && irq_gsi[i] == gsi) irq_gsi[i] = NO_GSI;
+    }
+
+    irq_gsi[irq] = gsi;
+    irq_redir[irq] = 0;
+    if ((inti & INTI_POLARITY) == INTI_ACTIVE_LOW) irq_redir[irq] |= IOAPIC_ACTIVE_LOW;
+    if ((inti & INTI_TRIGGER) == INTI_LEVEL) irq_redir[irq] |= IOAPIC_LEVEL;
+}
+
+/** static ioapic_read
+ * Inputs: reg -- IO-APIC register index
+ * Return value: Its value
+ * Side effects: Interrupts must be off once the APIC is in use
+ */
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic[IOAPIC_REGSEL >> 2] = reg;
+    return ioapic[IOAPIC_WIN >> 2];
+}
+
+/** static ioapic_write
+ * Inputs: reg -- IO-APIC register index
+ *         val -- Value to write
+ * Return value: none
+ * Side effects: Interrupts must be off once the APIC is in use
+ */
+static void ioapic_write(uint32_t reg, uint32_t val) {
+    ioapic[IOAPIC_REGSEL >> 2] = reg;
+    ioapic[IOAPIC_WIN >> 2] = val;
+}
@@ -0,0 +1,55 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include "types.h"
+
+#define IRQ_VECTOR_BASE     0x20    // IRQ n arrives at vector 0x20 + n, as with the 8259
+#define APIC_SPURIOUS_VECTOR 0xFF
+#define RESCHED_VECTOR      0xF0    // IPI: switch to a process that stopped waiting
+#define VIDMAP_VECTOR       0xF1    // IPI: stop using vidmap while the visible terminal changes
+#define ISA_IRQS            16
+#define MAX_CPUS            8
+
+/* Local APIC registers, as offsets from its base */
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ESR           0x280
+#define LAPIC_ICR_LOW       0x300
+#define LAPIC_ICR_HIGH      0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_TIMER_INIT    0x380
+#define LAPIC_TIMER_CUR     0x390
+#define LAPIC_TIMER_DIV     0x3E0
+
+/* Interrupt commands, for the low word of the ICR */
+#define LAPIC_ICR_FIXED     0x4000      // OR'd with the vector
+#define LAPIC_ICR_INIT      0x4500
+#define LAPIC_ICR_STARTUP   0x4600      // OR'd with the page number of the start address
+
+/* 1 once device IRQs go through the IO-APIC and EOIs to the local APIC */
+extern int32_t apic_enabled;
+
+/* Physical addresses of the register pages, identity mapped by init_paging */
+extern uint32_t lapic_phys;
+extern uint32_t ioapic_phys;
+
+/* Local APIC IDs of the processors the firmware lists, the boot one first */
+extern uint8_t apic_cpu_ids[MAX_CPUS];
+extern uint32_t apic_num_cpus;
+
+/* Local APIC timer counts in a PIT tick, measured by apic_timer_init */
+extern uint32_t lapic_timer_count;
+
+extern void apic_init(void);
+extern int32_t apic_timer_init(void);
+extern void lapic_init_cpu(void);
+extern void lapic_timer_start(void);
+extern void lapic_send_ipi(uint8_t apic_id, uint32_t icr);
+extern uint32_t lapic_read(uint32_t reg);
+extern void lapic_write(uint32_t reg, uint32_t val);
+extern void lapic_eoi(void);
+extern void ioapic_set_mask(uint32_t irq_num, int32_t masked);
+
+#endif
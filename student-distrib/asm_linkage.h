@@ -8,6 +8,10 @@
 extern void asm_keyboard();
 extern void asm_rtc();
 extern void pit_handler();
+extern void asm_ata();
+extern void asm_spurious();
+extern void asm_resched();
+extern void asm_vidmap();
 
 
 #endif
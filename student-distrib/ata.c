@@ -0,0 +1,372 @@
+/* ata.c - Driver for the drives on the primary IDE channel
+ * Transfers use DMA through the PIIX bus master when the IDE controller
+ * has one, and programmed I/O otherwise. */
+
+#include "ata.h"
+#include "lib.h"
+#include "i8259.h"
+
+/* Primary channel task file */
+#define ATA_IO              0x1F0
+#define ATA_DATA            (ATA_IO + 0)
+#define ATA_SECCOUNT        (ATA_IO + 2)
+#define ATA_LBA0            (ATA_IO + 3)
+#define ATA_LBA1            (ATA_IO + 4)
+#define ATA_LBA2            (ATA_IO + 5)
+#define ATA_DRIVE           (ATA_IO + 6)
+#define ATA_STATUS          (ATA_IO + 7)    // reading it acknowledges the interrupt
+#define ATA_COMMAND         (ATA_IO + 7)
+#define ATA_CTRL            0x3F6           // alternate status when read
+
+#define ATA_SR_BSY          0x80
+#define ATA_SR_DF           0x20
+#define ATA_SR_DRQ          0x08
+#define ATA_SR_ERR          0x01
+#define ATA_CTRL_NIEN       0x02            // drive doesn't raise interrupts
+#define ATA_DRIVE_LBA       0xE0
+
+#define ATA_CMD_READ_PIO    0x20
+#define ATA_CMD_READ_DMA    0xC8
+#define ATA_CMD_IDENTIFY    0xEC
+
+#define ATA_TIMEOUT         0x100000        // status polls before giving up
+
+/* Bus master registers, relative to the controller's BAR4 */
+#define BM_COMMAND          0
+#define BM_STATUS           2
+#define BM_PRDT             4
+#define BM_CMD_START        0x01
+#define BM_CMD_READ         0x08            // device to memory
+#define BM_SR_ERR           0x02
+#define BM_SR_IRQ           0x04
+
+/* PCI configuration space */
+#define PCI_CONFIG_ADDR     0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+#define PCI_ENABLE          0x80000000
+#define PCI_ID              0x00
+#define PCI_COMMAND         0x04
+#define PCI_CLASS           0x08
+#define PCI_BAR4            0x20
+#define PCI_CMD_IO          0x01
+#define PCI_CMD_BUS_MASTER  0x04
+#define PCI_CLASS_IDE       0x0101
+
+#define PRD_LAST            0x8000
+#define PRD_MAX_BYTES       0x10000         // a PRD can't cross a 64KB boundary
+#define ATA_MAX_PRDS        (2 * ATA_MAX_SEGMENTS)
+
+/* Physical region descriptor: one piece of a DMA buffer */
+typedef struct prd {
+    uint32_t addr;
+    uint16_t count;     // bytes, 0 means 64KB
+    uint16_t flags;
+} __attribute__((packed)) prd_t;
+
+static ata_drive_t drives[2];
+/* I/O base of the bus master, 0 if transfers must use PIO */
+static uint16_t bm_base;
+/* Descriptor table of the transfer in progress; aligned so it can't cross 64KB */
+static prd_t prdt[ATA_MAX_PRDS] __attribute__((aligned (ATA_MAX_PRDS * 8)));
+/* DMA request in progress, or NULL if the channel is idle */
+static ata_request_t * volatile active;
+
+// Private helper functions
+static uint32_t pci_read(uint32_t dev, uint32_t func, uint32_t offset);
+static void pci_write(uint32_t dev, uint32_t func, uint32_t offset, uint32_t val);
+static uint16_t find_bus_master(void);
+static void identify(int32_t drive);
+static void select(int32_t drive, uint32_t lba, uint32_t count);
+static int32_t wait_not_busy(void);
+static void start_dma(ata_request_t *req);
+static void complete(void);
+static int32_t pio_read(ata_request_t *req);
+
+/* ata_init
+ * Detects the drives on the primary channel and the bus master.
+ *      INPUTS: none
+ *      RETURN VALUE: none
+ *      SIDE EFFECTS: Enables the ATA IRQ if DMA is available
+ */
+void ata_init(void) {
+    drives[ATA_MASTER].present = 0;
+    drives[ATA_SLAVE].present = 0;
+    bm_base = 0;
+    active = NULL;
+
+    // Poll during detection
+    outb(ATA_CTRL_NIEN, ATA_CTRL);
+
+    // A floating bus reads all ones: no controller
+    if (inb(ATA_STATUS) == 0xFF) return;
+
+    identify(ATA_MASTER);
+    identify(ATA_SLAVE);
+
+    bm_base = find_bus_master();
+    if (bm_base != 0) {
+        outb(0, ATA_CTRL);
+        enable_irq(ATA_IRQ);
+    }
+}
+
+/* ata_present
+ *      INPUTS: drive -- ATA_MASTER or ATA_SLAVE
+ *      RETURN VALUE: 1 if the drive exists, 0 otherwise
+ */
+int32_t ata_present(int32_t drive) {
+    if (drive != ATA_MASTER && drive != ATA_SLAVE) return 0;
+    return drives[drive].present;
+}
+
+/* ata_sectors
+ *      INPUTS: drive -- ATA_MASTER or ATA_SLAVE
+ *      RETURN VALUE: Size of the drive in sectors, 0 if it doesn't exist
+ */
+uint32_t ata_sectors(int32_t drive) {
+    if (!ata_present(drive)) return 0;
+    return drives[drive].sectors;
+}
+
+/* ata_start
+ * Starts a read. The channel must be idle: the block request layer is the
+ * only caller and keeps one transfer in flight. With DMA, req->complete is
+ * called from the IRQ handler (or ata_poll); with PIO the transfer is done
+ * before this returns. The request must be valid for the drive.
+ *      INPUTS: req -- The transfer
+ *      RETURN VALUE: none
+ *      SIDE EFFECTS: Calls req->complete once the data is in memory
+ */
+void ata_start(ata_request_t* req) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    req->error = 0;
+    if (bm_base == 0) {
+        req->error = pio_read(req);
+        if (req->complete) req->complete(req);
+    } else {
+        active = req;
+        start_dma(req);
+    }
+    restore_flags(flags);
+}
+
+/* ata_poll
+ * Completes the DMA transfer in progress if the controller has finished it.
+ * For waiters that run with interrupts off, since the IRQ handler can't.
+ *      INPUTS: none
+ *      RETURN VALUE: none
+ *      SIDE EFFECTS: May call the request's complete function
+ */
+void ata_poll(void) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (bm_base != 0 && active != NULL && (inb(bm_base + BM_STATUS) & BM_SR_IRQ)) {
+        complete();
+    }
+    restore_flags(flags);
+}
+
+/* ata_handler
+ * Completes the DMA transfer in progress.
+ *      INPUTS: none
+ *      RETURN VALUE: none
+ *      SIDE EFFECTS: Calls the request's complete function, sends EOI
+ */
+void ata_handler(void) {
+    if (bm_base != 0 && (inb(bm_base + BM_STATUS) & BM_SR_IRQ)) {
+        complete();
+    } else {
+        inb(ATA_STATUS);
+    }
+    send_eoi(ATA_IRQ);
+}
+
+/* static pci_read
+ * Reads a dword of PCI configuration space on bus 0.
+ */
+static uint32_t pci_read(uint32_t dev, uint32_t func, uint32_t offset) {
+    outl(PCI_ENABLE | (dev << 11) | (func << 8) | (offset & 0xFC), PCI_CONFIG_ADDR);
+    return inl(PCI_CONFIG_DATA);
+}
+
+/* static pci_write
+ * Writes a dword of PCI configuration space on bus 0.
+ */
+static void pci_write(uint32_t dev, uint32_t func, uint32_t offset, uint32_t val) {
+    outl(PCI_ENABLE | (dev << 11) | (func << 8) | (offset & 0xFC), PCI_CONFIG_ADDR);
+    outl(val, PCI_CONFIG_DATA);
+}
+
+/* static find_bus_master
+ * Finds the IDE controller on PCI bus 0 and turns on bus mastering.
+ *      RETURN VALUE: I/O base of the bus master registers, 0 if none
+ */
+static uint16_t find_bus_master(void) {
+    uint32_t dev, func, bar;
+
+    for (dev = 0; dev < 32; dev++) {
+        for (func = 0; func < 8; func++) {
+            if ((pci_read(dev, func, PCI_ID) & 0xFFFF) == 0xFFFF) continue;
+            if ((pci_read(dev, func, PCI_CLASS) >> 16) != PCI_CLASS_IDE) continue;
+
+            bar = pci_read(dev, func, PCI_BAR4);
+            if (!(bar & 1) || (bar & 0xFFFC) == 0) continue;     // must be an I/O BAR
+
+            pci_write(dev, func, PCI_COMMAND,
+                      (pci_read(dev, func, PCI_COMMAND) & 0xFFFF) | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+            return bar & 0xFFFC;
+        }
+    }
+    return 0;
+}
+
+/* static identify
+ * Checks for an ATA drive and reads its size.
+ *      INPUTS: drive -- ATA_MASTER or ATA_SLAVE
+ *      SIDE EFFECTS: Fills in drives[drive]
+ */
+static void identify(int32_t drive) {
+    uint32_t i, timeout;
+    uint16_t data[ATA_SECTOR_SIZE / 2];
+    uint8_t status;
+
+    select(drive, 0, 0);
+    outb(ATA_CMD_IDENTIFY, ATA_COMMAND);
+
+    if (inb(ATA_STATUS) == 0) return;       // no drive
+    if (wait_not_busy()) return;
+    if (inb(ATA_LBA1) != 0 || inb(ATA_LBA2) != 0) return;  // not ATA
+
+    for (timeout = 0; timeout < ATA_TIMEOUT; timeout++) {
+        status = inb(ATA_STATUS);
+        if (status & ATA_SR_ERR) return;
+        if (status & ATA_SR_DRQ) break;
+    }
+    if (timeout == ATA_TIMEOUT) return;
+
+    for (i = 0; i < ATA_SECTOR_SIZE / 2; i++) {
+        data[i] = inw(ATA_DATA);
+    }
+
+    // Words 60-61: sectors addressable with LBA28
+    drives[drive].sectors = data[60] | ((uint32_t) data[61] << 16);
+    drives[drive].present = (drives[drive].sectors != 0);
+}
+
+/* static select
+ * Selects a drive and loads the LBA and sector count registers.
+ */
+static void select(int32_t drive, uint32_t lba, uint32_t count) {
+    wait_not_busy();
+    outb(ATA_DRIVE_LBA | (drive << 4) | ((lba >> 24) & 0x0F), ATA_DRIVE);
+
+    // 400ns for the drive to respond
+    inb(ATA_CTRL);
+    inb(ATA_CTRL);
+    inb(ATA_CTRL);
+    inb(ATA_CTRL);
+
+    outb(count & 0xFF, ATA_SECCOUNT);   // 256 is written as 0
+    outb(lba & 0xFF, ATA_LBA0);
+    outb((lba >> 8) & 0xFF, ATA_LBA1);
+    outb((lba >> 16) & 0xFF, ATA_LBA2);
+}
+
+/* static wait_not_busy
+ *      RETURN VALUE: 0 once the drive is not busy, -1 on timeout
+ */
+static int32_t wait_not_busy(void) {
+    uint32_t timeout;
+
+    for (timeout = 0; timeout < ATA_TIMEOUT; timeout++) {
+        if (!(inb(ATA_CTRL) & ATA_SR_BSY)) return 0;
+    }
+    return -1;
+}
+
+/* static start_dma
+ * Programs the bus master and the drive for a DMA read. Interrupts must be off.
+ */
+static void start_dma(ata_request_t *req) {
+    uint32_t seg;
+    int32_t i = 0;
+
+    // One descriptor per segment, split where a segment crosses 64KB
+    for (seg = 0; seg < req->nsegs; seg++) {
+        uint32_t addr = (uint32_t) req->segs[seg].buf;
+        uint32_t left = req->segs[seg].count * ATA_SECTOR_SIZE;
+
+        while (left > 0) {
+            uint32_t len = PRD_MAX_BYTES - (addr & (PRD_MAX_BYTES - 1));
+            if (len > left) len = left;
+
+            prdt[i].addr = addr;
+            prdt[i].count = len & 0xFFFF;
+            prdt[i].flags = 0;
+            addr += len;
+            left -= len;
+            i++;
+        }
+    }
+    prdt[i - 1].flags = PRD_LAST;
+
+    outb(0, bm_base + BM_COMMAND);
+    outl((uint32_t) prdt, bm_base + BM_PRDT);
+    outb(BM_SR_IRQ | BM_SR_ERR, bm_base + BM_STATUS);     // write 1 to clear
+
+    select(req->drive, req->lba, req->count);
+    outb(ATA_CMD_READ_DMA, ATA_COMMAND);
+    outb(BM_CMD_READ | BM_CMD_START, bm_base + BM_COMMAND);
+}
+
+/* static complete
+ * Finishes the DMA transfer in progress, frees the channel and calls the
+ * request's complete function. Interrupts must be off.
+ */
+static void complete(void) {
+    uint8_t bm_status = inb(bm_base + BM_STATUS);
+    uint8_t status = inb(ATA_STATUS);
+    ata_request_t *req = active;
+
+    outb(0, bm_base + BM_COMMAND);
+    outb(BM_SR_IRQ | BM_SR_ERR, bm_base + BM_STATUS);
+
+    if (req == NULL) return;
+    active = NULL;
+    req->error = ((bm_status & BM_SR_ERR) || (status & (ATA_SR_ERR | ATA_SR_DF))) ? -1 : 0;
+    if (req->complete) req->complete(req);
+}
+
+/* static pio_read
+ * Reads sectors one word at a time, polling the drive. Interrupts must
+ * be off so nothing else touches the channel.
+ *      RETURN VALUE: 0 on success, -1 on failure
+ */
+static int32_t pio_read(ata_request_t *req) {
+    uint32_t seg, sector, i;
+
+    select(req->drive, req->lba, req->count);
+    outb(ATA_CMD_READ_PIO, ATA_COMMAND);
+
+    for (seg = 0; seg < req->nsegs; seg++) {
+        uint16_t *buf = (uint16_t*) req->segs[seg].buf;
+
+        for (sector = 0; sector < req->segs[seg].count; sector++) {
+            uint8_t status;
+
+            inb(ATA_CTRL);
+            if (wait_not_busy()) return -1;
+            status = inb(ATA_STATUS);
+            if ((status & (ATA_SR_ERR | ATA_SR_DF)) || !(status & ATA_SR_DRQ)) return -1;
+
+            for (i = 0; i < ATA_SECTOR_SIZE / 2; i++) {
+                *buf++ = inw(ATA_DATA);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "types.h"
+
+#define ATA_IRQ             14
+#define ATA_SECTOR_SIZE     512
+#define ATA_MAX_SECTORS     128     // largest single transfer (64KB)
+#define ATA_MAX_SEGMENTS    32      // buffers in one transfer
+
+enum ata_drives {ATA_MASTER = 0, ATA_SLAVE = 1};
+
+/* A drive on the primary IDE channel */
+typedef struct ata_drive {
+    int32_t present;
+    uint32_t sectors;       // number of LBA28 sectors
+} ata_drive_t;
+
+/* One piece of a transfer's memory: count sectors at buf (identity mapped) */
+typedef struct ata_segment {
+    void* buf;
+    uint32_t count;
+} ata_segment_t;
+
+/* One transfer of consecutive sectors, scattered over up to
+ * ATA_MAX_SEGMENTS buffers in order. */
+typedef struct ata_request {
+    int32_t drive;
+    uint32_t lba;
+    uint32_t count;                 // total sectors of all segments
+    uint32_t nsegs;
+    ata_segment_t segs[ATA_MAX_SEGMENTS];
+    int32_t error;                  // set before complete is called
+    void (*complete)(struct ata_request* req);  // called with interrupts off
+} ata_request_t;
+
+extern void ata_init(void);
+extern int32_t ata_present(int32_t drive);
+extern uint32_t ata_sectors(int32_t drive);
+extern void ata_start(ata_request_t* req);
+extern void ata_poll(void);
+extern void ata_handler(void);
+
+#endif
@@ -0,0 +1,281 @@
+/* blkq.c - Block request queue in front of the ATA driver
+ * Reads wait in a queue sorted by drive and sector. While the drive is busy
+ * with one transfer, requests for neighbouring sectors are merged, and the
+ * next transfer is picked by a one-way elevator (C-LOOK) from where the
+ * last one ended. Transfers complete from the ATA interrupt. */
+
+#include "blkq.h"
+#include "lib.h"
+#include "syscalls.h"
+#include "scheduling.h"
+
+/* Transfers waiting for the drive, sorted by (drive, lba) */
+static blk_request_t *queue;
+/* Transfer the drive is working on, NULL if idle */
+static blk_request_t * volatile inflight;
+static ata_request_t xfer;
+/* Where the last transfer ended: the elevator continues upwards from here */
+static int32_t head_drive;
+static uint32_t head_pos;
+/* Requests in the queue, counting merged ones */
+static uint32_t depth;
+static int32_t dispatching;
+static blk_stats_t stats;
+
+// Private helper functions
+static int32_t before(blk_request_t *a, int32_t drive, uint32_t lba);
+static int32_t can_merge(blk_request_t *a, blk_request_t *b);
+static void merge(blk_request_t *a, blk_request_t *b);
+static void dispatch(void);
+static void blk_complete(ata_request_t *x);
+
+/** blk_init
+ * Empties the queue and clears the statistics.
+ * Inputs: none
+ * Return value: none
+ * Side effects: none
+ */
+void blk_init(void) {
+    queue = NULL;
+    inflight = NULL;
+    head_drive = 0;
+    head_pos = 0;
+    depth = 0;
+    dispatching = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+/** blk_submit
+ * Queues a read and returns without waiting. req->done is set and
+ * req->callback is called once the data is in req->buf. The request must
+ * not be touched until then.
+ * Inputs: req -- The read, with drive, lba, count, buf and callback set
+ * Return value: 0 if queued, -1 if the request is invalid
+ * Side effects: May start a transfer
+ */
+int32_t blk_submit(blk_request_t* req) {
+    blk_request_t **link, *cur;
+    uint32_t flags;
+
+    if (req == NULL || req->buf == NULL) return -1;
+    if (req->count == 0 || req->count > ATA_MAX_SECTORS) return -1;
+    if (req->lba + req->count > ata_sectors(req->drive) || req->lba + req->count < req->lba) return -1;
+
+    req->done = 0;
+    req->error = 0;
+    req->waiter = -1;
+    req->next = NULL;
+    req->chain = NULL;
+    req->total = req->count;
+    req->nsegs = 1;
+
+    cli_and_save(flags);
+    stats.submitted++;
+    stats.depth_sum += depth;
+    depth++;
+    if (depth > stats.max_depth) stats.max_depth = depth;
+
+    for (link = &queue; *link != NULL; link = &(*link)->next) {
+        cur = *link;
+
+        // Back merge, then see if the transfer now reaches the next one
+        if (can_merge(cur, req)) {
+            merge(cur, req);
+            stats.merged++;
+            if (cur->next != NULL && can_merge(cur, cur->next)) {
+                blk_request_t *nx = cur->next;
+                cur->next = nx->next;
+                merge(cur, nx);
+            }
+            restore_flags(flags);
+            return 0;
+        }
+
+        // Front merge: req takes cur's place in the queue
+        if (can_merge(req, cur)) {
+            req->next = cur->next;
+            merge(req, cur);
+            *link = req;
+            stats.merged++;
+            restore_flags(flags);
+            return 0;
+        }
+
+        if (!before(cur, req->drive, req->lba)) break;
+    }
+
+    req->next = *link;
+    *link = req;
+
+    dispatch();
+    restore_flags(flags);
+    return 0;
+}
+
+/** blk_wait
+ * Waits for a submitted request to finish. Sleeps until the ATA interrupt
+ * unless it's called during boot, before any process runs, with interrupts
+ * still off; then it polls the drive.
+ * Inputs: req -- A submitted request
+ * Return value: none
+ * Side effects: Enables interrupts while waiting
+ */
+void blk_wait(blk_request_t* req) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (!(flags & EFLAGS_IF) && curr_pid < 0) {
+        while (!req->done) ata_poll();
+    } else {
+        req->waiter = curr_pid;
+        sti();
+        while (!req->done) {
+            asm volatile ("hlt");
+        }
+    }
+    restore_flags(flags);
+}
+
+/** blk_read
+ * Reads sectors and waits for them.
+ * Inputs: drive -- ATA_MASTER or ATA_SLAVE
+ *         lba -- First sector
+ *         count -- Number of sectors, at most ATA_MAX_SECTORS
+ *         buf -- Buffer for count * ATA_SECTOR_SIZE bytes
+ * Return value: 0 on success, -1 if failed
+ * Side effects: none
+ */
+int32_t blk_read(int32_t drive, uint32_t lba, uint32_t count, void* buf) {
+    blk_request_t req;
+
+    req.drive = drive;
+    req.lba = lba;
+    req.count = count;
+    req.buf = buf;
+    req.callback = NULL;
+    req.private = NULL;
+
+    if (blk_submit(&req)) return -1;
+    blk_wait(&req);
+    return req.error;
+}
+
+/** blk_get_stats
+ * Copies the queue statistics. The merge rate is merged / submitted and
+ * the average queue depth seen by a new request is depth_sum / submitted.
+ * Inputs: none
+ * Outputs: out -- The statistics
+ * Return value: none
+ * Side effects: none
+ */
+void blk_get_stats(blk_stats_t* out) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    *out = stats;
+    restore_flags(flags);
+}
+
+/** static before
+ * Inputs: a -- A queued transfer
+ *         drive, lba -- Position to compare with
+ * Return value: 1 if a starts before the position in queue order
+ */
+static int32_t before(blk_request_t *a, int32_t drive, uint32_t lba) {
+    if (a->drive != drive) return a->drive < drive;
+    return a->lba < lba;
+}
+
+/** static can_merge
+ * Inputs: a, b -- Transfers
+ * Return value: 1 if b starts right where a ends and together they fit in
+ *               one drive transfer
+ */
+static int32_t can_merge(blk_request_t *a, blk_request_t *b) {
+    return a->drive == b->drive && a->lba + a->total == b->lba &&
+           a->total + b->total <= ATA_MAX_SECTORS &&
+           a->nsegs + b->nsegs <= ATA_MAX_SEGMENTS;
+}
+
+/** static merge
+ * Appends transfer b to the end of transfer a.
+ * Inputs: a, b -- Transfers that can_merge
+ * Return value: none
+ * Side effects: Interrupts must be off
+ */
+static void merge(blk_request_t *a, blk_request_t *b) {
+    blk_request_t *tail = a;
+
+    while (tail->chain != NULL) tail = tail->chain;
+    tail->chain = b;
+    a->total += b->total;
+    a->nsegs += b->nsegs;
+}
+
+/** static dispatch
+ * Starts the next transfer if the drive is idle: the first one at or past
+ * where the last transfer ended, wrapping around to the lowest one.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Interrupts must be off
+ */
+static void dispatch(void) {
+    blk_request_t **link, *req;
+
+    // PIO completes inside ata_start; keep going here instead of recursing
+    if (dispatching) return;
+    dispatching = 1;
+
+    while (inflight == NULL && queue != NULL) {
+        for (link = &queue; *link != NULL; link = &(*link)->next) {
+            if (!before(*link, head_drive, head_pos)) break;
+        }
+        if (*link == NULL) link = &queue;
+
+        req = *link;
+        *link = req->next;
+        depth -= req->nsegs;
+
+        xfer.drive = req->drive;
+        xfer.lba = req->lba;
+        xfer.count = req->total;
+        xfer.nsegs = 0;
+        xfer.complete = blk_complete;
+        for (inflight = req; req != NULL; req = req->chain) {
+            xfer.segs[xfer.nsegs].buf = req->buf;
+            xfer.segs[xfer.nsegs].count = req->count;
+            xfer.nsegs++;
+        }
+
+        stats.dispatched++;
+        ata_start(&xfer);
+    }
+
+    dispatching = 0;
+}
+
+/** static blk_complete
+ * Called by the ATA driver when a transfer is done. Finishes each request
+ * in it and starts the next transfer.
+ * Inputs: x -- The finished transfer
+ * Return value: none
+ * Side effects: Runs in interrupt context with interrupts off
+ */
+static void blk_complete(ata_request_t *x) {
+    blk_request_t *req = inflight, *next;
+
+    inflight = NULL;
+    head_drive = x->drive;
+    head_pos = x->lba + x->count;
+
+    for (; req != NULL; req = next) {
+        next = req->chain;
+        req->error = x->error;
+        req->done = 1;
+        stats.completed++;
+        sched_wake(req->waiter);
+        if (req->callback != NULL) req->callback(req);
+    }
+
+    dispatch();
+}
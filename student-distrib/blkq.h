@@ -0,0 +1,41 @@
+#ifndef BLKQ_H
+#define BLKQ_H
+
+#include "types.h"
+#include "ata.h"
+
+/* A read of consecutive sectors. Requests for neighbouring sectors are
+ * merged into one drive transfer while they wait in the queue. */
+typedef struct blk_request {
+    int32_t drive;
+    uint32_t lba;
+    uint32_t count;                 // sectors, at most ATA_MAX_SECTORS
+    void* buf;
+    void (*callback)(struct blk_request* req);  // optional, called with interrupts off
+    void* private;                  // for the callback
+    volatile int32_t done;          // set once the data is in buf
+    int32_t waiter;                 // process sleeping in blk_wait, -1 if none
+    int32_t error;                  // 0 on success, -1 if the read failed
+    struct blk_request* next;       // next transfer in the queue
+    struct blk_request* chain;      // next request merged into this transfer
+    uint32_t total;                 // sectors of the whole transfer (first request only)
+    uint32_t nsegs;                 // requests in the transfer (first request only)
+} blk_request_t;
+
+typedef struct blk_stats {
+    uint32_t submitted;             // requests
+    uint32_t merged;                // requests joined onto a queued transfer
+    uint32_t dispatched;            // transfers sent to the drive
+    uint32_t completed;             // requests finished
+    uint32_t max_depth;             // most requests waiting at once
+    uint32_t depth_sum;             // requests already waiting, summed over submits
+} blk_stats_t;
+
+extern void blk_init(void);
+
+extern int32_t blk_submit(blk_request_t* req);
+extern void blk_wait(blk_request_t* req);
+extern int32_t blk_read(int32_t drive, uint32_t lba, uint32_t count, void* buf);
+extern void blk_get_stats(blk_stats_t* out);
+
+#endif
@@ -3,110 +3,59 @@
 #include "lib.h"
 #include "syscalls.h"
 
-#define DEFAULT_HANDLER do {kill_current_proc(256);} while (0);
+#define DIVIDE_ERROR    0
+#define MACHINE_CHECK   18
 
-/* "name of exception"()
- * Description: prints the name of the exception and produces blue screen of death
- * Inputs: none
+/* Names of the exceptions, by vector */
+static const char* exception_names[EXCEPTION_COUNT] = {
+    "Divide Error",
+    "Debug Exception",
+    "NMI interrupt",
+    "Breakpoint Exception",
+    "Overflow Exception",
+    "BOUND Range Exceeded",
+    "Invalid/Undefined Opcode",
+    "Device not available / No Math Coprocessor",
+    "Double Fault",
+    "Coprocessor Segment Overrun",
+    "Invalid TSS",
+    "Segment Not Present",
+    "Stack-Segment Fault",
+    "General Protection",
+    "Page Fault",
+    "Reserved",
+    "x87 FPU Floating Point Error (Math Fault)",
+    "Alignment Check",
+    "Machine Check",
+    "SIMD Floating Point Exception"
+};
+
+/* exception_handler()
+ * Description: called by every exception entry point. An exception in a
+ *              user program sends it DIV_ZERO (divide error) or SEGFAULT
+ *              (the rest), so a program with a handler carries on. Otherwise
+ *              prints the name of the exception and kills the process
+ * Inputs: ctx - registers when the exception happened
  * Outputs: none
  * Returns: none
- * Side Effects: None
+ * Side Effects: Doesn't return if the process is killed
  */
-void Divide_Error() {
-    cli();       //Clear interrupts                   
-    printf("Divide Error\n");
-    DEFAULT_HANDLER;
-}
-void Debug_Exception() {
-    cli();       //Clear interrupts                 
-    printf("Debug Exception\n");
-    DEFAULT_HANDLER;
-}
-void NMI_interrupt() {
-    cli();       //Clear interrupts                
-    printf("NMI interrupt\n"); 
-    DEFAULT_HANDLER;
-}
-void Breakpoint_Exception() {
-    cli();       //Clear interrupts              
-    printf("Breakpoint Exception\n");
-    DEFAULT_HANDLER;
-}
-void Overflow_Exception() {
-    cli();       //Clear interrupts                
-    printf("Overflow Exception\n");  
-    DEFAULT_HANDLER;
-}
-void Bound_Range() {
-    cli();       //Clear interrupts             
-    printf("BOUND Range Exceeded\n"); 
-    DEFAULT_HANDLER;
-}
-void Invalid_Opcode() {
-    cli();       //Clear interrupts                    
-    printf("Invalid/Undefined Opcode\n");
-    DEFAULT_HANDLER;
-}
-void Device_Not_Available() {
-    cli();       //Clear interrupts                
-    printf("Device not available / No Math Coprocessor\n");
-    DEFAULT_HANDLER;
-}
-void Double_Fault() {
-    //cli();       //Clear interrupts                     
-    printf("Double Fault\n");
-    return;
-}
-void Coprocessor_Segment_Overrun() {
-    cli();       //Clear interrupts                     
-    printf("Coprocessor Segment Overrun\n");
-    DEFAULT_HANDLER;
-}
-void Invalid_TSS() {
-    cli();       //Clear interrupts                   
-    printf("Invalid TSS\n");
-    DEFAULT_HANDLER;
-}
-void Segment_Not_Present() {
-    cli();       //Clear interrupts                    
-    printf("Segment Not Present\n");
-    DEFAULT_HANDLER;
-}
-void Stack_Segment_Fault() {
-    cli();       //Clear interrupts                    
-    printf("Invalid TSS\n");
-    DEFAULT_HANDLER;
-}
-void General_Protection() {
-    cli();       //Clear interrupts                     
-    printf("General Protection\n");
-    DEFAULT_HANDLER;
-}
-void Page_Fault() {
-    cli();       //Clear interrupts                  
-    printf("Page Fault\n");
-    DEFAULT_HANDLER;
-}
-void Floating_Point_Error() {
-    cli();       //Clear interrupts                       
-    printf("x87 FPU Floating Point Error (Math Fault)\n");
-    DEFAULT_HANDLER;
-}
-void Alignment_Check() {
-    cli();       //Clear interrupts                     
-    printf("Alignment Check\n");  
-    while(1){}         
-    //Squash would go here later
-}
-void Machine_Check() {
-    cli();       //Clear interrupts                      
-    printf("Machine Check\n");    
-    while(1){}       
-    //Squash would go here later
-}
-void Floating_Point_Exception() {
-    cli();       //Clear interrupts                    
-    printf("SIMD Floating Point Exception\n");
-    DEFAULT_HANDLER;
-}
+void exception_handler(hw_context_t* ctx) {
+    pcb_t *pcb = get_pcb(curr_pid);
+    int32_t signum = (ctx->vector == DIVIDE_ERROR) ? DIV_ZERO : SEGFAULT;
+
+    cli();       //Clear interrupts
 
+    // A blocked signal would only fault again on the same instruction
+    if ((ctx->cs & 3) == 3 && pcb != NULL && pcb->sig_handler[signum] != NULL &&
+        !(pcb->sig_blocked & (1U << signum))) {
+        send_signal(pcb, signum);
+        return;
+    }
+
+    printf("%s\n", ctx->vector < EXCEPTION_COUNT ? exception_names[ctx->vector] : "Exception");
+    if (pcb == NULL || ctx->vector == MACHINE_CHECK) {
+        while(1){}      // nothing to kill, or the hardware is broken
+    }
+    kill_current_proc(256);
+}
@@ -1,6 +1,12 @@
 #ifndef EXC_HANDLERS_H
 #define EXC_HANDLERS_H
 
+#include "signal.h"
+
+#define EXCEPTION_COUNT 20
+
+/* Entry points in asm_linkage.S, which save a hw_context_t and call
+ * exception_handler */
 void Divide_Error() ;
 void Debug_Exception() ;
 void NMI_interrupt() ;
@@ -21,4 +27,6 @@ void Alignment_Check() ;
 void Machine_Check() ;
 void Floating_Point_Exception() ;
 
+void exception_handler(hw_context_t* ctx);
+
 #endif
@@ -0,0 +1,80 @@
+/* filedescriptor.c - Open files shared by file descriptors
+ * Open files are allocated a page at a time and kept on a free list once
+ * closed, so opening a file doesn't search a fixed table. */
+
+#include "filedescriptor.h"
+#include "syscalls.h"
+
+#define FILES_PER_PAGE  (FOUR_KB / sizeof(file_desc_t))
+
+/* Closed open files, linked through their ftable pointer */
+static file_desc_t *free_files;
+
+/** file_alloc
+ * Gets an open file with one reference. The caller fills in everything but
+ * refcount and opens it.
+ * Inputs: none
+ * Return value: The open file, or NULL if out of memory
+ * Side effects: May allocate a page
+ */
+file_desc_t* file_alloc(void) {
+    file_desc_t *file;
+    uint32_t i;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (free_files == NULL) {
+        file = alloc_page();
+        if (file == NULL) {
+            restore_flags(flags);
+            return NULL;
+        }
+        for (i = 0; i < FILES_PER_PAGE; i++) {
+            file[i].ftable = (struct file_desc_ftable*) free_files;
+            free_files = &file[i];
+        }
+    }
+
+    file = free_files;
+    free_files = (file_desc_t*) file->ftable;
+    restore_flags(flags);
+
+    memset(file, 0, sizeof(file_desc_t));
+    file->refcount = 1;
+    return file;
+}
+
+/** file_get
+ * Adds a reference to an open file.
+ * Inputs: file -- The open file
+ * Return value: file
+ * Side effects: none
+ */
+file_desc_t* file_get(file_desc_t *file) {
+    file->refcount++;
+    return file;
+}
+
+/** file_put
+ * Drops a reference to an open file, closing it and putting it back on the
+ * free list if it was the last.
+ * Inputs: file -- The open file
+ * Return value: What the file's close returned, or 0 if it's still open
+ * Side effects: May close the file
+ */
+int32_t file_put(file_desc_t *file) {
+    int32_t ret = 0;
+    uint32_t flags;
+
+    if (--file->refcount > 0) return 0;
+
+    if (file->flags.open) {
+        ret = file->ftable->close(file);
+    }
+
+    cli_and_save(flags);
+    file->ftable = (struct file_desc_ftable*) free_files;
+    free_files = file;
+    restore_flags(flags);
+    return ret;
+}
@@ -3,16 +3,43 @@
 
 #include "lib.h"
 
+/* Requests understood by every descriptor's ioctl */
+#define IOCTL_SET_NONBLOCK  1   // arg: 1 to make reads return instead of waiting (0 from a terminal, -1 from a pipe), 0 to wait
+#define IOCTL_SET_CLOEXEC   3   // arg: 1 to keep execute from passing the descriptor on
+
+/* Readiness bits returned by a descriptor's poll */
+#define POLLIN      0x1     // read will not wait
+#define POLLOUT     0x4     // write will not wait
+#define POLLNVAL    0x20    // fd isn't open; only set by poll()
+
 struct file_desc_ftable;
 
+/* An open file. Descriptors made by dup, dup2 and execute share it, along
+ * with its position and flags; it is closed when the last one goes away. */
 typedef struct file_desc {
     struct file_desc_ftable *ftable;
+    uint32_t refcount;      // descriptors pointing here, 0 while on the free list
     int32_t inode;
     int32_t pos;
     struct file_desc_flags {
         uint8_t open :1;
-        uint32_t reserved :31;
+        uint8_t nonblock :1;
+        uint32_t reserved :30;
     } flags __attribute__((packed));
+    /* Readahead state of regular files, in blocks */
+    struct file_desc_ra {
+        uint32_t next;      // block a sequential reader reads next
+        uint32_t end;       // first block not read ahead yet
+        uint32_t window;    // blocks to stay ahead of the reader, 0 when not sequential
+    } ra;
+    /* Virtual interrupt rate of an open "rtc" */
+    struct file_desc_rtc {
+        uint32_t divider;           // RTC interrupts per virtual one
+        uint32_t deadline;          // rtc_ticks of the next virtual interrupt
+        volatile uint32_t received; // 1 while a virtual interrupt is waiting to be read
+        int32_t waiter;             // process waiting in rtc_read, -1 if none
+        struct file_desc *next;     // next in the deadline list
+    } rtc;
 } file_desc_t;
 
 typedef struct file_desc_ftable {
@@ -20,6 +47,12 @@ typedef struct file_desc_ftable {
     int32_t (*write) (file_desc_t *fd, const void* buf, int32_t nbytes);
     int32_t (*open) (file_desc_t *fd, const uint8_t* filename);
     int32_t (*close) (file_desc_t *fd);
+    int32_t (*ioctl) (file_desc_t *fd, int32_t request, int32_t arg);   // NULL if unsupported
+    int32_t (*poll) (file_desc_t *fd);      // POLLIN/POLLOUT bits; NULL if always ready
 } file_desc_ftable_t;
 
+extern file_desc_t* file_alloc(void);
+extern file_desc_t* file_get(file_desc_t *file);
+extern int32_t file_put(file_desc_t *file);
+
 #endif
@@ -1,83 +1,327 @@
 #include "fs.h"
 #include "terminal_driver.h"
 #include "rtc.h"
+#include "tmpfs.h"
+#include "blkq.h"
 
 #define DENTRY_START 64
 #define MAX_DENTRIES 63
+#define RAW_INODE 0xFFFFFFFF    // page cache key for blocks of the image itself
+#define SECTORS_PER_BLOCK (DATA_BLOCK_SIZE / ATA_SECTOR_SIZE)
+#define BOOT_BUCKETS 64          // root name index buckets, must be a power of 2
+#define DCACHE_SIZE 32          // cached path lookups, must be a power of 2
+#define RA_MIN_BLOCKS 4         // first readahead window
+#define RA_MAX_BLOCKS 32        // the window doubles up to this
+#define RA_MAX_IOS 64           // blocks being read ahead at once
+
+/* One block being read ahead */
+typedef struct ra_io {
+    blk_request_t req;
+    pcache_page_t *page;
+    uint32_t len;               // bytes of the block inside the file
+    int32_t used;
+} ra_io_t;
+
+/* A cached path lookup, valid while gen is the current dcache_gen */
+typedef struct dcache_entry {
+    uint32_t gen;
+    int32_t found;              // 0 if the path doesn't exist
+    uint8_t path[FS_PATH_LEN + 1];
+    dentry_t dentry;
+} dcache_entry_t;
 
 // Private helper functions
-static uint32_t *get_inode(uint32_t id);
-static uint8_t *get_block(uint32_t id);
+static pcache_page_t *get_inode(uint32_t id);
+static int32_t get_block(uint32_t id);
+static int32_t read_image_block(uint32_t id, uint8_t* buf);
+static int32_t fill_raw(uint32_t inode, uint32_t block, uint8_t* buf);
+static void fs_init_common(void);
+static int32_t boot_lookup(const uint8_t* fname);
+static int32_t lookup_in(uint32_t dir, const uint8_t* fname, dentry_t* dentry);
+static int32_t resolve(const uint8_t* path, dentry_t* dentry);
+static int32_t resolve_parent(const uint8_t* path, uint32_t* dir, uint8_t* name);
+static int32_t create_in(uint32_t dir, const uint8_t* fname, uint32_t type);
+static int32_t copy_up(uint32_t inode);
+static int32_t fill_block(uint32_t inode, uint32_t block, uint8_t* buf);
+static void readahead(file_desc_t *fd, uint32_t first, uint32_t last);
+static void readahead_done(blk_request_t *req);
 
-/** The memory address of the base of the filesystem. */
+/** The memory address of the base of the filesystem, if it was loaded as a module. */
 uint32_t fs_base;
-/** The "boot block" of the filesystem, containing stats and the root directory. */
+/** ATA drive holding the filesystem, or -1 if it is the module at fs_base */
+static int32_t fs_drive = -1;
+/** Copy of the "boot block" of the filesystem, containing stats and the root directory. */
+static uint8_t boot_data[DATA_BLOCK_SIZE] __attribute__((aligned (DATA_BLOCK_SIZE)));
 bootblock_t *bootblock;
+static dentry_t *root_dentries;
+/** Boot image entries hidden by a file of the same name in the writable
+ *  layer - bit i set if root entry i is hidden */
+static uint32_t shadowed[(MAX_DENTRIES + 31) / 32];
+/** Hash index of the boot image's root entries. Buckets and chains hold
+ *  entry + 1, so 0 ends a chain. */
+static uint8_t boot_index[BOOT_BUCKETS];
+static uint8_t boot_next[MAX_DENTRIES];
+/** Recent path lookups, by hash of the path. Bumping dcache_gen when a
+ *  name is added or removed drops them all. */
+static dcache_entry_t dcache[DCACHE_SIZE];
+static uint32_t dcache_gen;
+/** Readahead reads in flight */
+static ra_io_t ra_ios[RA_MAX_IOS];
 
 /** fs_init(uint32_t fs)
- * Initialize the filesystem module.
+ * Initialize the filesystem module from an image in memory.
  * Inputs: fs -- Base memory address of the file system
  * Outputs: none
  * Side effects: Initializes file system
  */
 void fs_init(uint32_t fs) {
     fs_base = fs;
-    bootblock = (bootblock_t*) fs;
+    fs_drive = -1;
+    memcpy(boot_data, (uint8_t*) fs, DATA_BLOCK_SIZE);
+    fs_init_common();
+}
+
+/** fs_init_disk(int32_t drive)
+ * Initialize the filesystem module from an image on a disk. Only the boot
+ * block is read now; everything else is read on demand through the page cache.
+ * Inputs: drive -- ATA drive holding the image, starting at sector 0
+ * Return value: 0 on success, -1 if there is no drive or it doesn't hold
+ *               a filesystem image
+ * Side effects: Initializes file system
+ */
+int32_t fs_init_disk(int32_t drive) {
+    bootblock_t *bb = (bootblock_t*) boot_data;
+    dentry_t *dot = (dentry_t*) (boot_data + DENTRY_START);
+
+    if (!ata_present(drive)) return -1;
+    if (blk_read(drive, 0, SECTORS_PER_BLOCK, boot_data)) return -1;
+
+    // The root directory always starts with "."
+    if (bb->n_dentries == 0 || bb->n_dentries > MAX_DENTRIES ||
+        bb->n_inodes == 0 || bb->n_blocks == 0 ||
+        dot->type != FILE_DIRECTORY || strncmp(dot->name, ".", 2) != 0) {
+        return -1;
+    }
+
+    fs_base = 0;
+    fs_drive = drive;
+    fs_init_common();
+    return 0;
+}
+
+/** static fs_init_common
+ * Initialization shared by both image sources, once boot_data is loaded.
+ */
+static void fs_init_common(void) {
+    int32_t i;
+
+    bootblock = (bootblock_t*) boot_data;
+    root_dentries = (dentry_t*) (boot_data + DENTRY_START);
+    if (bootblock->n_dentries > MAX_DENTRIES) bootblock->n_dentries = MAX_DENTRIES;
+
+    memset(boot_index, 0, sizeof(boot_index));
+    for (i = bootblock->n_dentries - 1; i >= 0; i--) {
+        uint32_t b = strnhash(root_dentries[i].name, DENTRY_NAME_LEN) & (BOOT_BUCKETS - 1);
+        boot_next[i] = boot_index[b];
+        boot_index[b] = i + 1;
+    }
+
+    memset(dcache, 0, sizeof(dcache));
+    dcache_gen = 1;
+    memset(shadowed, 0, sizeof(shadowed));
+    memset(ra_ios, 0, sizeof(ra_ios));
+    tmpfs_init();
+    pcache_init();
 }
 
 /** read_dentry_by_name
- * Reads the data entry from the boot block with a given filename.
- * Inputs: fname -- Null-terminated filename
+ * Reads the directory entry at a path. Paths are relative to the root, and
+ * may start with '/' and use "." and "..". In the root, files in the
+ * writable layer hide boot image files of the same name. Recent lookups
+ * are answered from the dentry cache.
+ * Inputs: fname -- Null-terminated path
  * Outputs: dentry -- Buffer to store the resulting dentry_t
  * Return value: 0 on success, -1 on failure
  * Side effects: Overwrites dentry
  */
 int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry) {
-    int i, max;
-    max = bootblock->n_dentries;
+    uint32_t len, flags, gen;
+    dcache_entry_t *entry;
+    dentry_t de;
+    int32_t found;
 
-    // Get dir. entry
-    dentry_t *root = (dentry_t*) (fs_base + DENTRY_START);
-    
-    for (i = 0; i < max; i++) {
-        if (strnlen(root[i].name, DENTRY_NAME_LEN) == strlen((const char*) fname) &&
-            strncmp(root[i].name, (const char*) fname, DENTRY_NAME_LEN) == 0) {
-            break;
-        }
-    }
+    if (fname == NULL) return -1;
+    len = strnlen((const int8_t*) fname, FS_PATH_LEN + 1);
+    if (len == 0 || len > FS_PATH_LEN) return -1;
 
-    // Fail if none found
-    if (i >= max) return -1;
+    entry = &dcache[strnhash((const int8_t*) fname, FS_PATH_LEN) & (DCACHE_SIZE - 1)];
 
-    memcpy(dentry, &root[i], sizeof(dentry_t));
+    cli_and_save(flags);
+    if (entry->gen == dcache_gen && strncmp((const int8_t*) entry->path, (const int8_t*) fname, FS_PATH_LEN + 1) == 0) {
+        found = entry->found;
+        memcpy(&de, &entry->dentry, sizeof(dentry_t));
+        restore_flags(flags);
+    } else {
+        // A name added or removed during the walk makes this result stale
+        gen = dcache_gen;
+        restore_flags(flags);
+        found = (resolve(fname, &de) == 0);
+
+        cli_and_save(flags);
+        entry->gen = gen;
+        entry->found = found;
+        strncpy((int8_t*) entry->path, (const int8_t*) fname, FS_PATH_LEN + 1);
+        memcpy(&entry->dentry, &de, sizeof(dentry_t));
+        restore_flags(flags);
+    }
 
+    if (!found) return -1;
+    memcpy(dentry, &de, sizeof(dentry_t));
     return 0;
 }
 
 /** read_dentry_by_index
- * Reads the data entry from the boot block at the given index.
+ * Reads the data entry at the given index. The boot image entries that
+ * aren't hidden come first, followed by the files in the writable layer.
  * Inputs: index -- Index of the data entry
  * Outputs: dentry -- Buffer to store the resulting dentry_t
  * Return value: 0 on success, -1 on failure
  * Side effects: Overwrites dentry
  */
 int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry) {
-    int max = bootblock->n_dentries;
-
-    // Range checking
-    if (index >= max) return -1;
+    int i, max = bootblock->n_dentries;
 
     // Get dir. entry
-    dentry_t *root = (dentry_t*) (fs_base + DENTRY_START);
+    dentry_t *root = root_dentries;
+
+    for (i = 0; i < max; i++) {
+        if (shadowed[i / 32] & (1 << (i % 32))) continue;
+        if (index-- == 0) {
+            memcpy(dentry, &root[i], sizeof(dentry_t));
+            return 0;
+        }
+    }
+
+    return tmpfs_dentry_by_index(ROOT_DIR_INODE, index, dentry);
+}
+
+/** dir_dentry_by_index
+ * Reads the entry at the given index of any directory.
+ * Inputs: dir -- Directory inode
+ *         index -- Index of the entry
+ * Outputs: dentry -- Buffer to store the resulting dentry_t
+ * Return value: 0 on success, -1 if there are not that many entries
+ * Side effects: Overwrites dentry
+ */
+int32_t dir_dentry_by_index(uint32_t dir, uint32_t index, dentry_t* dentry) {
+    if (dir == ROOT_DIR_INODE) return read_dentry_by_index(index, dentry);
+    return tmpfs_dentry_by_index(dir, index, dentry);
+}
+
+/** fs_create
+ * Creates an empty file in the writable layer, or truncates it if it
+ * already exists. A boot image file of the same name is hidden.
+ * Inputs: fname -- Null-terminated path
+ * Return value: Inode number of the file, or -1 if failed
+ * Side effects: May allocate an inode, or free the file's blocks
+ */
+int32_t fs_create(const uint8_t* fname) {
+    uint8_t name[DENTRY_NAME_LEN + 1];
+    uint32_t dir;
+
+    if (resolve_parent(fname, &dir, name)) return -1;
+    return create_in(dir, name, FILE_REGULAR);
+}
+
+/** fs_mkdir
+ * Creates an empty directory in the writable layer.
+ * Inputs: fname -- Null-terminated path
+ * Return value: Inode number of the directory, or -1 if failed (the name
+ *               is already used)
+ * Side effects: May allocate an inode
+ */
+int32_t fs_mkdir(const uint8_t* fname) {
+    uint8_t name[DENTRY_NAME_LEN + 1];
+    uint32_t dir;
+
+    if (resolve_parent(fname, &dir, name)) return -1;
+    return create_in(dir, name, FILE_DIRECTORY);
+}
+
+/** fs_unlink
+ * Removes a file or an empty directory from the writable layer. If it hid
+ * a boot image file, the original becomes visible again. Descriptors that
+ * still have it open keep using it until they are closed.
+ * Inputs: fname -- Null-terminated path
+ * Return value: 0 on success, -1 if failed (boot image files can't be removed)
+ * Side effects: Frees the file's inode and blocks
+ */
+int32_t fs_unlink(const uint8_t* fname) {
+    uint8_t name[DENTRY_NAME_LEN + 1];
+    uint32_t dir, flags;
+    int32_t i;
+
+    if (resolve_parent(fname, &dir, name)) return -1;
+    if (tmpfs_unlink(dir, name)) return -1;
+
+    cli_and_save(flags);
+    dcache_gen++;
+    restore_flags(flags);
+
+    if (dir == ROOT_DIR_INODE) {
+        i = boot_lookup(name);
+        if (i >= 0) shadowed[i / 32] &= ~(1 << (i % 32));
+    }
+
+    return 0;
+}
+
+/** fs_stat
+ * Describe a file.
+ * Inputs: inode -- Inode number of the file
+ *         type -- Its type, one of Filetype
+ * Outputs: buf -- The file's metadata
+ * Return value: 0 on success, -1 if bad inode
+ * Side effects: Overwrites buf
+ */
+int32_t fs_stat(uint32_t inode, uint32_t type, stat_t* buf) {
+    int32_t size = 0;
 
-    memcpy(dentry, &root[index], sizeof(dentry_t));
+    if (type == FILE_REGULAR) {
+        size = fs_file_size(inode);
+        if (size < 0) return -1;
+    }
 
+    buf->inode = inode;
+    buf->type = type;
+    buf->size = size;
+    buf->blocks = (size + DATA_BLOCK_SIZE - 1) / DATA_BLOCK_SIZE;
     return 0;
 }
 
+/** fs_file_size
+ * Get the size of a file.
+ * Inputs: inode -- Inode number of the file
+ * Return value: File size in bytes, or -1 if bad inode
+ * Side effects: none
+ */
+int32_t fs_file_size(uint32_t inode) {
+    pcache_page_t *page;
+    int32_t size;
+
+    if (IS_TMPFS_INODE(inode)) return tmpfs_size(inode);
+
+    page = get_inode(inode);
+    if (page == NULL) return -1;
+    size = ((uint32_t*) page->data)[0];
+    pcache_put(page);
+    return size;
+}
+
 /** read_data
  * Reads data from an inode. If there are not enough bytes,
  * it will stop reading when it reaches the end of the file.
+ * Boot image blocks are read through the page cache.
  * Inputs: inode -- The index of the inode to read
  *         offset -- The byte offset to begin reading
  *         length -- The number of bytes to read
@@ -89,13 +333,13 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
     uint32_t blocknum    = offset / DATA_BLOCK_SIZE;
     uint32_t blockoffset = offset % DATA_BLOCK_SIZE;
     uint32_t count = 0;
+
+    if (IS_TMPFS_INODE(inode)) return tmpfs_read(inode, offset, buf, length);
     
-    uint32_t *file = get_inode(inode);
+    int32_t filesize = fs_file_size(inode); // File size, in bytes
 
     // Return if bad inode
-    if (file == NULL) return -1;
-
-    uint32_t filesize = file[0]; // File size, in bytes
+    if (filesize < 0) return -1;
 
     // Return if already past end
     if (offset >= filesize) return 0;
@@ -105,10 +349,10 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
         length = filesize - offset;
 
     while (count < length) {
-        uint8_t *block = get_block(file[blocknum + 1]);
+        pcache_page_t *page = pcache_get(inode, blocknum, fill_block);
         
         // Return if bad block
-        if (block == NULL) return -1;
+        if (page == NULL) return -1;
 
         uint32_t readlen = length - count;
 
@@ -116,7 +360,8 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
         if (readlen > DATA_BLOCK_SIZE - blockoffset)
             readlen = DATA_BLOCK_SIZE - blockoffset;
         
-        memcpy(buf+count, &block[blockoffset], readlen);
+        memcpy(buf+count, &page->data[blockoffset], readlen);
+        pcache_put(page);
 
         count += readlen;
         blocknum ++;
@@ -126,32 +371,414 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
     return count;
 }
 
+/** fs_get_page
+ * Get the cache page holding a block of a boot image file. The caller
+ * must release it with pcache_put.
+ * Inputs: inode -- Boot image inode of the file
+ *         block -- Block index within the file
+ * Return value: The held page, or NULL if there is no such block or the
+ *               file is in the writable layer
+ * Side effects: May read the block into the cache
+ */
+pcache_page_t* fs_get_page(uint32_t inode, uint32_t block) {
+    if (IS_TMPFS_INODE(inode)) return NULL;
+    return pcache_get(inode, block, fill_block);
+}
+
 /** static get_inode
- * Get a pointer to an inode.
+ * Get the cache page holding an inode. Release it with pcache_put.
  * Inputs: id -- Index to get
- * Return value: Pointer to the inode, or null if out of bounds.
- * Side effects: none
+ * Return value: The held page, or null if out of bounds or unreadable.
+ * Side effects: May read the inode into the cache
  */
-static uint32_t *get_inode(uint32_t id) {
+static pcache_page_t *get_inode(uint32_t id) {
     if (id >= bootblock->n_inodes) return NULL;
-    return (uint32_t*) (fs_base + (id + 1)*DATA_BLOCK_SIZE);
+    return pcache_get(RAW_INODE, id + 1, fill_raw);
 }
 
 /** static get_block
- * Get a pointer to a filesystem data block.
+ * Get the position of a filesystem data block in the image.
  * Inputs: id -- Index to get
- * Return value: Pointer to the data block, or null if out of bounds.
+ * Return value: Block number within the image, or -1 if out of bounds.
+ * Side effects: none
+ */
+static int32_t get_block(uint32_t id) {
+    if (id >= bootblock->n_blocks) return -1;
+    return id + bootblock->n_inodes + 1;
+}
+
+/** static read_image_block
+ * Read one block of the filesystem image from wherever it lives.
+ * Inputs: id -- Block number within the image
+ * Outputs: buf -- Identity mapped buffer of DATA_BLOCK_SIZE bytes
+ * Return value: 0 on success, -1 on a disk error
+ * Side effects: Overwrites buf
+ */
+static int32_t read_image_block(uint32_t id, uint8_t* buf) {
+    if (fs_drive >= 0) {
+        return blk_read(fs_drive, id * SECTORS_PER_BLOCK, SECTORS_PER_BLOCK, buf);
+    }
+    memcpy(buf, (uint8_t*) (fs_base + id * DATA_BLOCK_SIZE), DATA_BLOCK_SIZE);
+    return 0;
+}
+
+/** static fill_raw
+ * Page cache fill function for blocks of the image itself (inodes).
+ */
+static int32_t fill_raw(uint32_t inode, uint32_t block, uint8_t* buf) {
+    return read_image_block(block, buf);
+}
+
+/** static fill_block
+ * Page cache fill function for the boot image: copies one data block.
+ * Bytes past the end of the file are zeroed, since the page may be mapped.
+ * Inputs: inode -- Boot image inode
+ *         block -- Block index within the file
+ * Outputs: buf -- Page to fill
+ * Return value: 0 on success, -1 if the block doesn't exist
+ * Side effects: Overwrites buf
+ */
+static int32_t fill_block(uint32_t inode, uint32_t block, uint8_t* buf) {
+    pcache_page_t *page = get_inode(inode);
+    uint32_t *file;
+    uint32_t size;
+    int32_t id = -1;
+
+    if (page == NULL) return -1;
+
+    file = (uint32_t*) page->data;
+    size = file[0];
+    if (block < DATA_BLOCK_SIZE / 4 - 1 && block * DATA_BLOCK_SIZE < size) {
+        id = get_block(file[block + 1]);
+    }
+    pcache_put(page);
+
+    // Read straight into the page, the block isn't cached twice
+    if (id < 0 || read_image_block(id, buf)) return -1;
+
+    if (size - block * DATA_BLOCK_SIZE < DATA_BLOCK_SIZE) {
+        uint32_t len = size - block * DATA_BLOCK_SIZE;
+        memset(buf + len, 0, DATA_BLOCK_SIZE - len);
+    }
+    return 0;
+}
+
+/** static readahead
+ * Start reading the blocks after a sequential reader in the background,
+ * so its next reads hit the page cache. The window starts at RA_MIN_BLOCKS
+ * and doubles each time the reader catches up to half of it; a read that
+ * doesn't follow the last one turns readahead off until reads are
+ * sequential again.
+ * Inputs: fd -- Descriptor of a boot image file
+ *         first, last -- Blocks the reader is about to read
+ * Return value: none
+ * Side effects: Updates fd->ra, submits disk reads
+ */
+static void readahead(file_desc_t *fd, uint32_t first, uint32_t last) {
+    pcache_page_t *ipage;
+    uint32_t *file;
+    uint32_t size, nblocks, b, end, flags;
+    int32_t i, id;
+
+    // Only worth it when blocks come from the disk
+    if (fs_drive < 0 || IS_TMPFS_INODE(fd->inode)) return;
+
+    if (first != fd->ra.next && first + 1 != fd->ra.next) {
+        fd->ra.window = 0;
+        fd->ra.end = 0;
+        fd->ra.next = last + 1;
+        return;
+    }
+    fd->ra.next = last + 1;
+
+    if (fd->ra.window == 0) {
+        fd->ra.window = RA_MIN_BLOCKS;
+    } else if (fd->ra.end >= last + 1 + fd->ra.window / 2) {
+        return;     // still far enough ahead
+    } else if (fd->ra.window < RA_MAX_BLOCKS) {
+        fd->ra.window *= 2;
+    }
+
+    ipage = get_inode(fd->inode);
+    if (ipage == NULL) return;
+    file = (uint32_t*) ipage->data;
+    size = file[0];
+    nblocks = (size + DATA_BLOCK_SIZE - 1) / DATA_BLOCK_SIZE;
+    if (nblocks > DATA_BLOCK_SIZE / 4 - 1) nblocks = DATA_BLOCK_SIZE / 4 - 1;
+
+    end = last + 1 + fd->ra.window;
+    if (end > nblocks) end = nblocks;
+
+    for (b = (fd->ra.end > first) ? fd->ra.end : first; b < end; b++) {
+        pcache_page_t *page;
+        ra_io_t *io = NULL;
+
+        id = get_block(file[b + 1]);
+        if (id < 0) break;
+
+        cli_and_save(flags);
+        for (i = 0; i < RA_MAX_IOS; i++) {
+            if (!ra_ios[i].used) {
+                io = &ra_ios[i];
+                io->used = 1;
+                break;
+            }
+        }
+        restore_flags(flags);
+        if (io == NULL) break;
+
+        page = pcache_start_load(fd->inode, b);
+        if (page == NULL) {
+            io->used = 0;
+            continue;       // already cached
+        }
+
+        io->page = page;
+        io->len = (size - b * DATA_BLOCK_SIZE < DATA_BLOCK_SIZE) ? size - b * DATA_BLOCK_SIZE : DATA_BLOCK_SIZE;
+        io->req.drive = fs_drive;
+        io->req.lba = id * SECTORS_PER_BLOCK;
+        io->req.count = SECTORS_PER_BLOCK;
+        io->req.buf = page->data;
+        io->req.callback = readahead_done;
+        io->req.private = io;
+        if (blk_submit(&io->req)) {
+            pcache_end_load(page, -1);
+            io->used = 0;
+            break;
+        }
+    }
+    pcache_put(ipage);
+
+    if (b > fd->ra.end) fd->ra.end = b;
+}
+
+/** static readahead_done
+ * Block request callback of a readahead read. Runs in interrupt context.
+ * Inputs: req -- The finished request
+ * Return value: none
+ * Side effects: Publishes the page to the cache, frees the request
+ */
+static void readahead_done(blk_request_t *req) {
+    ra_io_t *io = (ra_io_t*) req->private;
+
+    // Like fill_block, zero what's past the end of the file
+    if (!req->error && io->len < DATA_BLOCK_SIZE) {
+        memset(io->page->data + io->len, 0, DATA_BLOCK_SIZE - io->len);
+    }
+    pcache_end_load(io->page, req->error);
+    io->used = 0;
+}
+
+/** static boot_lookup
+ * Find a file in the boot image's root directory through its name index.
+ * Inputs: fname -- Null-terminated filename
+ * Return value: Index of the directory entry, or -1 if not found
+ * Side effects: none
+ */
+static int32_t boot_lookup(const uint8_t* fname) {
+    uint32_t len = strlen((const char*) fname);
+    dentry_t *root = root_dentries;
+    uint8_t e;
+
+    if (len == 0 || len > DENTRY_NAME_LEN) return -1;
+
+    e = boot_index[strnhash((const int8_t*) fname, DENTRY_NAME_LEN) & (BOOT_BUCKETS - 1)];
+    for (; e != 0; e = boot_next[e - 1]) {
+        if (strnlen(root[e - 1].name, DENTRY_NAME_LEN) == len &&
+            strncmp(root[e - 1].name, (const char*) fname, DENTRY_NAME_LEN) == 0) {
+            return e - 1;
+        }
+    }
+    return -1;
+}
+
+/** static lookup_in
+ * Find a name in one directory.
+ * Inputs: dir -- Directory inode
+ *         fname -- Null-terminated filename
+ * Outputs: dentry -- The entry
+ * Return value: 0 on success, -1 if not found
+ * Side effects: Overwrites dentry
+ */
+static int32_t lookup_in(uint32_t dir, const uint8_t* fname, dentry_t* dentry) {
+    int32_t i;
+
+    if (tmpfs_lookup(dir, fname, dentry) == 0) return 0;
+    if (dir != ROOT_DIR_INODE) return -1;
+
+    i = boot_lookup(fname);
+    if (i < 0) return -1;
+    memcpy(dentry, &root_dentries[i], sizeof(dentry_t));
+    return 0;
+}
+
+/** static resolve
+ * Walk a path from the root one name at a time.
+ * Inputs: path -- Null-terminated path
+ * Outputs: dentry -- Entry of the last name; "." and ".." give a
+ *                    directory entry of that name
+ * Return value: 0 on success, -1 if a name doesn't exist or isn't a directory
+ * Side effects: Overwrites dentry
+ */
+static int32_t resolve(const uint8_t* path, dentry_t* dentry) {
+    uint8_t name[DENTRY_NAME_LEN + 1];
+    uint32_t dir = ROOT_DIR_INODE;
+    uint32_t len;
+    dentry_t de;
+
+    memset(&de, 0, sizeof(dentry_t));
+    de.name[0] = '.';
+    de.type = FILE_DIRECTORY;
+    de.inode = ROOT_DIR_INODE;
+
+    while (*path != '\0') {
+        while (*path == '/') path++;
+        if (*path == '\0') break;
+
+        for (len = 0; path[len] != '/' && path[len] != '\0'; len++);
+        if (len > DENTRY_NAME_LEN || de.type != FILE_DIRECTORY) return -1;
+        memcpy(name, path, len);
+        name[len] = '\0';
+        path += len;
+
+        if (strncmp((int8_t*) name, ".", 2) == 0) continue;
+        if (strncmp((int8_t*) name, "..", 3) == 0) {
+            dir = tmpfs_parent(dir);
+            memset(&de, 0, sizeof(dentry_t));
+            strncpy(de.name, "..", DENTRY_NAME_LEN);
+            de.type = FILE_DIRECTORY;
+            de.inode = dir;
+            continue;
+        }
+
+        if (lookup_in(dir, name, &de)) return -1;
+        if (de.type == FILE_DIRECTORY) dir = de.inode;
+    }
+
+    memcpy(dentry, &de, sizeof(dentry_t));
+    return 0;
+}
+
+/** static resolve_parent
+ * Split a path into the directory that holds it and its last name.
+ * Inputs: path -- Null-terminated path
+ * Outputs: dir -- Inode of the directory
+ *          name -- Last name of the path, DENTRY_NAME_LEN + 1 bytes
+ * Return value: 0 on success, -1 if the directory doesn't exist or the
+ *               last name is empty, "." or ".."
  * Side effects: none
  */
-static uint8_t *get_block(uint32_t id) {
-    if (id >= bootblock->n_blocks) return NULL;
-    return (uint8_t*) (fs_base + (id + bootblock->n_inodes + 1)*DATA_BLOCK_SIZE);
+static int32_t resolve_parent(const uint8_t* path, uint32_t* dir, uint8_t* name) {
+    uint8_t parent[FS_PATH_LEN + 1];
+    uint32_t len, start;
+    dentry_t de;
+
+    if (path == NULL) return -1;
+    len = strnlen((const int8_t*) path, FS_PATH_LEN + 1);
+    if (len == 0 || len > FS_PATH_LEN) return -1;
+
+    for (start = len; start > 0 && path[start - 1] != '/'; start--);
+    if (len - start == 0 || len - start > DENTRY_NAME_LEN) return -1;
+
+    memcpy(name, path + start, len - start);
+    name[len - start] = '\0';
+    if (strncmp((int8_t*) name, ".", 2) == 0 || strncmp((int8_t*) name, "..", 3) == 0) return -1;
+
+    if (start == 0) {
+        *dir = ROOT_DIR_INODE;
+        return 0;
+    }
+
+    memcpy(parent, path, start);
+    parent[start] = '\0';
+    if (read_dentry_by_name(parent, &de) || de.type != FILE_DIRECTORY) return -1;
+    *dir = de.inode;
+    return 0;
+}
+
+/** static create_in
+ * Creates a file or directory in a directory. In the root, a regular file
+ * may hide a boot image file of the same name.
+ * Inputs: dir -- Directory inode
+ *         fname -- Null-terminated filename
+ *         type -- FILE_REGULAR or FILE_DIRECTORY
+ * Return value: Inode number, or -1 if failed
+ * Side effects: May allocate an inode, or truncate an existing file
+ */
+static int32_t create_in(uint32_t dir, const uint8_t* fname, uint32_t type) {
+    dentry_t *root = root_dentries;
+    int32_t i = -1;
+    int32_t inode;
+    uint32_t flags;
+
+    if (dir == ROOT_DIR_INODE) {
+        // Only regular files can be replaced
+        i = boot_lookup(fname);
+        if (i >= 0 && (type != FILE_REGULAR || root[i].type != FILE_REGULAR)) return -1;
+    }
+
+    inode = tmpfs_create(dir, fname, type);
+    if (inode < 0) return -1;
+    if (i >= 0) shadowed[i / 32] |= (1 << (i % 32));
+
+    cli_and_save(flags);
+    dcache_gen++;
+    restore_flags(flags);
+
+    return inode;
+}
+
+/** static copy_up
+ * Copy a boot image file into the writable layer under the same name.
+ * If another descriptor already copied it, that copy is used.
+ * Inputs: inode -- Boot image inode of the file
+ * Return value: Inode number of the writable copy, or -1 if failed
+ * Side effects: Allocates an inode and blocks, hides the original
+ */
+static int32_t copy_up(uint32_t inode) {
+    dentry_t *root = root_dentries;
+    uint8_t name[DENTRY_NAME_LEN + 1];
+    int32_t size = fs_file_size(inode);
+    dentry_t de;
+    int32_t i, copy;
+    uint32_t offset;
+
+    if (size < 0) return -1;
+
+    for (i = 0; i < bootblock->n_dentries; i++) {
+        if (root[i].type == FILE_REGULAR && root[i].inode == inode) break;
+    }
+    if (i >= bootblock->n_dentries) return -1;
+
+    strncpy((int8_t*) name, root[i].name, DENTRY_NAME_LEN);
+    name[DENTRY_NAME_LEN] = '\0';
+
+    if (tmpfs_lookup(ROOT_DIR_INODE, name, &de) == 0) return de.inode;
+
+    copy = fs_create(name);
+    if (copy < 0) return -1;
+
+    for (offset = 0; offset < size; offset += DATA_BLOCK_SIZE) {
+        pcache_page_t *page = fs_get_page(inode, offset / DATA_BLOCK_SIZE);
+        uint32_t len = size - offset;
+        if (len > DATA_BLOCK_SIZE) len = DATA_BLOCK_SIZE;
+
+        if (page == NULL || tmpfs_write(copy, offset, page->data, len) != len) {
+            if (page != NULL) pcache_put(page);
+            fs_unlink(name);
+            return -1;
+        }
+        pcache_put(page);
+    }
+
+    return copy;
 }
 
 
 /** file_read
  * Read data from a file descriptor. Subsequent calls advance the file pointer.
- * Will not read past the end of a file.
+ * Will not read past the end of a file. Sequential reads start reading
+ * the following blocks ahead of time.
  * Inputs: fd -- File descriptor
  *         buf -- Buffer to copy to
  *         nbytes -- Number of bytes to copy
@@ -159,7 +786,12 @@ static uint8_t *get_block(uint32_t id) {
  * Side effects: Increases file descriptor's read position
  */
 int32_t file_read (file_desc_t *fd, void* buf, int32_t nbytes) {
-    int32_t count = read_data(fd->inode, fd->pos, buf, nbytes);
+    int32_t count;
+
+    if (nbytes > 0) {
+        readahead(fd, fd->pos / DATA_BLOCK_SIZE, (fd->pos + nbytes - 1) / DATA_BLOCK_SIZE);
+    }
+    count = read_data(fd->inode, fd->pos, buf, nbytes);
 
     // Add to pos if no error
     if (count > 0) fd->pos += count;
@@ -167,14 +799,81 @@ int32_t file_read (file_desc_t *fd, void* buf, int32_t nbytes) {
     return count;
 }
 
+/** file_pread
+ * Read data from a file at a given offset. The file position doesn't move.
+ * Inputs: fd -- File descriptor
+ *         buf -- Buffer to copy to
+ *         nbytes -- Number of bytes to copy
+ *         offset -- Byte offset to read from
+ * Return value: Number of bytes actually read, 0 at or past the end, or -1 if failed
+ * Side effects: none
+ */
+int32_t file_pread(file_desc_t* fd, void* buf, int32_t nbytes, int32_t offset) {
+    if (buf == NULL || nbytes < 0 || offset < 0) return -1;
+    return read_data(fd->inode, offset, buf, nbytes);
+}
+
+/** fs_lseek
+ * Move the position of a file or directory descriptor. A file's position
+ * may go past its end; writing there leaves a hole of zeros. A directory's
+ * position is the index of the next entry dir_read returns.
+ * Inputs: fd -- File or directory descriptor
+ *         offset -- New position, relative to whence
+ *         whence -- SEEK_SET, SEEK_CUR or SEEK_END (files only)
+ * Return value: The new position, or -1 if it would be negative or whence is bad
+ * Side effects: Changes fd->pos
+ */
+int32_t fs_lseek(file_desc_t* fd, int32_t offset, int32_t whence) {
+    int32_t base;
+
+    switch (whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = fd->pos;
+            break;
+        case SEEK_END:
+            if (fd->ftable != &file_regular_ftable) return -1;
+            base = fs_file_size(fd->inode);
+            if (base < 0) return -1;
+            break;
+        default:
+            return -1;
+    }
+
+    if (offset > 0 && base > 0x7FFFFFFF - offset) return -1;
+    if (base + offset < 0) return -1;
+    fd->pos = base + offset;
+    return fd->pos;
+}
+
 /** file_write
- * Write data to a file descriptor. Unimplemented, since this FS is read-only.
- * Inputs: Ignored
- * Return value: -1
- * Side effects: None
+ * Write data to a file descriptor at its current position. The boot image
+ * is read-only, so the first write to one of its files copies the file
+ * into the writable layer.
+ * Inputs: fd -- File descriptor
+ *         buf -- Data to write
+ *         nbytes -- Number of bytes to write
+ * Return value: Number of bytes actually written, or -1 if failed
+ * Side effects: Increases file descriptor's position
  */
 int32_t file_write (file_desc_t *fd, const void* buf, int32_t nbytes) {
-    return -1;
+    if (buf == NULL || nbytes < 0) return -1;
+
+    if (!IS_TMPFS_INODE(fd->inode)) {
+        int32_t inode = copy_up(fd->inode);
+        if (inode < 0) return -1;
+        tmpfs_open(inode);
+        fd->inode = inode;
+    }
+
+    int32_t count = tmpfs_write(fd->inode, fd->pos, buf, nbytes);
+
+    // Add to pos if no error
+    if (count > 0) fd->pos += count;
+
+    return count;
 }
 
 /** file_open
@@ -198,33 +897,48 @@ int32_t file_open (file_desc_t *fd, const uint8_t* filename) {
         return -1;
     }
 
-    uint32_t *inode = get_inode(de.inode);
-    if (inode == NULL) {
+    // Files in the writable layer are always consistent
+    if (IS_TMPFS_INODE(de.inode)) {
+        tmpfs_open(de.inode);
+        fd->inode = de.inode;
+        fd->pos = 0;
+        fd->flags.open = 1;
+        memset(&fd->ra, 0, sizeof(fd->ra));
+        return 0;
+    }
+
+    pcache_page_t *page = get_inode(de.inode);
+    if (page == NULL) {
         printf("Bad inode %d\n", de.inode);
         return -1;
     }
+    uint32_t *inode = (uint32_t*) page->data;
     for (i = 0; i < inode[0] / DATA_BLOCK_SIZE; i++) {
-        uint8_t *block = get_block(inode[i+1]);
-        if (block == NULL) {
+        if (get_block(inode[i+1]) < 0) {
             printf("Bad block %d in inode %d\n", de.inode);
+            pcache_put(page);
             return -1;
         }
     }
+    pcache_put(page);
 
     fd->inode = de.inode;
     fd->pos = 0;
     fd->flags.open = 1;
+    memset(&fd->ra, 0, sizeof(fd->ra));
 
     return 0;
 }
 
 /** file_close
- * Close a file descriptor.
+ * Close a file descriptor. A file unlinked while open is freed once its
+ * last open file is closed.
  * Inputs: fd -- File descriptor
  * Return value: -1
  * Side effects: Closes fd
  */
 int32_t file_close (file_desc_t *fd) {
+    if (IS_TMPFS_INODE(fd->inode)) tmpfs_close(fd->inode);
     fd->flags.open = 0;
     return 0;
 }
@@ -242,7 +956,7 @@ int32_t dir_read (file_desc_t *fd, void* buf, int32_t nbytes) {
     uint8_t *sbuf = (uint8_t*) buf;
 
     dentry_t de;
-    int32_t err = read_dentry_by_index(fd->pos, &de);
+    int32_t err = dir_dentry_by_index(fd->inode, fd->pos, &de);
 
     // Add to pos if no error
     if (err) {
@@ -263,14 +977,60 @@ int32_t dir_read (file_desc_t *fd, void* buf, int32_t nbytes) {
     }
 }
 
+/** dir_getdents
+ * Read as many entries of a directory as fit in a buffer. Subsequent calls
+ * continue where the last one stopped.
+ * Inputs: fd -- Directory file descriptor
+ *         nbytes -- Size of buf
+ * Outputs: buf -- The entries, packed
+ * Return value: Number of bytes filled, 0 after the last entry, or -1 if
+ *               buf can't hold a single entry
+ * Side effects: Advances the file descriptor's position
+ */
+int32_t dir_getdents(file_desc_t* fd, dirent_t* buf, int32_t nbytes) {
+    int32_t count = 0;
+    dentry_t de;
+
+    if (buf == NULL || nbytes < (int32_t) sizeof(dirent_t)) return -1;
+
+    while (count + (int32_t) sizeof(dirent_t) <= nbytes && dir_dentry_by_index(fd->inode, fd->pos, &de) == 0) {
+        dirent_t *ent = &buf[count / sizeof(dirent_t)];
+        int32_t size = (de.type == FILE_REGULAR) ? fs_file_size(de.inode) : 0;
+
+        ent->inode = de.inode;
+        ent->type = de.type;
+        ent->size = (size > 0) ? size : 0;
+        strncpy((int8_t*) ent->name, de.name, DENTRY_NAME_LEN);
+        ent->name[DENTRY_NAME_LEN] = '\0';
+
+        fd->pos++;
+        count += sizeof(dirent_t);
+    }
+
+    return count;
+}
+
 /** dir_write
- * Write data to a directory. Unimplemented, since this FS is read-only.
- * Inputs: Ignored
- * Return value: -1
- * Side effects: None
+ * Create a file in the open directory. The data written is the new
+ * file's name. An existing file of that name in the writable layer is
+ * truncated.
+ * Inputs: fd -- File descriptor
+ *         buf -- Filename, not necessarily null-terminated
+ *         nbytes -- Length of the filename
+ * Return value: nbytes on success, or -1 if failed
+ * Side effects: Creates or truncates a file
  */
 int32_t dir_write (file_desc_t *fd, const void* buf, int32_t nbytes) {
-    return -1;
+    uint8_t name[DENTRY_NAME_LEN + 1];
+
+    if (buf == NULL || nbytes <= 0 || nbytes > DENTRY_NAME_LEN) return -1;
+
+    memcpy(name, buf, nbytes);
+    name[nbytes] = '\0';
+    if (strlen((int8_t*) name) != nbytes) return -1;
+
+    if (create_in(fd->inode, name, FILE_REGULAR) < 0) return -1;
+    return nbytes;
 }
 
 /** dir_open
@@ -292,6 +1052,7 @@ int32_t dir_open (file_desc_t *fd, const uint8_t* filename) {
         return -1;
     }
 
+    if (IS_TMPFS_INODE(de.inode)) tmpfs_open(de.inode);
     fd->inode = de.inode;
     fd->pos = 0;
     fd->flags.open = 1;
@@ -306,14 +1067,15 @@ int32_t dir_open (file_desc_t *fd, const uint8_t* filename) {
  * Side effects: Closes fd
  */
 int32_t dir_close (file_desc_t *fd) {
+    if (IS_TMPFS_INODE(fd->inode)) tmpfs_close(fd->inode);
     fd->flags.open = 0;
     return 0;
 }
 
-file_desc_ftable_t file_regular_ftable = {file_read, file_write, file_open, file_close};
-file_desc_ftable_t file_dir_ftable     = {dir_read, dir_write, dir_open, dir_close};
-file_desc_ftable_t stdinout            = {terminal_read, terminal_write, terminal_open, terminal_close};
-file_desc_ftable_t rtc_ftable          = {rtc_read, rtc_write, rtc_open, rtc_close};
+file_desc_ftable_t file_regular_ftable = {file_read, file_write, file_open, file_close, NULL, NULL};
+file_desc_ftable_t file_dir_ftable     = {dir_read, dir_write, dir_open, dir_close, NULL, NULL};
+file_desc_ftable_t stdinout            = {terminal_read, terminal_write, terminal_open, terminal_close, terminal_ioctl, terminal_poll};
+file_desc_ftable_t rtc_ftable          = {rtc_read, rtc_write, rtc_open, rtc_close, NULL, rtc_poll};
 
 
 
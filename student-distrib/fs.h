@@ -3,12 +3,20 @@
 
 #include "lib.h"
 #include "filedescriptor.h"
+#include "pcache.h"
 
 #define DENTRY_NAME_LEN 32
 #define DATA_BLOCK_SIZE 0x1000
+#define FS_PATH_LEN 128         // longest path, not counting the null
+/* Directory inode of the root. The boot image only has the root directory;
+ * every other directory is a writable-layer inode. */
+#define ROOT_DIR_INODE 0
 
 enum Filetype {FILE_RTC = 0, FILE_DIRECTORY = 1, FILE_REGULAR = 2};
 
+/* lseek origins */
+enum Seek {SEEK_SET = 0, SEEK_CUR = 1, SEEK_END = 2};
+
 typedef struct bootblock {
     uint32_t n_dentries;
     uint32_t n_inodes;
@@ -22,16 +30,44 @@ typedef struct dentry {
     int8_t reserved[24];
 } dentry_t;
 
+/* File metadata as returned to user programs by stat and fstat */
+typedef struct stat {
+    uint32_t inode;
+    uint32_t type;                      // one of Filetype
+    uint32_t size;                      // bytes in a regular file, 0 otherwise
+    uint32_t blocks;                    // data blocks
+} stat_t;
+
+/* Directory entry as returned to user programs by getdents */
+typedef struct dirent {
+    uint32_t inode;
+    uint32_t type;                      // one of Filetype
+    uint32_t size;                      // bytes in a regular file, 0 otherwise
+    uint8_t name[DENTRY_NAME_LEN + 1];  // null-terminated
+} dirent_t;
+
 extern file_desc_ftable_t file_regular_ftable;
 extern file_desc_ftable_t file_dir_ftable    ;
 extern file_desc_ftable_t stdinout;
 extern file_desc_ftable_t rtc_ftable;
 
 extern void fs_init(uint32_t fs);
+extern int32_t fs_init_disk(int32_t drive);
 
 extern int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
 extern int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry);
+extern int32_t dir_dentry_by_index(uint32_t dir, uint32_t index, dentry_t* dentry);
 extern int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
 
+extern int32_t fs_create(const uint8_t* fname);
+extern int32_t fs_mkdir(const uint8_t* fname);
+extern int32_t fs_unlink(const uint8_t* fname);
+extern int32_t fs_file_size(uint32_t inode);
+extern int32_t fs_stat(uint32_t inode, uint32_t type, stat_t* buf);
+extern int32_t fs_lseek(file_desc_t* fd, int32_t offset, int32_t whence);
+extern int32_t file_pread(file_desc_t* fd, void* buf, int32_t nbytes, int32_t offset);
+extern int32_t dir_getdents(file_desc_t* fd, dirent_t* buf, int32_t nbytes);
+extern pcache_page_t* fs_get_page(uint32_t inode, uint32_t block);
+
 
 #endif
@@ -3,6 +3,7 @@
  */
 
 #include "i8259.h"
+#include "apic.h"
 #include "lib.h"
 
 /* Interrupt masks to determine which interrupts are enabled and disabled */
@@ -35,7 +36,7 @@ void i8259_init(void) {
     enable_irq(SLAVE_IRQ);
 }
 
-/* Enable (unmask) the specified IRQ 
+/* Enable (unmask) the specified IRQ, at the IO-APIC once it's in use
  *      INPUTS: irq_num - IRQ number to enable, range 0-15
  *      OUTPUTS: sets bit (irq_num) of master_mask or slave_mask low
  *      RETURN VALUE: none
@@ -47,6 +48,11 @@ void enable_irq(uint32_t irq_num) {
         return;
     }
 
+    if(apic_enabled){
+        ioapic_set_mask(irq_num, 0);
+        return;
+    }
+
     if(irq_num < PIC_SIZE){
         mask = ~(1 << irq_num);
         master_mask &= mask;
@@ -60,7 +66,7 @@ void enable_irq(uint32_t irq_num) {
 
 }
 
-/* Disable (mask) the specified IRQ 
+/* Disable (mask) the specified IRQ, at the IO-APIC once it's in use
  *      INPUTS: irq_num - IRQ number to disable, range 0-15
  *      OUTPUTS: sets bit (irq_num) of master_mask or slave_mask high
  *      RETURN VALUE: none
@@ -72,6 +78,11 @@ void disable_irq(uint32_t irq_num) {
         return;
     }
 
+    if(apic_enabled){
+        ioapic_set_mask(irq_num, 1);
+        return;
+    }
+
     if(irq_num < PIC_SIZE){
         mask = (1 << irq_num);
         master_mask |= mask;
@@ -89,13 +100,19 @@ void disable_irq(uint32_t irq_num) {
  *      INPUTS: irq_num - IRQ number to send EOI to, range 0-15
  *      OUTPUTS: none
  *      RETURN VALUE: none
- *      SIDE EFFECTS: sends EOI, tells device we are done servicing interrupt
+ *      SIDE EFFECTS: sends EOI, tells device we are done servicing interrupt.
+ *                    With the APIC in use it's one write to the local APIC
  */
 void send_eoi(uint32_t irq_num) {
     if(irq_num > MAX_INTERRUPT){
         return;
     }
 
+    if(apic_enabled){
+        lapic_eoi();
+        return;
+    }
+
     if(irq_num >= PIC_SIZE){   // send to both master and slave
         irq_num -= PIC_SIZE;
         outb((EOI | irq_num), SLAVE_8259_PORT);
@@ -32,7 +32,8 @@
  * to declare the interrupt finished */
 #define EOI                 0x60
 
-/* Externally-visible functions */
+/* Externally-visible functions. Once apic_init has switched to the
+ * IO-APIC (apic.c), the mask and EOI calls go there instead. */
 
 /* Enables both PICs (note: interrupts should be disabled before calling)
  *      INPUTS: none
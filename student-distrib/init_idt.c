@@ -4,6 +4,7 @@
 #include "init_idc.h"
 #include "system_call_linkage.h"
 #include "scheduling.h"
+#include "apic.h"
 
 /* IDT structure for reference
 typedef union idt_desc_t {
@@ -102,10 +103,24 @@ void idt_initialize() {
     SET_IDT_ENTRY(idt[0x28], asm_rtc);     
     idt[0x28].present = 1;              
     
+    //initialize primary IDE channel in IDT
+    SET_IDT_ENTRY(idt[0x2E], asm_ata);
+    idt[0x2E].present = 1;
+
     //initialize PIT in IDT
     SET_IDT_ENTRY(idt[0x20], pit_handler);
     idt[0x20].present = 1;   
 
+    //interprocessor interrupts
+    SET_IDT_ENTRY(idt[RESCHED_VECTOR], asm_resched);
+    idt[RESCHED_VECTOR].present = 1;
+    SET_IDT_ENTRY(idt[VIDMAP_VECTOR], asm_vidmap);
+    idt[VIDMAP_VECTOR].present = 1;
+
+    //spurious interrupts from the local APIC
+    SET_IDT_ENTRY(idt[APIC_SPURIOUS_VECTOR], asm_spurious);
+    idt[APIC_SPURIOUS_VECTOR].present = 1;
+
     //load IDT
      lidt(idt_desc_ptr);
 }
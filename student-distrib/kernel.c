@@ -6,12 +6,16 @@
 #include "x86_desc.h"
 #include "lib.h"
 #include "i8259.h"
+#include "apic.h"
+#include "smp.h"
 #include "keyboard.h"
 #include "rtc.h"
 #include "debug.h"
 #include "tests.h"
 #include "paging.h"
 #include "fs.h"
+#include "ata.h"
+#include "blkq.h"
 #include "syscalls.h"
 #include "terminal_driver.h"
 #include "scheduling.h"
@@ -152,18 +156,33 @@ void entry(unsigned long magic, unsigned long addr) {
 
 
 
-    /* Init the PIC */
+    /* Init the PIC, then move to the IO-APIC if there is one */
     i8259_init();
+    apic_init();
 
     /* Initialize devices, memory, filesystem, enable device interrupts on the
      * PIC, any other initialization stuff... */
     keyboard_init();
     rtc_init();
-    fs_init(((module_t*)mbi->mods_addr)->mod_start);
+    ata_init();
+    blk_init();
+
+    // Prefer the filesystem image on the primary slave (qemu -hdb filesys_img),
+    // fall back to the copy GRUB loaded as a module
+    if (fs_init_disk(ATA_SLAVE) != 0) {
+        if (!CHECK_FLAG(mbi->flags, 3) || mbi->mods_count == 0) {
+            printf("No filesystem image\n");
+        } else {
+            fs_init(((module_t*)mbi->mods_addr)->mod_start);
+        }
+    }
     init_paging();
 
     terminal_init();
+    timer_init();
+    tsc_init();
     pit_init();
+    smp_init();
 
     /* Enable interrupts */
     /* Do not enable the following until after you have set up your
@@ -176,8 +195,8 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Run tests */
     launch_tests();
 #endif
-    /* Execute the first program ("shell") ... */
-    execute((const uint8_t*)"shell");
+    /* Execute the first program ("shell") on each terminal ... */
+    sched_start();
     /* Spin (nicely, so we don't chew up cycles) */
     asm volatile (".1: hlt; jmp .1;");
 }
@@ -150,7 +150,7 @@ uint8_t special_chars(uint8_t scan_code){
             return 1;
         case SCANCODE_C: // C
             if(control_flag) {
-                terminal_data[visible_terminal].halt_flag = 1;
+                kill_foreground(visible_terminal);
                 return 1;
             }
             else {
@@ -3,6 +3,8 @@
 
 #include "lib.h"
 #include "terminal_driver.h"
+#include "shm.h"
+#include "mmap.h"
 
 #include "keyboard.h"
 
@@ -15,6 +17,8 @@ static int screen_x;
 static int screen_y;
 static char* video_mem = (char *)VIDEO;
 
+static int32_t bad_user_range(uint32_t start, int32_t len, int32_t write);
+
 /**
  * get_video_mem()
  * Returns the video buffer for a given terminal
@@ -628,6 +632,121 @@ int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n) {
     return dest;
 }
 
+/* uint32_t strnhash(const int8_t* s, uint32_t n)
+ * Inputs: const int8_t* s = string
+ *               uint32_t n = maximum number of characters to hash
+ * Return Value: hash of the string up to its null or n characters
+ * Function: FNV-1a, for hash tables keyed by name */
+uint32_t strnhash(const int8_t* s, uint32_t n) {
+    uint32_t hash = 2166136261U;
+    uint32_t i;
+
+    for (i = 0; i < n && s[i] != '\0'; i++) {
+        hash ^= (uint8_t) s[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/* int32_t find_first_zero(const uint32_t* bitmap, int32_t nbits)
+ * Inputs: const uint32_t* bitmap = bitmap, bit i is bit (i % 32) of word i / 32
+ *                  int32_t nbits = number of valid bits in the bitmap
+ * Return Value: index of the lowest clear bit, or -1 if all bits are set
+ * Function: skips full words, then finds the bit with a single bsf */
+int32_t find_first_zero(const uint32_t* bitmap, int32_t nbits) {
+    int32_t i, bit;
+
+    for (i = 0; i * 32 < nbits; i++) {
+        if (bitmap[i] == 0xFFFFFFFF)
+            continue;
+
+        asm ("bsfl %1, %0" : "=r"(bit) : "r"(~bitmap[i]) : "cc");
+        bit += i * 32;
+        return (bit < nbits) ? bit : -1;
+    }
+    return -1;
+}
+
+/* uint64_t div64(uint64_t n, uint32_t d)
+ * Inputs: uint64_t n = dividend
+ *         uint32_t d = divisor, not 0
+ * Return Value: n / d
+ * Function: divides the high half first, then the remainder and the low
+ *           half with one divl, whose quotient then fits in 32 bits */
+uint64_t div64(uint64_t n, uint32_t d) {
+    uint32_t hi = (uint32_t)(n >> 32), lo = (uint32_t)n;
+    uint32_t q_hi = hi / d, q_lo, r = hi % d;
+
+    asm ("divl %4" : "=a"(q_lo), "=d"(r) : "a"(lo), "d"(r), "rm"(d) : "cc");
+    return ((uint64_t)q_hi << 32) | q_lo;
+}
+
+/* int32_t bad_userspace_addr(const void* addr, int32_t len)
+ * Inputs: const void* addr = start of a buffer passed in by a user program
+ *               int32_t len = length of the buffer in bytes
+ * Return Value: 0 if the whole buffer is inside the user program page or
+ *               pages the current process has mapped in its shared memory
+ *               or file mapping windows, 1 otherwise
+ * Function: validates pointers handed to system calls that read them */
+int32_t bad_userspace_addr(const void* addr, int32_t len) {
+    return bad_user_range((uint32_t)addr, len, 0);
+}
+
+/* int32_t bad_userspace_write(const void* addr, int32_t len)
+ * Inputs: const void* addr = start of a buffer passed in by a user program
+ *               int32_t len = length of the buffer in bytes
+ * Return Value: 0 if the user program may write the whole buffer, 1 otherwise
+ * Function: validates buffers system calls write to. The kernel ignores
+ *           page protection, so this keeps it out of read-only file
+ *           mappings, which are the page cache itself */
+int32_t bad_userspace_write(const void* addr, int32_t len) {
+    return bad_user_range((uint32_t)addr, len, 1);
+}
+
+/* static int32_t bad_user_range(uint32_t start, int32_t len, int32_t write)
+ * Inputs: start, len = the buffer
+ *         write = 1 if the pages must be writable
+ * Return Value: 1 if any of it isn't mapped for the current process, else 0
+ * Function: checks the program page, then each 4KB page of the shared
+ *           memory and file mapping page tables */
+static int32_t bad_user_range(uint32_t start, int32_t len, int32_t write) {
+    uint32_t user_start = FOUR_MB * USER_PAGING;
+    uint32_t user_end = FOUR_MB * (USER_PAGING + 1);
+    uint32_t last, page;
+    pagetable_entry_t *table;
+    pcb_t *pcb;
+
+    if (len < 0)
+        return 1;
+    if (start >= user_start && start < user_end)
+        return (uint32_t)len > user_end - start;
+
+    last = start + (len > 0 ? len - 1 : 0);
+    if (last < start)
+        return 1;
+
+    pcb = get_pcb(curr_pid);
+    if (pcb == NULL)
+        return 1;
+    // Stops at the first page outside the windows, long before it could wrap
+    for (page = start & ~(FOUR_KB - 1); page <= last; page += FOUR_KB) {
+        if (page / FOUR_MB == SHM_PAGE) {
+            table = pcb->shm_table;
+        } else if (page / FOUR_MB == MMAP_PAGE) {
+            table = pcb->mmap_table;
+        } else {
+            return 1;
+        }
+        if (table == NULL)
+            return 1;
+
+        table += (page % FOUR_MB) / FOUR_KB;
+        if (!table->present || !table->user || (write && !table->read_write))
+            return 1;
+    }
+    return 0;
+}
+
 /* void test_interrupts(void)
  * Inputs: void
  * Return Value: void
@@ -37,9 +37,17 @@ void* memmove(void* dest, const void* src, uint32_t n);
 int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
 int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
+uint32_t strnhash(const int8_t* s, uint32_t n);
+
+/* Bitmap functions */
+int32_t find_first_zero(const uint32_t* bitmap, int32_t nbits);
+
+/* 64-bit division, which gcc would otherwise leave to libgcc */
+uint64_t div64(uint64_t n, uint32_t d);
 
 /* Userspace address-check functions */
 int32_t bad_userspace_addr(const void* addr, int32_t len);
+int32_t bad_userspace_write(const void* addr, int32_t len);
 int32_t safe_strncpy(int8_t* dest, const int8_t* src, int32_t n);
 
 /* Port read functions */
@@ -86,6 +94,15 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Reads the time stamp counter, which counts CPU cycles */
+static inline uint64_t rdtsc(void) {
+    uint64_t val;
+    asm volatile ("rdtsc"
+            : "=A"(val)
+    );
+    return val;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -109,14 +126,22 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
     );                                  \
 } while (0)
 
-/* Clear interrupt flag - disables interrupts on this processor */
+#define EFLAGS_IF           0x200
+
+/* The kernel lock (smp.c): held by a processor while its interrupts are
+ * off in the kernel, so that also keeps the other processors out */
+extern void kernel_lock(void);
+extern void kernel_unlock(void);
+
+/* Clear interrupt flag - disables interrupts on this processor and takes
+ * the kernel lock */
 #define cli()                           \
 do {                                    \
     asm volatile ("cli"                 \
@@ -124,11 +149,12 @@ do {                                    \
             :                           \
             : "memory", "cc"            \
     );                                  \
+    kernel_lock();                      \
 } while (0)
 
 /* Save flags and then clear interrupt flag
  * Saves the EFLAGS register into the variable "flags", and then
- * disables interrupts on this processor */
+ * disables interrupts on this processor and takes the kernel lock */
 #define cli_and_save(flags)             \
 do {                                    \
     asm volatile ("                   \n\
@@ -140,11 +166,14 @@ do {                                    \
             :                           \
             : "memory", "cc"            \
     );                                  \
+    kernel_lock();                      \
 } while (0)
 
-/* Set interrupt flag - enable interrupts on this processor */
+/* Set interrupt flag - gives back the kernel lock and enables interrupts
+ * on this processor */
 #define sti()                           \
 do {                                    \
+    kernel_unlock();                    \
     asm volatile ("sti"                 \
             :                           \
             :                           \
@@ -153,10 +182,12 @@ do {                                    \
 } while (0)
 
 /* Restore flags
- * Puts the value in "flags" into the EFLAGS register.  Most often used
+ * Puts the value in "flags" into the EFLAGS register, giving back or
+ * taking the kernel lock with the interrupt flag.  Most often used
  * after a cli_and_save_flags(flags) */
 #define restore_flags(flags)            \
 do {                                    \
+    if ((flags) & EFLAGS_IF) kernel_unlock(); \
     asm volatile ("                   \n\
             pushl %0                  \n\
             popfl                     \n\
@@ -165,6 +196,7 @@ do {                                    \
             : "r"(flags)                \
             : "memory", "cc"            \
     );                                  \
+    if (!((flags) & EFLAGS_IF)) kernel_lock(); \
 } while (0)
 
 #endif /* _LIB_H */
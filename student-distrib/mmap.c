@@ -0,0 +1,159 @@
+#include "mmap.h"
+#include "lib.h"
+#include "fs.h"
+#include "pcache.h"
+
+/** Cache pages pinned by every process's mappings */
+static uint32_t mmap_pinned;
+
+// Private helper functions
+static void unmap_pages(pcb_t* pcb, uint32_t first);
+static void release_tables(pcb_t* pcb);
+
+/** mmap_map
+ * Maps the first length bytes of a file read-only into a process. The
+ * mapping uses the page cache's pages directly, so nothing is copied
+ * once a block is cached.
+ * Inputs: pcb -- Process to map into (the current process)
+ *         inode -- Inode number of the file
+ *         length -- Number of bytes to map, rounded up to whole pages
+ * Outputs: addr -- User address of the mapping
+ * Return value: 0 on success, -1 if failed or if the mapping would pin
+ *               more than MMAP_PROC_PAGES or MMAP_MAX_PAGES cache pages
+ * Side effects: Holds the file's cache pages until unmapped, may allocate
+ *               the process's mapping tables
+ */
+int32_t mmap_map(pcb_t* pcb, uint32_t inode, uint32_t length, uint8_t** addr) {
+    uint32_t npages = (length + PAGETABLE_STEP - 1) / PAGETABLE_STEP;
+    uint32_t first, i;
+
+    if (npages == 0 || npages > PAGETABLE_SIZE) return -1;
+    if (pcb->mmap_npages + npages > MMAP_PROC_PAGES) return -1;
+    if (mmap_pinned + npages > MMAP_MAX_PAGES) return -1;
+
+    if (pcb->mmap_table == NULL) {
+        pcb->mmap_table = alloc_page();
+        pcb->mmap_pages = alloc_page();
+        if (pcb->mmap_table == NULL || pcb->mmap_pages == NULL) {
+            release_tables(pcb);
+            return -1;
+        }
+        memset(pcb->mmap_table, 0, PAGETABLE_STEP);
+        memset(pcb->mmap_pages, 0, PAGETABLE_STEP);
+    }
+
+    // First fit: find npages free pages in a row
+    for (first = 0; first + npages <= PAGETABLE_SIZE; first++) {
+        for (i = 0; i < npages; i++) {
+            if (pcb->mmap_table[first + i].present) break;
+        }
+        if (i == npages) break;
+        first += i;
+    }
+    if (first + npages > PAGETABLE_SIZE) return -1;
+
+    for (i = 0; i < npages; i++) {
+        pcache_page_t *page = fs_get_page(inode, i);
+        pagetable_entry_t *pte = &pcb->mmap_table[first + i];
+
+        if (page == NULL) {
+            if (i > 0) unmap_pages(pcb, first);
+            return -1;
+        }
+
+        pcb->mmap_pages[first + i] = page;
+        pcb->mmap_npages++;
+        mmap_pinned++;
+        pte->val     = 0;
+        pte->addr    = (uint32_t) page->data >> PAGE_ALIGN;
+        pte->extra   = (i == 0) ? MMAP_REGION_START : 0;
+        pte->user    = 1;
+        pte->present = 1;
+    }
+
+    set_process_paging(pcb->pid);
+
+    *addr = (uint8_t*) (MMAP_START + first * PAGETABLE_STEP);
+    return 0;
+}
+
+/** mmap_unmap
+ * Removes a mapping made by mmap_map.
+ * Inputs: pcb -- Process to unmap from (the current process)
+ *         addr -- Address returned by mmap_map
+ * Return value: 0 on success, -1 if addr is not the start of a mapping
+ * Side effects: Releases the cache pages, may free the mapping tables
+ */
+int32_t mmap_unmap(pcb_t* pcb, uint8_t* addr) {
+    uint32_t offset = (uint32_t) addr - MMAP_START;
+    uint32_t first = offset / PAGETABLE_STEP;
+    uint32_t i;
+
+    if ((uint32_t) addr < MMAP_START || offset >= FOUR_MB) return -1;
+    if (offset % PAGETABLE_STEP != 0 || pcb->mmap_table == NULL) return -1;
+    if (!pcb->mmap_table[first].present || pcb->mmap_table[first].extra != MMAP_REGION_START) return -1;
+
+    unmap_pages(pcb, first);
+
+    // Drop the tables once nothing is mapped
+    for (i = 0; i < PAGETABLE_SIZE; i++) {
+        if (pcb->mmap_table[i].present) break;
+    }
+    if (i == PAGETABLE_SIZE) release_tables(pcb);
+
+    set_process_paging(pcb->pid);
+    return 0;
+}
+
+/** mmap_unmap_all
+ * Removes every mapping of a process that is exiting.
+ * Inputs: pcb -- Process control block
+ * Return value: none
+ * Side effects: Releases the cache pages and frees the mapping tables
+ */
+void mmap_unmap_all(pcb_t* pcb) {
+    uint32_t i;
+
+    if (pcb->mmap_table == NULL) return;
+
+    for (i = 0; i < PAGETABLE_SIZE; i++) {
+        if (pcb->mmap_table[i].present && pcb->mmap_table[i].extra == MMAP_REGION_START) {
+            unmap_pages(pcb, i);
+        }
+    }
+    release_tables(pcb);
+}
+
+/** static unmap_pages
+ * Clears the pages of one mapping and releases their cache pages.
+ * Inputs: pcb -- Process control block
+ *         first -- Index of the mapping's first page
+ * Return value: none
+ * Side effects: Does not flush the TLB
+ */
+static void unmap_pages(pcb_t* pcb, uint32_t first) {
+    uint32_t i = first;
+
+    do {
+        pcache_put(pcb->mmap_pages[i]);
+        pcb->mmap_pages[i] = NULL;
+        pcb->mmap_npages--;
+        mmap_pinned--;
+        pcb->mmap_table[i].val = 0;
+        i++;
+    } while (i < PAGETABLE_SIZE && pcb->mmap_table[i].present &&
+             pcb->mmap_table[i].extra != MMAP_REGION_START);
+}
+
+/** static release_tables
+ * Frees a process's mapping tables.
+ * Inputs: pcb -- Process control block
+ * Return value: none
+ * Side effects: none
+ */
+static void release_tables(pcb_t* pcb) {
+    if (pcb->mmap_table != NULL) free_page(pcb->mmap_table);
+    if (pcb->mmap_pages != NULL) free_page(pcb->mmap_pages);
+    pcb->mmap_table = NULL;
+    pcb->mmap_pages = NULL;
+}
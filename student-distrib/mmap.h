@@ -0,0 +1,22 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include "types.h"
+#include "paging.h"
+#include "syscalls.h"
+#include "pcache.h"
+
+#define MMAP_PAGE           36      // page directory entry holding each process's file mappings
+#define MMAP_START          (MMAP_PAGE * FOUR_MB)
+#define MMAP_REGION_START   1       // PTE "extra" bit marking the first page of a mapping
+
+/* Mapped pages pin their cache pages, so mappings may only hold part of
+ * the cache; the rest stays free for reads and readahead. */
+#define MMAP_MAX_PAGES      (PCACHE_PAGES / 2)  // pinned by all processes together
+#define MMAP_PROC_PAGES     (PCACHE_PAGES / 8)  // pinned by one process
+
+extern int32_t mmap_map(pcb_t* pcb, uint32_t inode, uint32_t length, uint8_t** addr);
+extern int32_t mmap_unmap(pcb_t* pcb, uint8_t* addr);
+extern void mmap_unmap_all(pcb_t* pcb);
+
+#endif
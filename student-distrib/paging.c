@@ -3,15 +3,23 @@
 #include "paging.h"
 #include "syscalls.h"
 #include "terminal_driver.h"
+#include "shm.h"
+#include "tmpfs.h"
+#include "mmap.h"
+#include "apic.h"
 
-/* Memory page directory - Each entry specifies the paging behavior of 4MB of memory */
-pagedir_entry_t page_directory[PAGEDIR_SIZE] __attribute__((aligned (0x1000)));
+/* Memory page directory of each processor - Each entry specifies the paging behavior of 4MB of memory.
+ * They differ only in the entries of the process each one is running */
+pagedir_entry_t page_directories[MAX_CPUS][PAGEDIR_SIZE] __attribute__((aligned (0x1000)));
 
 /* Page table for first 4MB - Each entry specifies the paging behavior of 4KB of memory */
 pagetable_entry_t page_0_table[PAGETABLE_SIZE] __attribute__((aligned (0x1000)));
 
-/* Page table entry for vidmap - Only need single entry instead of array because only 4 kB needed */
-pagetable_entry_t vidmap_pte __attribute__((aligned (0x1000)));
+/* Page table for vidmap on each processor - Only the first entry is used because only 4 kB needed */
+pagetable_entry_t vidmap_tables[MAX_CPUS][PAGETABLE_SIZE] __attribute__((aligned (0x1000)));
+
+/* Page pool frames in use - bit i set if the page at KPOOL_START + i*4KB is allocated */
+static uint32_t kpool_bitmap[KPOOL_FRAMES / 32];
 
 /* enable_paging(pagedir_entry *addr)
  * Description: Enables memory paging
@@ -38,16 +46,41 @@ do {                                     \
     );                                   \
 } while (0)
 
+/* map_mmio()
+ * Description: Identity maps the 4MB page holding device registers, uncached
+ * Inputs: addr -- physical address of the registers
+ * Outputs: none
+ * Side effects: changes page_directory
+ */
+static void map_mmio(uint32_t addr) {
+    pagedir_entry_t *page_directory = page_directories[0];
+    uint32_t i = addr / PAGEDIR_STEP;
+
+    page_directory[i].val           = 0;
+    page_directory[i].addr          = (i * PAGEDIR_STEP) >> PAGE_ALIGN;
+    page_directory[i].size          = 1; // Use 4MB direct page
+    page_directory[i].accessed      = 1;
+    page_directory[i].cache_disable = 1;
+    page_directory[i].write_thru    = 1;
+    page_directory[i].read_write    = 1;
+    page_directory[i].present       = 1;
+}
+
 /* init_paging()
  * Description: Initialize memory paging. The initial mapping is as follows:
  *              0x000B8000 - 0x000B8FFF (4KB): Identity mapped (video memory)
  *              0x00400000 - 0x007FFFFF (4MB): Identity mapped (kernel memory)
+ *              0x04000000 - 0x047FFFFF (8MB): Identity mapped (page pool)
+ *              0x04800000 - 0x04BFFFFF (4MB): Identity mapped (writable filesystem blocks)
+ *              The 4MB pages holding the APIC registers: Identity mapped, uncached
  *              All else:                       Not available
  * Inputs: none
  * Outputs: none
- * Side effects: Enables memory paging and initializes page_directory and page_0_table
+ * Side effects: Enables memory paging and initializes the boot processor's page
+ *               directory and page_0_table
  */
 void init_paging() {
+    pagedir_entry_t *page_directory = page_directories[0];
     uint32_t i;
 
     // Initialize page 0 sub-table
@@ -117,6 +150,28 @@ void init_paging() {
         page_directory[i].val = 0;
     }
 
+    // Identity map the page pool, kernel only
+    for (i = KPOOL_PAGE; i < KPOOL_PAGE + KPOOL_PDES; i++) {
+        page_directory[i].addr          = (i * PAGEDIR_STEP) >> PAGE_ALIGN;
+        page_directory[i].size          = 1; // Use 4MB direct page
+        page_directory[i].accessed      = 1;
+        page_directory[i].read_write    = 1;
+        page_directory[i].present       = 1;
+    }
+
+    // Identity map the writable filesystem's blocks, kernel only
+    page_directory[TMPFS_PAGE].addr          = TMPFS_START >> PAGE_ALIGN;
+    page_directory[TMPFS_PAGE].size          = 1; // Use 4MB direct page
+    page_directory[TMPFS_PAGE].accessed      = 1;
+    page_directory[TMPFS_PAGE].read_write    = 1;
+    page_directory[TMPFS_PAGE].present       = 1;
+
+    // Identity map the local APIC and IO-APIC registers, uncached
+    if (apic_enabled) {
+        map_mmio(lapic_phys);
+        map_mmio(ioapic_phys);
+    }
+
     // Set processor registers for paging
     enable_paging(page_directory);
 }
@@ -130,8 +185,9 @@ void init_paging() {
  */
 void set_process_paging(uint32_t pid){
     
+    pagedir_entry_t *page_directory = page_directories[this_cpu()->id];
     uint32_t physical_address = get_physical_addr_for_pid(pid);
-    pcb_t *pcb = get_pcb(curr_pid);
+    pcb_t *pcb = get_pcb(pid);
 
   //page_directory[USER_PAGING].val = (physical_address & PHYSICAL_MASKING) | PD_COMBO;
     page_directory[USER_PAGING].addr          = (physical_address) >> PAGE_ALIGN;
@@ -146,6 +202,32 @@ void set_process_paging(uint32_t pid){
     page_directory[USER_PAGING].read_write    = 1;
     page_directory[USER_PAGING].present       = 1;
 
+    // Shared memory segments mapped by this process
+    if (pcb->shm_table != NULL) {
+        page_directory[SHM_PAGE].val           = 0;
+        page_directory[SHM_PAGE].addr          = ((uint32_t) pcb->shm_table) >> PAGE_ALIGN;
+        page_directory[SHM_PAGE].size          = 0; // Use 4KB page table
+        page_directory[SHM_PAGE].accessed      = 1;
+        page_directory[SHM_PAGE].user          = 1;
+        page_directory[SHM_PAGE].read_write    = 1;
+        page_directory[SHM_PAGE].present       = 1;
+    } else {
+        page_directory[SHM_PAGE].val = 0;
+    }
+
+    // Memory mapped files, read-only
+    if (pcb->mmap_table != NULL) {
+        page_directory[MMAP_PAGE].val           = 0;
+        page_directory[MMAP_PAGE].addr          = ((uint32_t) pcb->mmap_table) >> PAGE_ALIGN;
+        page_directory[MMAP_PAGE].size          = 0; // Use 4KB page table
+        page_directory[MMAP_PAGE].accessed      = 1;
+        page_directory[MMAP_PAGE].user          = 1;
+        page_directory[MMAP_PAGE].read_write    = 1; // each page table entry is read-only
+        page_directory[MMAP_PAGE].present       = 1;
+    } else {
+        page_directory[MMAP_PAGE].val = 0;
+    }
+
     if (pcb->vidmap_active) {
         vidmap_paging(1);
     } else {
@@ -163,6 +245,9 @@ void set_process_paging(uint32_t pid){
  * Side effects: clears TLB
  */
 void vidmap_paging(int32_t arg){
+    pagedir_entry_t *page_directory = page_directories[this_cpu()->id];
+    pagetable_entry_t *vidmap_pte = vidmap_tables[this_cpu()->id];
+
     if(arg == 0){
         page_directory[VIDMAP_PAGE].val = 0;
         flush_tlb();
@@ -171,18 +256,18 @@ void vidmap_paging(int32_t arg){
 
     uint32_t buffer_mem = (uint32_t) get_video_mem(active_terminal);
 
-    vidmap_pte.addr          = buffer_mem >> PAGE_ALIGN;
-    vidmap_pte.extra         = 0;
-    vidmap_pte.global        = 0;
-    vidmap_pte.reserved0     = 0;
-    vidmap_pte.dirty         = 0;
-    vidmap_pte.accessed      = 1;
-    vidmap_pte.cache_disable = 0;
-    vidmap_pte.write_thru    = 0;
-    vidmap_pte.user          = 1;
-    vidmap_pte.read_write    = 1;
-    vidmap_pte.present       = 1;
-    page_directory[VIDMAP_PAGE].addr          = ((uint32_t) &vidmap_pte) >> PAGE_ALIGN;
+    vidmap_pte->addr          = buffer_mem >> PAGE_ALIGN;
+    vidmap_pte->extra         = 0;
+    vidmap_pte->global        = 0;
+    vidmap_pte->reserved0     = 0;
+    vidmap_pte->dirty         = 0;
+    vidmap_pte->accessed      = 1;
+    vidmap_pte->cache_disable = 0;
+    vidmap_pte->write_thru    = 0;
+    vidmap_pte->user          = 1;
+    vidmap_pte->read_write    = 1;
+    vidmap_pte->present       = 1;
+    page_directory[VIDMAP_PAGE].addr          = ((uint32_t) vidmap_pte) >> PAGE_ALIGN;
     page_directory[VIDMAP_PAGE].extra         = 0;
     page_directory[VIDMAP_PAGE].global        = 0;
     page_directory[VIDMAP_PAGE].size          = 0; // Use 4KB page table
@@ -197,6 +282,48 @@ void vidmap_paging(int32_t arg){
 }
 
 
+/* init_paging_ap()
+ * Description: Turns on paging on another processor, with a copy of the boot
+ *              processor's kernel mappings
+ * Inputs: cpu -- index of the processor in cpus[]
+ * Outputs: none
+ * Side effects: Enables memory paging on this processor
+ */
+void init_paging_ap(uint32_t cpu) {
+    pagedir_entry_t *page_directory = page_directories[cpu];
+
+    memcpy(page_directory, page_directories[0], sizeof(page_directories[0]));
+
+    // Nothing of the process the boot processor runs
+    page_directory[USER_PAGING].val = 0;
+    page_directory[SHM_PAGE].val = 0;
+    page_directory[MMAP_PAGE].val = 0;
+    page_directory[VIDMAP_PAGE].val = 0;
+
+    enable_paging(page_directory);
+}
+
+/* map_low_page()
+ * Description: Identity maps a kernel page in the first 4MB, or unmaps it
+ * Inputs: addr -- address of the page
+ *         present -- 1 to map it, 0 to unmap it
+ * Outputs: none
+ * Side effects: changes page_0_table, which every processor shares, and
+ *               flushes this processor's TLB
+ */
+void map_low_page(uint32_t addr, int32_t present) {
+    uint32_t i = addr / PAGETABLE_STEP;
+
+    page_0_table[i].val = 0;
+    if (present) {
+        page_0_table[i].addr       = addr >> PAGE_ALIGN;
+        page_0_table[i].accessed   = 1;
+        page_0_table[i].read_write = 1;
+        page_0_table[i].present    = 1;
+    }
+    flush_tlb();
+}
+
  /* flush_tlb()
  * Description: flushes the tlb when context switching          
  * Inputs: none
@@ -218,3 +345,41 @@ uint32_t get_physical_addr_for_pid(uint32_t pid) {
     return EIGHT_MB + FOUR_MB * pid;
 }
 
+/* alloc_page()
+ * Description: Allocates a 4KB page from the page pool
+ * Inputs: none
+ * Outputs: address of the page (virtual and physical), or NULL if the pool is empty
+ * Side effects: marks the page as used; contents are not cleared
+ */
+void* alloc_page(void) {
+    uint32_t flags;
+    int32_t frame;
+
+    cli_and_save(flags);
+    frame = find_first_zero(kpool_bitmap, KPOOL_FRAMES);
+    if (frame >= 0)
+        kpool_bitmap[frame / 32] |= (1 << (frame % 32));
+    restore_flags(flags);
+
+    if (frame < 0)
+        return NULL;
+    return (void*) (KPOOL_START + frame * PAGETABLE_STEP);
+}
+
+/* free_page()
+ * Description: Returns a page from alloc_page() to the page pool
+ * Inputs: page -- address returned by alloc_page()
+ * Outputs: none
+ * Side effects: marks the page as free
+ */
+void free_page(void* page) {
+    uint32_t flags;
+    uint32_t frame = ((uint32_t) page - KPOOL_START) / PAGETABLE_STEP;
+
+    if ((uint32_t) page < KPOOL_START || frame >= KPOOL_FRAMES)
+        return;
+
+    cli_and_save(flags);
+    kpool_bitmap[frame / 32] &= ~(1 << (frame % 32));
+    restore_flags(flags);
+}
@@ -1,6 +1,8 @@
 #ifndef PAGING_H
 #define PAGING_H
 
+#include "apic.h"
+
 #define EIGHT_MB      0x00800000
 #define FOUR_MB       0x00400000
 
@@ -17,6 +19,13 @@
 
 #define VIDMAP_PAGE         34
 
+/* Page pool: physical memory the kernel hands out one 4KB page at a time.
+ * It is identity mapped, so a page's address is also its physical address. */
+#define KPOOL_PAGE          16      // page directory entry of the first 4MB of the pool
+#define KPOOL_PDES          2       // number of 4MB pages in the pool
+#define KPOOL_START         (KPOOL_PAGE * PAGEDIR_STEP)
+#define KPOOL_FRAMES        (KPOOL_PDES * (PAGEDIR_STEP / PAGETABLE_STEP))
+
 /* This is a page directory entry. */
 typedef struct pagedir_entry {
     union {
@@ -57,10 +66,12 @@ typedef struct pagetable_entry {
     };
 } pagetable_entry_t;
 
-/* Memory page directory - Each entry specifies the paging behavior of 4MB of memory */
-extern pagedir_entry_t page_directory[1024] __attribute__((aligned (0x1000)));
+/* Memory page directory of each processor - Each entry specifies the paging behavior of 4MB of memory */
+extern pagedir_entry_t page_directories[MAX_CPUS][PAGEDIR_SIZE] __attribute__((aligned (0x1000)));
 
 extern void init_paging();
+extern void init_paging_ap(uint32_t cpu);
+extern void map_low_page(uint32_t addr, int32_t present);
 
 extern void  set_process_paging(uint32_t pid);
 
@@ -70,4 +81,7 @@ extern void flush_tlb(void);
 
 extern uint32_t get_physical_addr_for_pid(uint32_t pid);
 
+extern void* alloc_page(void);
+extern void free_page(void* page);
+
 #endif
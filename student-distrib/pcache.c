@@ -0,0 +1,334 @@
+#include "pcache.h"
+#include "lib.h"
+#include "paging.h"
+
+/** All cache pages, and the hash buckets of the valid ones */
+static pcache_page_t pages[PCACHE_PAGES];
+static pcache_page_t *buckets[PCACHE_BUCKETS];
+/** Every page is on the LRU list, most recently used at the head.
+ *  Invalid pages are kept at the tail so they are reused first. */
+static pcache_page_t *lru_head;
+static pcache_page_t *lru_tail;
+
+static pcache_stats_t stats;
+
+// Private helper functions
+static uint32_t hash(uint32_t inode, uint32_t block);
+static pcache_page_t *lookup(uint32_t inode, uint32_t block);
+static void unhash(pcache_page_t *page);
+static void lru_remove(pcache_page_t *page);
+static void lru_push_head(pcache_page_t *page);
+static void lru_push_tail(pcache_page_t *page);
+static pcache_page_t *take_victim(void);
+static void wait_loaded(pcache_page_t *page);
+
+/** pcache_init
+ * Initialize an empty page cache. Pages are allocated from the page pool
+ * the first time they are needed.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Clears the cache and its statistics
+ */
+void pcache_init(void) {
+    int32_t i;
+
+    memset(pages, 0, sizeof(pages));
+    memset(buckets, 0, sizeof(buckets));
+    memset(&stats, 0, sizeof(stats));
+    lru_head = NULL;
+    lru_tail = NULL;
+
+    for (i = 0; i < PCACHE_PAGES; i++) {
+        lru_push_tail(&pages[i]);
+    }
+}
+
+/** pcache_get
+ * Get a block of a file, reading it with fill on a miss. The page is held
+ * until pcache_put, so its data stays valid while the caller uses it.
+ * If readahead is still reading the block, waits for it with interrupts on.
+ * Inputs: inode -- Inode number of the file
+ *         block -- Block index within the file
+ *         fill -- Reads the block from the backing store on a miss
+ * Return value: The cache page, or NULL if the block doesn't exist or
+ *               every page is in use
+ * Side effects: May evict the least recently used page
+ */
+pcache_page_t* pcache_get(uint32_t inode, uint32_t block, pcache_fill_t fill) {
+    pcache_page_t *page, *other;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    page = lookup(inode, block);
+    if (page != NULL && page->loading) {
+        page->refcount++;
+        wait_loaded(page);
+        page->refcount--;
+        page = lookup(inode, block);    // gone if the read failed
+    }
+    if (page != NULL && !page->loading) {
+        stats.hits++;
+        if (page->readahead) {
+            stats.readahead_hits++;
+            page->readahead = 0;
+        }
+        page->refcount++;
+        lru_remove(page);
+        lru_push_head(page);
+        restore_flags(flags);
+        return page;
+    }
+
+    stats.misses++;
+    page = take_victim();
+    restore_flags(flags);
+    if (page == NULL) return NULL;
+
+    // Fill with interrupts on; the page is held, so nobody else takes it
+    if (fill(inode, block, page->data)) {
+        cli_and_save(flags);
+        page->refcount--;
+        restore_flags(flags);
+        return NULL;
+    }
+
+    cli_and_save(flags);
+    other = lookup(inode, block);
+    if (other != NULL && other->loading) {
+        // Readahead started on the block meanwhile; ours is already here
+        unhash(other);
+        other = NULL;
+    }
+    if (other != NULL) {
+        // Someone else read the same block while we were filling
+        page->refcount--;
+        page = other;
+        page->refcount++;
+    } else {
+        page->inode = inode;
+        page->block = block;
+        page->valid = 1;
+        page->readahead = 0;
+        page->hash_next = buckets[hash(inode, block)];
+        buckets[hash(inode, block)] = page;
+    }
+    lru_remove(page);
+    lru_push_head(page);
+    restore_flags(flags);
+
+    return page;
+}
+
+/** pcache_put
+ * Release a page returned by pcache_get.
+ * Inputs: page -- The page
+ * Return value: none
+ * Side effects: The page may be evicted once nobody holds it
+ */
+void pcache_put(pcache_page_t* page) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    page->refcount--;
+    restore_flags(flags);
+}
+
+/** pcache_invalidate
+ * Drop every cached block of a file, after its contents changed.
+ * Inputs: inode -- Inode number of the file
+ * Return value: none
+ * Side effects: Later reads of the file miss
+ */
+void pcache_invalidate(uint32_t inode) {
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    for (i = 0; i < PCACHE_PAGES; i++) {
+        if (pages[i].valid && pages[i].inode == inode) {
+            unhash(&pages[i]);
+            lru_remove(&pages[i]);
+            lru_push_tail(&pages[i]);
+        }
+    }
+    restore_flags(flags);
+}
+
+/** pcache_start_load
+ * Start reading a block in the background. The page is inserted and held
+ * right away, so readers of the block wait for it instead of reading it
+ * themselves. The caller fills page->data and then calls pcache_end_load.
+ * Inputs: inode -- Inode number of the file
+ *         block -- Block index within the file
+ * Return value: The page to fill, or NULL if the block is already cached
+ *               or every page is in use
+ * Side effects: May evict the least recently used page
+ */
+pcache_page_t* pcache_start_load(uint32_t inode, uint32_t block) {
+    pcache_page_t *page = NULL;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (lookup(inode, block) == NULL) {
+        page = take_victim();
+    }
+    if (page != NULL) {
+        stats.readahead++;
+        page->inode = inode;
+        page->block = block;
+        page->valid = 1;
+        page->loading = 1;
+        page->readahead = 1;
+        page->hash_next = buckets[hash(inode, block)];
+        buckets[hash(inode, block)] = page;
+        lru_remove(page);
+        lru_push_head(page);
+    }
+    restore_flags(flags);
+
+    return page;
+}
+
+/** pcache_end_load
+ * Finish a read started by pcache_start_load. May be called from an
+ * interrupt handler.
+ * Inputs: page -- The page from pcache_start_load
+ *         error -- 0 if page->data holds the block, -1 if the read failed
+ * Return value: none
+ * Side effects: Wakes readers waiting for the block, releases the page
+ */
+void pcache_end_load(pcache_page_t* page, int32_t error) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (error && page->valid) {
+        unhash(page);
+        lru_remove(page);
+        lru_push_tail(page);
+    }
+    page->loading = 0;
+    page->refcount--;
+    restore_flags(flags);
+}
+
+/** pcache_get_stats
+ * Copy the cache's hit, miss and eviction counters.
+ * Inputs: none
+ * Outputs: out -- Buffer for the counters
+ * Return value: none
+ * Side effects: none
+ */
+void pcache_get_stats(pcache_stats_t* out) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    *out = stats;
+    restore_flags(flags);
+}
+
+/** static hash
+ * Hash bucket of a (inode, block) key.
+ */
+static uint32_t hash(uint32_t inode, uint32_t block) {
+    return (inode * 31 + block) & (PCACHE_BUCKETS - 1);
+}
+
+/** static lookup
+ * Find the valid page holding a block. Interrupts must be off.
+ * Inputs: inode, block -- Key
+ * Return value: The page, or NULL if not cached
+ */
+static pcache_page_t *lookup(uint32_t inode, uint32_t block) {
+    pcache_page_t *page;
+
+    for (page = buckets[hash(inode, block)]; page != NULL; page = page->hash_next) {
+        if (page->inode == inode && page->block == block) return page;
+    }
+    return NULL;
+}
+
+/** static unhash
+ * Remove a valid page from its hash bucket and mark it invalid.
+ * Interrupts must be off.
+ */
+static void unhash(pcache_page_t *page) {
+    pcache_page_t **link = &buckets[hash(page->inode, page->block)];
+
+    while (*link != page) link = &(*link)->hash_next;
+    *link = page->hash_next;
+    page->hash_next = NULL;
+    page->valid = 0;
+}
+
+/** static lru_remove
+ * Unlink a page from the LRU list. Interrupts must be off.
+ */
+static void lru_remove(pcache_page_t *page) {
+    if (page->lru_prev) page->lru_prev->lru_next = page->lru_next;
+    else lru_head = page->lru_next;
+    if (page->lru_next) page->lru_next->lru_prev = page->lru_prev;
+    else lru_tail = page->lru_prev;
+    page->lru_prev = NULL;
+    page->lru_next = NULL;
+}
+
+/** static lru_push_head
+ * Put a page at the most recently used end. Interrupts must be off.
+ */
+static void lru_push_head(pcache_page_t *page) {
+    page->lru_prev = NULL;
+    page->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = page;
+    else lru_tail = page;
+    lru_head = page;
+}
+
+/** static lru_push_tail
+ * Put a page at the least recently used end. Interrupts must be off.
+ */
+static void lru_push_tail(pcache_page_t *page) {
+    page->lru_next = NULL;
+    page->lru_prev = lru_tail;
+    if (lru_tail) lru_tail->lru_next = page;
+    else lru_head = page;
+    lru_tail = page;
+}
+
+/** static wait_loaded
+ * Sleep until readahead finishes reading a held page. Interrupts must be
+ * off; they are enabled while waiting and off again on return.
+ */
+static void wait_loaded(pcache_page_t *page) {
+    sti();
+    while (page->loading) {
+        asm volatile ("hlt");
+    }
+    cli();
+}
+
+/** static take_victim
+ * Find the least recently used page nobody holds, evict its block and
+ * hold it for the caller. Interrupts must be off.
+ * Inputs: none
+ * Return value: The page, or NULL if every page is held
+ * Side effects: May allocate a page from the page pool
+ */
+static pcache_page_t *take_victim(void) {
+    pcache_page_t *page;
+
+    for (page = lru_tail; page != NULL; page = page->lru_prev) {
+        if (page->refcount > 0) continue;
+        if (page->data == NULL) {
+            page->data = alloc_page();
+            if (page->data == NULL) continue;
+        }
+
+        if (page->valid) {
+            stats.evictions++;
+            unhash(page);
+        }
+        page->refcount = 1;
+        return page;
+    }
+    return NULL;
+}
@@ -0,0 +1,45 @@
+#ifndef PCACHE_H
+#define PCACHE_H
+
+#include "types.h"
+
+#define PCACHE_PAGES        256     // max cached blocks (1MB of the page pool)
+#define PCACHE_BUCKETS      64      // must be a power of 2
+
+/* Fills buf with one 4KB block of a file. Returns 0 on success, -1 if the
+ * block doesn't exist. */
+typedef int32_t (*pcache_fill_t)(uint32_t inode, uint32_t block, uint8_t* buf);
+
+/* One cached block. Pages are linked into a hash bucket by key and into
+ * the LRU list, most recently used first. */
+typedef struct pcache_page {
+    uint32_t inode;
+    uint32_t block;
+    uint8_t* data;                  // page pool page, NULL until first used
+    int32_t valid;                  // 1 if data holds (inode, block)
+    volatile int32_t loading;       // 1 while readahead is still reading the block
+    int32_t readahead;              // 1 if read ahead and not used yet
+    int32_t refcount;               // users holding the page; it can't be evicted while > 0
+    struct pcache_page *hash_next;
+    struct pcache_page *lru_prev;
+    struct pcache_page *lru_next;
+} pcache_page_t;
+
+typedef struct pcache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t readahead;             // blocks read ahead of the reader
+    uint32_t readahead_hits;        // ... and found by a reader later
+} pcache_stats_t;
+
+extern void pcache_init(void);
+
+extern pcache_page_t* pcache_get(uint32_t inode, uint32_t block, pcache_fill_t fill);
+extern void pcache_put(pcache_page_t* page);
+extern void pcache_invalidate(uint32_t inode);
+extern pcache_page_t* pcache_start_load(uint32_t inode, uint32_t block);
+extern void pcache_end_load(pcache_page_t* page, int32_t error);
+extern void pcache_get_stats(pcache_stats_t* out);
+
+#endif
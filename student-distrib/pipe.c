@@ -0,0 +1,187 @@
+#include "pipe.h"
+#include "lib.h"
+#include "syscalls.h"
+#include "scheduling.h"
+
+/** All pipes. A pipe is free when both ends are closed. */
+pipe_t pipes[MAX_PIPES];
+
+/** pipe_alloc
+ * Creates a new pipe and initializes descriptors for both of its ends.
+ * Inputs: read_end -- Descriptor to become the read end
+ *         write_end -- Descriptor to become the write end
+ * Return value: 0 on success, -1 if all pipes are in use
+ * Side effects: Initializes read_end and write_end
+ */
+int32_t pipe_alloc(file_desc_t *read_end, file_desc_t *write_end) {
+    int32_t i;
+
+    for (i = 0; i < MAX_PIPES; i++) {
+        if (pipes[i].readers == 0 && pipes[i].writers == 0) break;
+    }
+    if (i >= MAX_PIPES) return -1;
+
+    pipes[i].head = 0;
+    pipes[i].tail = 0;
+    pipes[i].readers = 1;
+    pipes[i].writers = 1;
+    pipes[i].read_waiter = -1;
+    pipes[i].write_waiter = -1;
+
+    read_end->ftable = &pipe_read_ftable;
+    read_end->inode = i;
+    read_end->pos = 0;
+    read_end->flags.open = 1;
+    read_end->flags.nonblock = 0;
+
+    write_end->ftable = &pipe_write_ftable;
+    write_end->inode = i;
+    write_end->pos = 0;
+    write_end->flags.open = 1;
+    write_end->flags.nonblock = 0;
+
+    return 0;
+}
+
+/** pipe_read
+ * Reads bytes from a pipe. Waits while the pipe is empty and a writer
+ * still has it open.
+ * Inputs: fd -- Read end of the pipe
+ *         buf -- Buffer to copy to
+ *         nbytes -- Maximum number of bytes to copy
+ * Return value: Number of bytes read, 0 at end of file (no writers left),
+ *               or -1 if failed or if the read would wait and fd is
+ *               non-blocking
+ * Side effects: Consumes bytes from the pipe
+ */
+int32_t pipe_read(file_desc_t *fd, void* buf, int32_t nbytes) {
+    pipe_t *p = &pipes[fd->inode];
+    uint8_t *cbuf = (uint8_t*) buf;
+    int32_t count = 0;
+
+    if (fd->ftable != &pipe_read_ftable) return -1;
+    if (buf == NULL || nbytes < 0) return -1;
+
+    sti();
+    while (p->head == p->tail && p->writers > 0) {
+        if (fd->flags.nonblock) return -1;     // not end of file, just nothing yet
+        p->read_waiter = curr_pid;
+        asm volatile ("hlt");
+    }
+
+    cli();
+    while (count < nbytes && p->head != p->tail) {
+        uint32_t offset = p->head & (PIPE_BUF_SIZE - 1);
+        uint32_t len = p->tail - p->head;
+
+        // Copy up to the end of the buffer, then wrap around
+        if (len > PIPE_BUF_SIZE - offset) len = PIPE_BUF_SIZE - offset;
+        if (len > nbytes - count) len = nbytes - count;
+
+        memcpy(cbuf + count, &p->buf[offset], len);
+        p->head += len;
+        count += len;
+    }
+    sched_wake(p->write_waiter);
+    p->write_waiter = -1;
+    sti();
+
+    return count;
+}
+
+/** pipe_write
+ * Writes bytes to a pipe. Waits while the pipe is full and a reader
+ * still has it open.
+ * Inputs: fd -- Write end of the pipe
+ *         buf -- Data to write
+ *         nbytes -- Number of bytes to write
+ * Return value: Number of bytes written, or -1 if there are no readers left
+ * Side effects: Adds bytes to the pipe
+ */
+int32_t pipe_write(file_desc_t *fd, const void* buf, int32_t nbytes) {
+    pipe_t *p = &pipes[fd->inode];
+    const uint8_t *cbuf = (const uint8_t*) buf;
+    int32_t count = 0;
+
+    if (fd->ftable != &pipe_write_ftable) return -1;
+    if (buf == NULL || nbytes < 0) return -1;
+
+    sti();
+    while (count < nbytes) {
+        while (p->tail - p->head == PIPE_BUF_SIZE && p->readers > 0) {
+            if (fd->flags.nonblock) return count;
+            p->write_waiter = curr_pid;
+            asm volatile ("hlt");
+        }
+
+        // Nobody will ever read the rest
+        if (p->readers == 0) return (count > 0) ? count : -1;
+
+        cli();
+        uint32_t offset = p->tail & (PIPE_BUF_SIZE - 1);
+        uint32_t len = PIPE_BUF_SIZE - (p->tail - p->head);
+
+        if (len > PIPE_BUF_SIZE - offset) len = PIPE_BUF_SIZE - offset;
+        if (len > nbytes - count) len = nbytes - count;
+
+        memcpy(&p->buf[offset], cbuf + count, len);
+        p->tail += len;
+        count += len;
+        sched_wake(p->read_waiter);
+        p->read_waiter = -1;
+        sti();
+    }
+
+    return count;
+}
+
+/** pipe_open
+ * Pipes have no name in the filesystem, so they can't be opened.
+ * Inputs: Ignored
+ * Return value: -1
+ * Side effects: None
+ */
+int32_t pipe_open(file_desc_t *fd, const uint8_t* filename) {
+    return -1;
+}
+
+/** pipe_close
+ * Closes one end of a pipe. The pipe is freed once both ends are closed.
+ * Inputs: fd -- File descriptor
+ * Return value: 0
+ * Side effects: Decrements the reader or writer count, wakes the other end
+ */
+int32_t pipe_close(file_desc_t *fd) {
+    pipe_t *p = &pipes[fd->inode];
+
+    if (fd->ftable == &pipe_read_ftable) {
+        p->readers--;
+        sched_wake(p->write_waiter);
+        p->write_waiter = -1;
+    } else {
+        p->writers--;
+        sched_wake(p->read_waiter);
+        p->read_waiter = -1;
+    }
+    fd->flags.open = 0;
+    return 0;
+}
+
+/** pipe_poll
+ * Reports whether a read or write on this end would wait.
+ * Inputs: fd -- File descriptor
+ * Return value: POLLIN or POLLOUT if ready, 0 otherwise
+ * Side effects: None
+ */
+int32_t pipe_poll(file_desc_t *fd) {
+    pipe_t *p = &pipes[fd->inode];
+
+    if (fd->ftable == &pipe_read_ftable) {
+        // End of file counts as readable
+        return (p->head != p->tail || p->writers == 0) ? POLLIN : 0;
+    }
+    return (p->tail - p->head < PIPE_BUF_SIZE || p->readers == 0) ? POLLOUT : 0;
+}
+
+file_desc_ftable_t pipe_read_ftable  = {pipe_read, pipe_write, pipe_open, pipe_close, NULL, pipe_poll};
+file_desc_ftable_t pipe_write_ftable = {pipe_read, pipe_write, pipe_open, pipe_close, NULL, pipe_poll};
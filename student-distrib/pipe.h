@@ -0,0 +1,33 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "types.h"
+#include "filedescriptor.h"
+
+#define MAX_PIPES       8
+#define PIPE_BUF_SIZE   0x2000  // must be a power of 2
+
+/* A pipe is a ring buffer shared by the open files of its two ends.
+ * head and tail are free-running counters, masked with PIPE_BUF_SIZE - 1. */
+typedef struct pipe {
+    uint8_t buf[PIPE_BUF_SIZE];
+    volatile uint32_t head;     // next byte to be read
+    volatile uint32_t tail;     // next free slot
+    volatile int32_t readers;   // open files on the read end
+    volatile int32_t writers;   // open files on the write end
+    volatile int32_t read_waiter;   // process to wake when data arrives, -1 if none
+    volatile int32_t write_waiter;  // process to wake when space frees up, -1 if none
+} pipe_t;
+
+extern file_desc_ftable_t pipe_read_ftable;
+extern file_desc_ftable_t pipe_write_ftable;
+
+extern int32_t pipe_alloc(file_desc_t *read_end, file_desc_t *write_end);
+
+extern int32_t pipe_read(file_desc_t *fd, void* buf, int32_t nbytes);
+extern int32_t pipe_write(file_desc_t *fd, const void* buf, int32_t nbytes);
+extern int32_t pipe_open(file_desc_t *fd, const uint8_t* filename);
+extern int32_t pipe_close(file_desc_t *fd);
+extern int32_t pipe_poll(file_desc_t *fd);
+
+#endif
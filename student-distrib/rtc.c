@@ -1,18 +1,31 @@
-/* rtc.c - Functions to interact with the rtc */
+/* rtc.c - Functions to interact with the rtc
+ * The RTC interrupts at RTC_RATE Hz while any "rtc" file is open. Each open
+ * file gets virtual interrupts at its own rate, from a list of the open
+ * files sorted by when their next one is due, so an interrupt only looks
+ * at the files whose virtual interrupt it is. */
 
 #include "rtc.h"
 #include "i8259.h"
 #include "lib.h"
-#include "terminal_driver.h"
+#include "syscalls.h"
+#include "scheduling.h"
 
+/* RTC interrupts since boot */
+static volatile uint32_t rtc_ticks;
+/* Open rtc files, soonest deadline first */
+static file_desc_t *deadlines;
 
-/* Initializes RTC, turns on periodic interrupts, and enables
- * the associated IRQ on the PIC 
+// Private helper functions
+static void rtc_insert(file_desc_t *fd);
+static void rtc_remove(file_desc_t *fd);
+
+
+/* Initializes RTC and turns on periodic interrupts. The IRQ stays masked
+ * until an rtc file is opened
  *      INPUTS: none
  *      OUTPUTS: none
  *      RETURN VALUE: none
- *      SIDE EFFECTS: Sets interrupt flag, enables interrupts from the RTC,
- *                    and RTC will generate periodic interrupts at 2 Hz
+ *      SIDE EFFECTS: RTC will generate periodic interrupts at RTC_RATE Hz
  */
 void rtc_init(){
     uint8_t prev;
@@ -20,36 +33,35 @@ void rtc_init(){
     prev = inb(CMOS_PORT);
     outb(0x8B, RTC_PORT);   // set index again
     outb((prev|0x40), CMOS_PORT);   // turns on periodic interrupts (bit 6 in Status Register B)
-    enable_irq(RTC_IRQ);
     outb(0x8A, RTC_PORT);   // set index again
     outb(0x06, CMOS_PORT);   // set rate selector to 0110 (1024 Hz)
 
-    int i;
-    for (i=0; i<MAX_TERMINALS; i++) {
-        terminal_data[active_terminal].rtc_divider = RTC_RATE / 2;     // set rtc frequency to 2 Hz
-        terminal_data[active_terminal].rtc_counter = 0;
-    }
+    rtc_ticks = 0;
+    deadlines = NULL;
 }
 
 /* Handles interrupts generated by the RTC
  *  INPUTS: none
  *  OUTPUTS: none
  *  RETURN VALUE: none
- *  SIDE EFFECTS: Calls test_interrupts, which prints onto the screen
+ *  SIDE EFFECTS: Gives each open rtc file whose deadline has come a
+ *                virtual interrupt and its next deadline
  */
 void rtc_handler(){
+    file_desc_t *fd;
+
     outb(0x0C, RTC_PORT);	// select register C
     inb(CMOS_PORT);		    // just throw away contents
 
-    int i;
-    for (i = 0; i < MAX_TERMINALS; i++) {
-        //terminal_data[i].rtc_interrupt_received = 0;
-        terminal_data[i].rtc_counter++;
-        if(terminal_data[i].rtc_counter >= terminal_data[i].rtc_divider){
-            //test_interrupts();
-            terminal_data[i].rtc_counter = 0;
-            terminal_data[i].rtc_interrupt_received = 1;
-        }
+    rtc_ticks++;
+    while (deadlines != NULL && (int32_t)(rtc_ticks - deadlines->rtc.deadline) >= 0) {
+        fd = deadlines;
+        deadlines = fd->rtc.next;
+        fd->rtc.received = 1;
+        fd->rtc.deadline += fd->rtc.divider;
+        sched_wake(fd->rtc.waiter);
+        fd->rtc.waiter = -1;
+        rtc_insert(fd);
     }
 
     send_eoi(RTC_IRQ);
@@ -57,56 +69,81 @@ void rtc_handler(){
 
 
 /* Initializes rtc frequency to 2 Hz
- *  INPUTS: defined but not used
- *  OUTPUTS: sets terminal_data[active_terminal].rtc_counter to 0, divider to RTC_RATE/2
- *  RETURN VALUE: none
- *  SIDE EFFECTS: none
+ *  INPUTS: fd - the file being opened
+ *          filename - defined but not used
+ *  OUTPUTS: sets fd's divider to RTC_RATE/2
+ *  RETURN VALUE: 0
+ *  SIDE EFFECTS: Unmasks the RTC interrupt if it's the only rtc file open
  */
 int32_t rtc_open(file_desc_t *fd, const uint8_t* filename){
-    terminal_data[active_terminal].rtc_divider = RTC_RATE / 2;     // set rtc frequency to 2 Hz
-    terminal_data[active_terminal].rtc_counter = 0;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    fd->rtc.divider = RTC_RATE / 2;     // set rtc frequency to 2 Hz
+    fd->rtc.deadline = rtc_ticks + fd->rtc.divider;
+    fd->rtc.received = 0;
+    fd->rtc.waiter = -1;
+    if (deadlines == NULL) enable_irq(RTC_IRQ);
+    rtc_insert(fd);
+    restore_flags(flags);
+
     fd->flags.open = 1;
     return 0;
 }
 
-/* Doesn't really do anything but still need to define
- *  INPUTS: defined but not used
+/* Stops the file's virtual interrupts
+ *  INPUTS: fd - an open rtc file
  *  OUTPUTS: none
  *  RETURN VALUE: 0
- *  SIDE EFFECTS: none
+ *  SIDE EFFECTS: Masks the RTC interrupt if no rtc file is left open
  */
 int32_t rtc_close(file_desc_t *fd){
-    terminal_data[active_terminal].rtc_counter = 0;
-    terminal_data[active_terminal].rtc_divider = RTC_RATE / 2;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    rtc_remove(fd);
+    if (deadlines == NULL) disable_irq(RTC_IRQ);
+    restore_flags(flags);
+
     fd->flags.open = 0;
     return 0;
 }
 
-/* Waits until interrupt has occurred
- *  INPUTS: defined but not used
+/* Waits until the file's next virtual interrupt
+ *  INPUTS: fd - an open rtc file
+ *          buf, nbytes - defined but not used
  *  OUTPUTS: none
  *  RETURN VALUE: 0
- *  SIDE EFFECTS: spins in while loop until rtc interrupt occurs
+ *  SIDE EFFECTS: halts the CPU between interrupts while waiting
  */
 int32_t rtc_read(file_desc_t *fd, void* buf, int32_t nbytes){
-    sti();
-    while(terminal_data[active_terminal].rtc_interrupt_received == 0){
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while(fd->rtc.received == 0){
         // wait until interrupt occurs
+        fd->rtc.waiter = curr_pid;
+        sti();
+        asm volatile ("hlt");
+        cli();
     }
-    terminal_data[active_terminal].rtc_interrupt_received = 0;
+    fd->rtc.received = 0;
+    restore_flags(flags);
     return 0;
 }
 
 /* Changes the rtc frequency
- *  INPUTS: int32_t fd - not used
+ *  INPUTS: fd - an open rtc file
  *          void* buf - buffer of data containing new frequency, must be power of 2
  *          int32_t nbytes - number of bytes in buf, must be 4
  *  OUTPUTS: none
  *  RETURN VALUE: -1 if unsuccessful, nbytes if success
- *  SIDE EFFECTS: changes rtc virtual frequency
+ *  SIDE EFFECTS: changes the file's virtual frequency, starting a new period
  */
 int32_t rtc_write(file_desc_t *fd, const void* buf, int32_t nbytes){
     int32_t buffer;
+    uint32_t flags;
+
     if(nbytes != 4 || buf == NULL){ // only accepts writes of 4 bytes
         return -1;
     }
@@ -114,8 +151,12 @@ int32_t rtc_write(file_desc_t *fd, const void* buf, int32_t nbytes){
     buffer = *(int32_t*)buf;
     if((buffer != 0) && ((buffer & (buffer - 1)) == 0)){    // check if power of 2
         if(buffer <= RTC_RATE){
-            terminal_data[active_terminal].rtc_divider = RTC_RATE / buffer;
-            terminal_data[active_terminal].rtc_counter = 0;
+            cli_and_save(flags);
+            rtc_remove(fd);
+            fd->rtc.divider = RTC_RATE / buffer;
+            fd->rtc.deadline = rtc_ticks + fd->rtc.divider;
+            rtc_insert(fd);
+            restore_flags(flags);
         }else{
             return -1;
         }
@@ -128,3 +169,45 @@ int32_t rtc_write(file_desc_t *fd, const void* buf, int32_t nbytes){
 
 }
 
+/* Reports whether a virtual RTC interrupt is waiting to be read
+ *  INPUTS: fd - an open rtc file
+ *  OUTPUTS: none
+ *  RETURN VALUE: POLLIN if rtc_read would return immediately, 0 otherwise
+ *  SIDE EFFECTS: none
+ */
+int32_t rtc_poll(file_desc_t *fd){
+    return fd->rtc.received ? POLLIN : 0;
+}
+
+/* Puts a file in the deadline list, after those due at the same tick
+ *  INPUTS: fd - an rtc file not in the list
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: interrupts must be off
+ */
+static void rtc_insert(file_desc_t *fd){
+    file_desc_t **link = &deadlines;
+
+    while (*link != NULL && (int32_t)(fd->rtc.deadline - (*link)->rtc.deadline) >= 0) {
+        link = &(*link)->rtc.next;
+    }
+    fd->rtc.next = *link;
+    *link = fd;
+}
+
+/* Takes a file out of the deadline list
+ *  INPUTS: fd - an rtc file
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: interrupts must be off
+ */
+static void rtc_remove(file_desc_t *fd){
+    file_desc_t **link;
+
+    for (link = &deadlines; *link != NULL; link = &(*link)->rtc.next) {
+        if (*link == fd) {
+            *link = fd->rtc.next;
+            return;
+        }
+    }
+}
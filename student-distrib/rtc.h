@@ -8,13 +8,12 @@
 #define RTC_IRQ     8
 #define RTC_RATE    1024
 
-/* Initializes RTC, turns on periodic interrupts, and enables
- * the associated IRQ on the PIC 
+/* Initializes RTC and turns on periodic interrupts. The IRQ stays masked
+ * until an rtc file is opened
  *      INPUTS: none
  *      OUTPUTS: none
  *      RETURN VALUE: none
- *      SIDE EFFECTS: Sets interrupt flag, enables interrupts from the RTC,
- *                    and RTC will generate periodic interrupts at 2 Hz
+ *      SIDE EFFECTS: RTC will generate periodic interrupts at RTC_RATE Hz
  */
 void rtc_init();
 
@@ -23,42 +22,53 @@ void rtc_init();
  *  INPUTS: none
  *  OUTPUTS: none
  *  RETURN VALUE: none
- *  SIDE EFFECTS: Calls test_interrupts, which prints onto the screen
+ *  SIDE EFFECTS: Gives each open rtc file whose deadline has come a
+ *                virtual interrupt and its next deadline
  */
 void rtc_handler();
 
 
 /* Initializes rtc frequency to 2 Hz
- *  INPUTS: none
- *  OUTPUTS: sets counter to 0, divider to RTC_RATE/2
- *  RETURN VALUE: none
- *  SIDE EFFECTS: none
+ *  INPUTS: fd - the file being opened
+ *          filename - defined but not used
+ *  OUTPUTS: sets fd's divider to RTC_RATE/2
+ *  RETURN VALUE: 0
+ *  SIDE EFFECTS: Unmasks the RTC interrupt if it's the only rtc file open
  */
 int32_t rtc_open(file_desc_t *fd, const uint8_t* filename);
 
 
-/* Doesn't really do anything but still need to define
- *  INPUTS: none
+/* Stops the file's virtual interrupts
+ *  INPUTS: fd - an open rtc file
  *  OUTPUTS: none
  *  RETURN VALUE: 0
- *  SIDE EFFECTS: none
+ *  SIDE EFFECTS: Masks the RTC interrupt if no rtc file is left open
  */
 int32_t rtc_close(file_desc_t *fd);
 
-/* Waits until interrupt has occurred
- *  INPUTS: defined but not used
+/* Waits until the file's next virtual interrupt
+ *  INPUTS: fd - an open rtc file
+ *          buf, nbytes - defined but not used
  *  OUTPUTS: none
  *  RETURN VALUE: 0
- *  SIDE EFFECTS: none
+ *  SIDE EFFECTS: halts the CPU between interrupts while waiting
  */
 int32_t rtc_read(file_desc_t *fd, void* buf, int32_t nbytes);
 
 /* Changes the rtc frequency
- *  INPUTS: int32_t fd - not used
+ *  INPUTS: fd - an open rtc file
  *          void* buf - buffer of data we want to write, must be power of 2
  *          int32_t nbytes - number of bytes in buf, must be 4
  *  OUTPUTS: none
  *  RETURN VALUE: -1 if unsuccessful, nbytes if success
- *  SIDE EFFECTS: changes rtc virtual frequency
+ *  SIDE EFFECTS: changes the file's virtual frequency, starting a new period
  */
 int32_t rtc_write(file_desc_t *fd, const void* buf, int32_t nbytes);
+
+/* Reports whether a virtual RTC interrupt is waiting to be read
+ *  INPUTS: fd - an open rtc file
+ *  OUTPUTS: none
+ *  RETURN VALUE: POLLIN if rtc_read would return immediately, 0 otherwise
+ *  SIDE EFFECTS: none
+ */
+int32_t rtc_poll(file_desc_t *fd);
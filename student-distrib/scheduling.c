@@ -6,10 +6,21 @@
 #include "terminal_driver.h"
 #include "i8259.h"
 #include "scheduling.h"
+#include "signal.h"
+#include "timer.h"
+#include "apic.h"
+#include "smp.h"
 
 
+/* Number of PIT interrupts since boot */
+volatile uint32_t pit_ticks = 0;
+
+// Private helper functions
+static void sched_boot(void);
+
 /* pit_init()
- * Initializes the PIT
+ * Starts the scheduler tick, PIT_HZ times a second on the PIT's vector:
+ * from the local APIC timer if the APIC is in use, else from the PIT
  * Inputs: none
  * Outputs: none
  * Side effects: 
@@ -18,6 +29,8 @@ void pit_init(void){
     
 	//cli();?
 
+    if (apic_timer_init() == 0) return;
+
 	//interrupt every 100 HZ
 
     outb(PIT_MODE, PIT_CMD);
@@ -30,97 +43,271 @@ void pit_init(void){
 }
 
 
+/* sched_start()
+ * Moves the boot processor onto its idle stack and starts a shell on every
+ * terminal, spread over the processors. The boot stack is pid 0's kernel
+ * stack, so the idle loop can't stay on it
+ * Inputs: none
+ * Outputs: none (this function doesn't return)
+ * Side effects: Abandons the boot stack
+ */
+void sched_start(void){
+    cli();
+    asm volatile (
+        "movl %0, %%esp         \n"
+        "xorl %%ebp, %%ebp      \n"
+        "call *%1               \n"
+        :
+        : "r" (idle_stack_top(0)), "r" (sched_boot)
+    );
+}
+
+
+/* sched_boot()
+ * Rest of sched_start(), on the boot processor's idle stack
+ * Inputs: none
+ * Outputs: none (this function doesn't return)
+ * Side effects: Becomes the boot processor's idle loop
+ */
+static void sched_boot(void){
+    int i;
+
+    for (i = 0; i < MAX_TERMINALS; i++) {
+        terminal_data[i].shell_pid = create_process((uint8_t*)"shell", NULL, i, 0);
+    }
+    if (terminal_data[0].shell_pid < 0) {
+        printf("Can't start the shell\n");
+    }
+    sched_idle();
+}
+
+
+/* sched_idle()
+ * Idle loop of a processor. Its timer switches from here to the processes
+ * in its run queue, and back here while it has none
+ * Inputs: none
+ * Outputs: none (this function doesn't return)
+ * Side effects: Enables interrupts
+ */
+void sched_idle(void){
+    this_cpu()->scheduling = 1;
+    sti();
+    while (1) {
+        asm volatile ("hlt");
+    }
+}
+
+
+/* sched_pick_cpu()
+ * Picks the processor for a new process: the one running the fewest
+ * Inputs: none
+ * Outputs: index of the processor in cpus[]
+ * Side effects: Interrupts must be off
+ */
+int32_t sched_pick_cpu(void){
+    uint32_t load[MAX_CPUS];
+    int32_t i, best = 0;
+    pcb_t *pcb;
+
+    memset(load, 0, sizeof(load));
+    for (i = 0; i < MAX_PROCESSES; i++) {
+        pcb = get_pcb(i);
+        if (pcb != NULL && pidarray[i] == USED) load[pcb->cpu]++;
+    }
+    for (i = 1; i < MAX_CPUS; i++) {
+        if (cpus[i].online && load[i] < load[best]) best = i;
+    }
+    return best;
+}
+
+
 /* schedule_process()
- * schedules next process
+ * Timer handler of every processor: runs the next process in its run queue.
+ * The boot processor also keeps time and looks after the terminals
  * Inputs: none
  * Outputs: none
- * Side effects: Switches active terminal and changes process paging
+ * Side effects: Switches visible terminal and changes process paging
  */
 void schedule_process(){
+    cpu_t *cpu = this_cpu();
+    int i;
 
     cli();
 	send_eoi(PIT_IRQ_VECTOR);
+    if (cpu->id == 0) {
+        pit_ticks++;
+        timer_tick();
+    }
 
-    int num = (active_terminal + 1) % MAX_TERMINALS;
-    
-	if(active_terminal == num){
-        sti();
+    // Still booting, nothing to switch to yet
+    if (!cpu->scheduling) {
         return;
-    }	
+    }
 
-    // Switch video memory if terminal change requested
-    if (target_visible_terminal != visible_terminal && target_visible_terminal == num) {
-        // Save current terminal
-        memcpy(term_vidmem[visible_terminal],(uint8_t*) VIDEO_REAL_ADDR, FOUR_KB);
+    if (cpu->id == 0) {
+        // Switch video memory if terminal change requested
+        if (target_visible_terminal != visible_terminal) {
+            // Programs on other processors may be writing either screen through vidmap
+            vidmap_stop(visible_terminal, target_visible_terminal);
 
-        // Load target terminal
-        memcpy((uint8_t*) VIDEO_REAL_ADDR,term_vidmem[num], FOUR_KB);
-        visible_terminal = num;
-        
-        update_cursor_pos();
+            // Save current terminal
+            memcpy(term_vidmem[visible_terminal],(uint8_t*) VIDEO_REAL_ADDR, FOUR_KB);
+
+            // Load target terminal
+            memcpy((uint8_t*) VIDEO_REAL_ADDR,term_vidmem[target_visible_terminal], FOUR_KB);
+            visible_terminal = target_visible_terminal;
+
+            vidmap_resume();
+        }
+
+        // Retry shells that couldn't be restarted because no PID was free
+        for (i = 0; i < MAX_TERMINALS; i++) {
+            if (terminal_data[i].shell_pid < 0) {
+                terminal_data[i].shell_pid = create_process((uint8_t*)"shell", NULL, i, 0);
+            }
+        }
     }
 
-    // Switch terminal data
-    terminal_data[active_terminal].curr_pid = curr_pid;
+    schedule_next();
+
+    // Running again. A signal that kills it can't wait until it's back in
+    // user mode, since it may be waiting in the kernel
+    if (curr_pid >= 0 && signal_fatal(get_pcb(curr_pid))) {
+        kill_current_proc(256);
+    }
+}
 
-    uint32_t esp, ebp;
-    asm volatile
-    (
-        "\t movl %%esp, %0 \n"
-        "\t movl %%ebp, %1 \n"
-        :"=rm"(esp), "=rm"(ebp) // output
-    );
 
-    terminal_data[active_terminal].tss_esp0 = tss.esp0;
-    terminal_data[active_terminal].esp_save = esp;
-    terminal_data[active_terminal].ebp_save = ebp;
+/* sched_wake()
+ * Runs a process waiting in the kernel as soon as what it waits for has
+ * happened. If it is pinned to another processor, that processor gets a
+ * reschedule IPI; otherwise it would only notice on its next timer tick
+ * Inputs: pid -- the waiting process, -1 for none
+ * Outputs: none
+ * Side effects: Interrupts must be off
+ */
+void sched_wake(int32_t pid){
+    pcb_t *pcb = get_pcb(pid);
+    cpu_t *cpu;
 
-    // Switch to target terminal
-    if(terminal_data[num].curr_pid == -1){
-        // first-time terminal initialization
-        curr_pid = -1;
-        //int32_t prev_terminal = active_terminal;
-        active_terminal = num;
-        clear();
-        set_cursor_pos(0, 0);
-        execute((uint8_t*)"shell");
+    if (pcb == NULL || pidarray[pid] != USED) return;
+    cpu = &cpus[pcb->cpu];
+    if (cpu == this_cpu()) return;
 
-        //shouldn't need in scheduling
-        // if reach here then execute failed
-        //switch_terminal(prev_terminal);
+    cpu->wake_pid = pid;
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_FIXED | RESCHED_VECTOR);
+}
+
+
+/* sched_ipi()
+ * Reschedule IPI handler: switches to the process sched_wake named. If it
+ * is already running, it was halted in its wait and the IPI woke it
+ * Inputs: none
+ * Outputs: none
+ * Side effects: Returns once the interrupted process is scheduled again
+ */
+void sched_ipi(void){
+    cpu_t *cpu = this_cpu();
+    int32_t pid = cpu->wake_pid;
 
+    lapic_eoi();
+    cpu->wake_pid = -1;
+    if (!cpu->scheduling || pid < 0 || pid == curr_pid) {
         return;
-    } else {
-        curr_pid = terminal_data[num].curr_pid;
-	    active_terminal = num;
+    }
+    if (pidarray[pid] != USED || get_pcb(pid)->cpu != cpu->id) {
+        return;
+    }
 
-        if (terminal_data[num].halt_flag) {
-            terminal_data[num].halt_flag = 0;
-            kill_current_proc(256);
-            return; //never reached
-        }
+    switch_to(pid);
 
-        tss.esp0 = terminal_data[num].tss_esp0;
-        esp = terminal_data[num].esp_save;
-        ebp = terminal_data[num].ebp_save;
+    if (curr_pid >= 0 && signal_fatal(get_pcb(curr_pid))) {
+        kill_current_proc(256);
+    }
+}
 
-        set_process_paging(curr_pid);
 
-        update_cursor_pos();
+/* schedule_next()
+ * Switches to the next runnable process on this processor after the current
+ * one, round robin, or to the idle loop if there is none
+ * Inputs: none
+ * Outputs: none
+ * Side effects: Returns once the current process is scheduled again, or
+ *               never if it has halted
+ */
+void schedule_next(void){
+    int32_t i, pid, me = this_cpu()->id;
 
-        asm volatile (
-            "movl %0, %%esp         \n"
-            "movl %1, %%ebp         \n"
-            "leave                  \n"
-            "ret                    \n"
-            :
-            : "r" (esp), "r" (ebp)
-        );
+    for (i = 1; i <= MAX_PROCESSES; i++) {
+        pid = (curr_pid + i) % MAX_PROCESSES;
+        if (pidarray[pid] == USED && get_pcb(pid)->cpu == me) {
+            switch_to(pid);
+            return;
+        }
+    }
 
-        // This line is never reached
-        return;
+    if (curr_pid >= 0) {
+        switch_to(-1);
     }
 }
 
 
+/* switch_to()
+ * Saves the current kernel stack and continues another process on this
+ * processor where it left off: in switch_to, or at process_entry if it's new
+ * Inputs: pid -- process to run, -1 for the processor's idle loop
+ * Outputs: none
+ * Side effects: Changes paging, the TSS and the active terminal
+ */
+void switch_to(int32_t pid){
+    cpu_t *cpu = this_cpu();
+    int32_t prev_pid = curr_pid;
+    pcb_t *prev = get_pcb(prev_pid);
+    pcb_t *next = get_pcb(pid);
+    uint32_t *esp_save = NULL, *ebp_save = NULL;
+    uint32_t esp, ebp;
 
+    curr_pid = pid;
+    if (next != NULL) {
+        active_terminal = next->terminal;
+        cpu->tss->esp0 = kernel_stack_top(pid);
+        cpu->tss->ss0 = KERNEL_DS;
+        set_process_paging(pid);
+        update_cursor_pos();
+        esp = next->esp_save;
+        ebp = next->ebp_save;
+    } else {
+        esp = cpu->idle_esp;
+        ebp = cpu->idle_ebp;
+    }
+
+    if (prev_pid == pid) {
+        return;
+    }
+
+    // A halted process that was freed has nothing worth saving
+    if (prev_pid < 0) {
+        esp_save = &cpu->idle_esp;
+        ebp_save = &cpu->idle_ebp;
+    } else if (prev != NULL) {
+        esp_save = &prev->esp_save;
+        ebp_save = &prev->ebp_save;
+    }
+    if (esp_save != NULL) {
+        asm volatile
+        (
+            "\t movl %%esp, %0 \n"
+            "\t movl %%ebp, %1 \n"
+            :"=m"(*esp_save), "=m"(*ebp_save) // output
+        );
+    }
+
+    asm volatile (
+        "movl %0, %%esp         \n"
+        "movl %1, %%ebp         \n"
+        "leave                  \n"
+        "ret                    \n"
+        :
+        : "r" (esp), "r" (ebp)
+    );
+}
@@ -7,9 +7,22 @@
 #define PIT_CMD        0x43    //command register port
 #define DIV_HZ	11932    //1193180 / 100 HZ
 #define PIT_DATAREG     0x40
+#define PIT_HZ          100
+#define MS_PER_TICK     (1000 / PIT_HZ)
+
+#include "types.h"
+
+extern volatile uint32_t pit_ticks;
 
 
 void pit_init();
+void sched_start(void);
+void sched_idle(void);
+int32_t sched_pick_cpu(void);
 void schedule_process();
+void schedule_next(void);
+void switch_to(int32_t pid);
+void sched_wake(int32_t pid);
+void sched_ipi(void);
 
 #endif
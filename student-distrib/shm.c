@@ -0,0 +1,184 @@
+#include "shm.h"
+#include "lib.h"
+
+/** All shared memory segments */
+shm_segment_t shm_segments[MAX_SHM_SEGMENTS];
+
+// Private helper functions
+static int32_t shm_find(const uint8_t* name);
+static int32_t shm_create(const uint8_t* name, uint32_t size);
+static void shm_release(int32_t id);
+
+/** shm_map
+ * Maps the named shared memory segment into a process, creating it first
+ * if no process has it mapped.
+ * Inputs: pcb -- Process to map the segment into (the current process)
+ *         name -- Null-terminated segment name, copied into kernel memory
+ *         size -- Size in bytes if the segment has to be created
+ * Outputs: addr -- User address of the segment
+ * Return value: Segment id, or -1 if failed
+ * Side effects: May allocate pages and the process's shared memory page table
+ */
+int32_t shm_map(pcb_t* pcb, const uint8_t* name, uint32_t size, uint8_t** addr) {
+    int32_t id, i;
+    shm_segment_t *seg;
+
+    id = shm_find(name);
+    if (id < 0) id = shm_create(name, size);
+    if (id < 0) return -1;
+    seg = &shm_segments[id];
+
+    if (!(pcb->shm_attached & (1 << id))) {
+        if (pcb->shm_table == NULL) {
+            pcb->shm_table = alloc_page();
+            if (pcb->shm_table == NULL) {
+                if (seg->refcount == 0) shm_release(id);
+                return -1;
+            }
+            memset(pcb->shm_table, 0, PAGETABLE_STEP);
+        }
+
+        for (i = 0; i < seg->npages; i++) {
+            pagetable_entry_t *pte = &pcb->shm_table[id * SHM_SLOT_PAGES + i];
+            pte->val        = 0;
+            pte->addr       = (uint32_t) seg->pages[i] >> PAGE_ALIGN;
+            pte->user       = 1;
+            pte->read_write = 1;
+            pte->present    = 1;
+        }
+
+        seg->refcount++;
+        pcb->shm_attached |= (1 << id);
+        set_process_paging(pcb->pid);
+    }
+
+    *addr = (uint8_t*) (FOUR_MB * SHM_PAGE + id * SHM_SLOT_PAGES * PAGETABLE_STEP);
+    return id;
+}
+
+/** shm_unmap
+ * Unmaps a shared memory segment from a process. The segment is freed once
+ * no process has it mapped.
+ * Inputs: pcb -- Process to unmap from (the current process)
+ *         addr -- Address returned by shm_map
+ * Return value: 0 on success, -1 if addr is not a mapped segment
+ * Side effects: May free the segment's pages
+ */
+int32_t shm_unmap(pcb_t* pcb, uint8_t* addr) {
+    uint32_t offset = (uint32_t) addr - FOUR_MB * SHM_PAGE;
+    int32_t id, i;
+
+    if ((uint32_t) addr < FOUR_MB * SHM_PAGE || offset >= FOUR_MB) return -1;
+    if (offset % (SHM_SLOT_PAGES * PAGETABLE_STEP) != 0) return -1;
+
+    id = offset / (SHM_SLOT_PAGES * PAGETABLE_STEP);
+    if (!(pcb->shm_attached & (1 << id))) return -1;
+
+    for (i = 0; i < SHM_SLOT_PAGES; i++) {
+        pcb->shm_table[id * SHM_SLOT_PAGES + i].val = 0;
+    }
+    pcb->shm_attached &= ~(1 << id);
+
+    if (--shm_segments[id].refcount == 0) shm_release(id);
+
+    if (pcb->shm_attached == 0) {
+        free_page(pcb->shm_table);
+        pcb->shm_table = NULL;
+    }
+    set_process_paging(pcb->pid);
+
+    return 0;
+}
+
+/** shm_unmap_all
+ * Unmaps every shared memory segment from a process that is exiting.
+ * Inputs: pcb -- Process control block
+ * Return value: none
+ * Side effects: May free segments and the process's shared memory page table
+ */
+void shm_unmap_all(pcb_t* pcb) {
+    int32_t id;
+
+    for (id = 0; id < MAX_SHM_SEGMENTS; id++) {
+        if (!(pcb->shm_attached & (1 << id))) continue;
+
+        pcb->shm_attached &= ~(1 << id);
+        if (--shm_segments[id].refcount == 0) shm_release(id);
+    }
+
+    if (pcb->shm_table != NULL) {
+        free_page(pcb->shm_table);
+        pcb->shm_table = NULL;
+    }
+}
+
+/** static shm_find
+ * Looks up a segment by name.
+ * Inputs: name -- Null-terminated segment name
+ * Return value: Segment id, or -1 if not found
+ * Side effects: none
+ */
+static int32_t shm_find(const uint8_t* name) {
+    int32_t id;
+
+    for (id = 0; id < MAX_SHM_SEGMENTS; id++) {
+        if (shm_segments[id].npages != 0 &&
+            strncmp((int8_t*) shm_segments[id].name, (int8_t*) name, SHM_NAME_LEN) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+/** static shm_create
+ * Creates a zero-filled segment.
+ * Inputs: name -- Null-terminated segment name, shorter than SHM_NAME_LEN
+ *         size -- Size in bytes, rounded up to whole pages
+ * Return value: Segment id, or -1 if failed
+ * Side effects: Allocates pages
+ */
+static int32_t shm_create(const uint8_t* name, uint32_t size) {
+    uint32_t npages = (size + PAGETABLE_STEP - 1) / PAGETABLE_STEP;
+    int32_t id, i;
+    shm_segment_t *seg;
+
+    if (npages == 0 || npages > SHM_SLOT_PAGES) return -1;
+    if (strlen((int8_t*) name) == 0 || strlen((int8_t*) name) >= SHM_NAME_LEN) return -1;
+
+    for (id = 0; id < MAX_SHM_SEGMENTS; id++) {
+        if (shm_segments[id].npages == 0) break;
+    }
+    if (id >= MAX_SHM_SEGMENTS) return -1;
+    seg = &shm_segments[id];
+
+    for (i = 0; i < npages; i++) {
+        seg->pages[i] = alloc_page();
+        if (seg->pages[i] == NULL) {
+            seg->npages = i;
+            shm_release(id);
+            return -1;
+        }
+        memset(seg->pages[i], 0, PAGETABLE_STEP);
+    }
+
+    strncpy((int8_t*) seg->name, (int8_t*) name, SHM_NAME_LEN);
+    seg->npages = npages;
+    seg->refcount = 0;
+
+    return id;
+}
+
+/** static shm_release
+ * Frees a segment's pages and marks it unused.
+ * Inputs: id -- Segment id
+ * Return value: none
+ * Side effects: Frees pages
+ */
+static void shm_release(int32_t id) {
+    int32_t i;
+
+    for (i = 0; i < shm_segments[id].npages; i++) {
+        free_page(shm_segments[id].pages[i]);
+    }
+    shm_segments[id].npages = 0;
+}
@@ -0,0 +1,26 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "types.h"
+#include "paging.h"
+#include "syscalls.h"
+
+#define MAX_SHM_SEGMENTS    8
+#define SHM_NAME_LEN        32
+#define SHM_PAGE            35      // page directory entry holding every process's shared memory
+#define SHM_SLOT_PAGES      (PAGETABLE_SIZE / MAX_SHM_SEGMENTS)     // max pages in one segment
+
+/* A named shared memory segment. Segment i is mapped at the same user
+ * address in every process: FOUR_MB * SHM_PAGE + i * SHM_SLOT_PAGES * 4KB */
+typedef struct shm_segment {
+    uint8_t name[SHM_NAME_LEN];
+    uint32_t npages;                // 0 if the segment is unused
+    int32_t refcount;               // processes that have it mapped
+    void* pages[SHM_SLOT_PAGES];    // page pool pages backing the segment
+} shm_segment_t;
+
+extern int32_t shm_map(pcb_t* pcb, const uint8_t* name, uint32_t size, uint8_t** addr);
+extern int32_t shm_unmap(pcb_t* pcb, uint8_t* addr);
+extern void shm_unmap_all(pcb_t* pcb);
+
+#endif
@@ -0,0 +1,236 @@
+/* signal.c - Signals
+ * A signal is marked pending in the process it's sent to and acted on the
+ * next time the process returns to user mode: a handler is called on the
+ * user stack with every signal blocked until it returns through sigreturn.
+ * Without a handler DIV_ZERO, SEGFAULT and INTERRUPT kill the process and
+ * the others are ignored. */
+
+#include "signal.h"
+#include "lib.h"
+#include "scheduling.h"
+
+#define SIG_ALL         ((1U << NUM_SIGNALS) - 1)
+#define SIG_KILLS       ((1U << DIV_ZERO) | (1U << SEGFAULT) | (1U << INTERRUPT))
+#define EFLAGS_DF       0x400
+#define EFLAGS_USER     0xCD5   // CF PF AF ZF SF DF OF, which a handler may change
+
+/* movl $10, %eax; int $0x80 -- calls sigreturn when the handler returns */
+static const uint8_t sigreturn_code[8] = {0xB8, 0x0A, 0x00, 0x00, 0x00, 0xCD, 0x80, 0x90};
+
+// Private helper functions
+static hw_context_t* user_context(pcb_t *pcb);
+static void push_frame(pcb_t *pcb, hw_context_t *ctx, int32_t signum);
+static void alarm_expired(timer_t *t);
+
+/** signal_init
+ * Gives a new process no pending or blocked signals, the default action
+ * for each and no alarm.
+ * Inputs: pcb -- The process
+ * Return value: none
+ * Side effects: none
+ */
+void signal_init(pcb_t* pcb) {
+    int32_t i;
+
+    pcb->sig_pending = 0;
+    pcb->sig_blocked = 0;
+    for (i = 0; i < NUM_SIGNALS; i++) {
+        pcb->sig_handler[i] = NULL;
+    }
+    timer_setup(&pcb->alarm_timer, alarm_expired, pcb);
+    pcb->alarm_interval = 0;
+}
+
+/** send_signal
+ * Marks a signal pending in a process.
+ * Inputs: pcb -- The process
+ *         signum -- The signal
+ * Return value: none
+ * Side effects: Safe in interrupt context
+ */
+void send_signal(pcb_t* pcb, int32_t signum) {
+    uint32_t flags;
+
+    if (pcb == NULL || signum < 0 || signum >= NUM_SIGNALS) return;
+    cli_and_save(flags);
+    pcb->sig_pending |= 1U << signum;
+    restore_flags(flags);
+}
+
+/** signal_fatal
+ * Inputs: pcb -- A process
+ * Return value: 1 if a pending signal that isn't blocked or handled will
+ *               kill the process, 0 otherwise
+ * Side effects: none
+ */
+int32_t signal_fatal(pcb_t* pcb) {
+    uint32_t ready = pcb->sig_pending & ~pcb->sig_blocked & SIG_KILLS;
+    int32_t i;
+
+    for (i = 0; i < NUM_SIGNALS; i++) {
+        if ((ready & (1U << i)) && pcb->sig_handler[i] == NULL) return 1;
+    }
+    return 0;
+}
+
+/** signal_pending
+ * Inputs: pcb -- A process
+ * Return value: 1 if a pending signal that isn't blocked will run a handler
+ *               or kill the process, so a blocking call should return
+ * Side effects: none
+ */
+int32_t signal_pending(pcb_t* pcb) {
+    uint32_t ready = pcb->sig_pending & ~pcb->sig_blocked;
+    int32_t i;
+
+    for (i = 0; i < NUM_SIGNALS; i++) {
+        if ((ready & (1U << i)) && (pcb->sig_handler[i] != NULL || (SIG_KILLS & (1U << i)))) return 1;
+    }
+    return 0;
+}
+
+/** signal_set_handler
+ * Sets the user function called for a signal.
+ * Inputs: pcb -- The process
+ *         signum -- The signal
+ *         handler -- User function taking the signal number, NULL for the
+ *                    default action
+ * Return value: 0 on success, -1 if the signal or address is invalid
+ * Side effects: none
+ */
+int32_t signal_set_handler(pcb_t* pcb, int32_t signum, void* handler) {
+    if (signum < 0 || signum >= NUM_SIGNALS) return -1;
+    if (handler != NULL && bad_userspace_addr(handler, 1)) return -1;
+
+    pcb->sig_handler[signum] = handler;
+    return 0;
+}
+
+/** signal_return
+ * Ends a signal handler: the process continues where it was interrupted,
+ * with the registers as the handler left them in its frame and the signals
+ * blocked before it ran.
+ * Inputs: pcb -- The current process, in the sigreturn system call
+ * Return value: The eax to return to the process
+ * Side effects: Kills the process if its stack holds no frame
+ */
+int32_t signal_return(pcb_t* pcb) {
+    hw_context_t *ctx = user_context(pcb);
+    sig_frame_t *frame = (sig_frame_t*)(ctx->esp - sizeof(uint32_t));  // ret_addr was popped
+
+    if (bad_userspace_addr(frame, sizeof(sig_frame_t))) kill_current_proc(256);
+
+    // Segments stay as they are, so the process can't give itself the kernel's
+    ctx->ebx = frame->context.ebx;
+    ctx->ecx = frame->context.ecx;
+    ctx->edx = frame->context.edx;
+    ctx->esi = frame->context.esi;
+    ctx->edi = frame->context.edi;
+    ctx->ebp = frame->context.ebp;
+    ctx->eax = frame->context.eax;
+    ctx->eip = frame->context.eip;
+    ctx->esp = frame->context.esp;
+    ctx->eflags = (ctx->eflags & ~EFLAGS_USER) | (frame->context.eflags & EFLAGS_USER);
+    pcb->sig_blocked = frame->blocked & SIG_ALL;
+
+    return ctx->eax;
+}
+
+/** signal_set_alarm
+ * Sends a process ALARM after a number of PIT ticks, replacing the alarm
+ * it had.
+ * Inputs: pcb -- The process
+ *         ticks -- Ticks until the first ALARM, 0 to stop the alarm
+ *         interval -- Ticks between later ones, 0 for just one
+ * Return value: Ticks that were left on the old alarm, 0 if none
+ * Side effects: none
+ */
+uint32_t signal_set_alarm(pcb_t* pcb, uint32_t ticks, uint32_t interval) {
+    uint32_t flags, left;
+
+    cli_and_save(flags);
+    left = timer_del(&pcb->alarm_timer);
+    pcb->alarm_interval = interval;
+    if (ticks != 0) timer_add(&pcb->alarm_timer, pit_ticks + ticks);
+    restore_flags(flags);
+    return left;
+}
+
+/** do_signals
+ * Acts on the current process's pending signals before it returns to user
+ * mode: calls the handler of the lowest one that isn't blocked, or kills
+ * or ignores it.
+ * Inputs: ctx -- Registers to return with, on the kernel stack
+ * Return value: none
+ * Side effects: Called with interrupts off on every return from an
+ *               interrupt, exception or system call. Doesn't return if the
+ *               process is killed
+ */
+void do_signals(hw_context_t* ctx) {
+    pcb_t *pcb;
+    uint32_t ready;
+    int32_t signum;
+
+    // Kernel code is never interrupted by a handler
+    if ((ctx->cs & 3) != 3) return;
+    pcb = get_pcb(curr_pid);
+    if (pcb == NULL) return;
+
+    while ((ready = pcb->sig_pending & ~pcb->sig_blocked) != 0) {
+        for (signum = 0; !(ready & (1U << signum)); signum++);
+        pcb->sig_pending &= ~(1U << signum);
+
+        if (pcb->sig_handler[signum] != NULL) {
+            push_frame(pcb, ctx, signum);
+            return;
+        }
+        if (SIG_KILLS & (1U << signum)) kill_current_proc(256);
+    }
+}
+
+/** static user_context
+ * Inputs: pcb -- The current process, in a system call
+ * Return value: Its user registers, at the top of its kernel stack
+ */
+static hw_context_t* user_context(pcb_t *pcb) {
+    return (hw_context_t*)(kernel_stack_top(pcb->pid) - sizeof(hw_context_t));
+}
+
+/** static push_frame
+ * Sets the process up to run a signal handler when it returns to user mode.
+ * Inputs: pcb -- The current process
+ *         ctx -- Its user registers
+ *         signum -- Signal to handle
+ * Return value: none
+ * Side effects: Writes the frame below the user stack pointer. Kills the
+ *               process if it doesn't fit there
+ */
+static void push_frame(pcb_t *pcb, hw_context_t *ctx, int32_t signum) {
+    sig_frame_t *frame = (sig_frame_t*)((ctx->esp - sizeof(sig_frame_t)) & ~0x3);
+
+    if (bad_userspace_write(frame, sizeof(sig_frame_t))) kill_current_proc(256);
+
+    frame->ret_addr = (uint32_t)frame->code;
+    frame->signum = signum;
+    frame->context = *ctx;
+    frame->blocked = pcb->sig_blocked;
+    memcpy(frame->code, sigreturn_code, sizeof(frame->code));
+
+    pcb->sig_blocked = SIG_ALL;
+    ctx->esp = (uint32_t)frame;
+    ctx->eip = (uint32_t)pcb->sig_handler[signum];
+    ctx->eflags &= ~EFLAGS_DF;
+}
+
+/** static alarm_expired
+ * Timer callback: sends ALARM and starts the next interval.
+ * Inputs: t -- The process's alarm_timer
+ * Return value: none
+ * Side effects: Runs in the PIT interrupt
+ */
+static void alarm_expired(timer_t *t) {
+    pcb_t *pcb = t->data;
+
+    send_signal(pcb, ALARM);
+    if (pcb->alarm_interval != 0) timer_add(t, t->expires + pcb->alarm_interval);
+}
@@ -0,0 +1,38 @@
+#ifndef SIGNAL_H
+#define SIGNAL_H
+
+#include "types.h"
+#include "syscalls.h"
+
+/* Registers saved on the kernel stack by every interrupt, exception and
+ * system call. A signal handler finds a copy of them just above its
+ * signal number on the user stack. */
+typedef struct hw_context {
+    uint32_t ebx, ecx, edx, esi, edi, ebp, eax;
+    uint32_t ds, es, fs;
+    uint32_t vector;        // interrupt, exception or system call vector
+    uint32_t error_code;    // 0 for exceptions without one
+    uint32_t eip, cs, eflags;
+    uint32_t esp, ss;       // only there when coming from user mode
+} hw_context_t;
+
+/* What a handler is called with on the user stack. It returns into code,
+ * which calls sigreturn. */
+typedef struct sig_frame {
+    uint32_t ret_addr;
+    uint32_t signum;
+    hw_context_t context;   // where the process was interrupted
+    uint32_t blocked;       // signals blocked before the handler ran
+    uint8_t code[8];
+} sig_frame_t;
+
+extern void signal_init(pcb_t* pcb);
+extern void send_signal(pcb_t* pcb, int32_t signum);
+extern int32_t signal_fatal(pcb_t* pcb);
+extern int32_t signal_pending(pcb_t* pcb);
+extern int32_t signal_set_handler(pcb_t* pcb, int32_t signum, void* handler);
+extern int32_t signal_return(pcb_t* pcb);
+extern uint32_t signal_set_alarm(pcb_t* pcb, uint32_t ticks, uint32_t interval);
+extern void do_signals(hw_context_t* ctx);
+
+#endif
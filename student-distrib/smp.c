@@ -0,0 +1,270 @@
+/* smp.c - Starting the other processors, and the kernel lock
+ * The kernel was written for one processor, where turning interrupts off
+ * was enough to keep a critical section to itself. On several processors
+ * cli() and cli_and_save() also take the kernel lock, and sti() and
+ * restore_flags() give it back, so a processor holds the lock exactly
+ * while its interrupts are off in the kernel. Every interrupt, exception
+ * and system call takes it on entry and return_from_interrupt lets it go
+ * if it returns to code that runs with interrupts on. User programs, and
+ * the kernel's waits with interrupts on, run on all processors at once.
+ *
+ * Programs write to video memory through vidmap without the lock. When the
+ * boot processor changes the visible terminal it parks every processor
+ * running such a program with an IPI, copies the screens and lets them
+ * remap vidmap. A processor spinning for the kernel lock can't take the
+ * IPI, so it parks from the spin loop instead. */
+
+#include "smp.h"
+#include "lib.h"
+#include "paging.h"
+#include "timer.h"
+#include "scheduling.h"
+#include "syscalls.h"
+
+#define AP_TIMEOUT_MS       100
+#define INIT_DELAY_MS       10
+#define STARTUP_DELAY_DIV   5           // 1/5 ms between the two STARTUPs
+#define TSS_AVAILABLE       0x9
+
+/* Set up in boot.S; copied to AP_TRAMPOLINE_ADDR */
+extern uint8_t ap_trampoline[], ap_trampoline_end[], ap_gdtr[], ap_stack[];
+
+cpu_t cpus[MAX_CPUS] = {
+    [0] = { .online = 1, .pid = -1, .tss = &tss, .wake_pid = -1 },
+};
+
+static tss_t ap_tss[AP_TSS_COUNT];
+static uint8_t idle_stacks[MAX_CPUS][IDLE_STACK_SIZE] __attribute__((aligned (16)));
+/* Processor ap_main is starting */
+static volatile int32_t ap_booting;
+
+static spinlock_t klock = SPINLOCK_INIT;
+static volatile int32_t klock_owner = -1;
+
+// Private helper functions
+static void delay_cycles(uint32_t cycles);
+static uint8_t *trampoline_field(uint8_t *field);
+
+/** smp_init
+ * Starts every other processor the firmware lists with INIT and STARTUP
+ * IPIs. Each one runs the trampoline in boot.S into ap_main and waits in
+ * its idle loop for processes.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Needs the APIC, paging and tsc_init. Waits up to
+ *               AP_TIMEOUT_MS for each processor
+ */
+void smp_init(void) {
+    uint8_t *tramp = (uint8_t*) AP_TRAMPOLINE_ADDR;
+    uint64_t start;
+    uint32_t i, vector = AP_TRAMPOLINE_ADDR >> PAGE_ALIGN;
+
+    if (!apic_enabled || apic_num_cpus < 2 || tsc_khz == 0) return;
+
+    cpus[0].apic_id = apic_cpu_ids[0];
+
+    map_low_page(AP_TRAMPOLINE_ADDR, 1);
+    memcpy(tramp, ap_trampoline, ap_trampoline_end - ap_trampoline);
+    memcpy(trampoline_field(ap_gdtr), &gdt_desc, 6);    // limit and base, as lgdt takes them
+
+    for (i = 1; i < apic_num_cpus; i++) {
+        cpus[i].id = i;
+        cpus[i].apic_id = apic_cpu_ids[i];
+        cpus[i].pid = -1;
+        cpus[i].wake_pid = -1;
+        cpus[i].terminal = 0;
+        cpus[i].tss = &ap_tss[i - 1];
+        ap_booting = i;
+        *(uint32_t*) trampoline_field(ap_stack) = idle_stack_top(i);
+
+        lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_INIT);
+        delay_cycles(tsc_khz * INIT_DELAY_MS);
+        lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_STARTUP | vector);
+        delay_cycles(tsc_khz / STARTUP_DELAY_DIV);
+        lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_STARTUP | vector);
+
+        start = rdtsc();
+        while (!cpus[i].online && rdtsc() - start < (uint64_t) tsc_khz * AP_TIMEOUT_MS);
+        if (!cpus[i].online) printf("Processor %d didn't start\n", i);
+    }
+
+    map_low_page(AP_TRAMPOLINE_ADDR, 0);
+}
+
+/** ap_main
+ * C entry point of the other processors, on the stack smp_init gave the
+ * trampoline. Turns on paging, loads the IDT and its own TSS and starts
+ * its local APIC timer.
+ * Inputs: none
+ * Return value: none (this function doesn't return)
+ * Side effects: Becomes the processor's idle loop
+ */
+void ap_main(void) {
+    cpu_t *cpu = &cpus[ap_booting];
+    seg_desc_t the_tss_desc = tss_desc_ptr;
+
+    init_paging_ap(cpu->id);
+    lidt(idt_desc_ptr);
+    lldt(KERNEL_LDT);
+
+    // The boot processor's TSS descriptor, pointing at our TSS
+    the_tss_desc.type = TSS_AVAILABLE;
+    SET_TSS_PARAMS(the_tss_desc, cpu->tss, tss_size);
+    ap_tss_desc_ptr[cpu->id - 1] = the_tss_desc;
+
+    cpu->tss->ldt_segment_selector = KERNEL_LDT;
+    cpu->tss->ss0 = KERNEL_DS;
+    cpu->tss->esp0 = idle_stack_top(cpu->id);
+    ltr(AP_TSS_BASE + ((cpu->id - 1) << 3));
+
+    lapic_init_cpu();
+    lapic_timer_start();
+    cpu->online = 1;
+
+    sched_idle();
+}
+
+/** idle_stack_top
+ * The boot stack is pid 0's kernel stack, so every processor, the boot
+ * processor too, idles on a stack of its own
+ * Inputs: cpu -- Index in cpus[]
+ * Return value: Top of its idle stack
+ */
+uint32_t idle_stack_top(int32_t cpu) {
+    return (uint32_t) &idle_stacks[cpu][IDLE_STACK_SIZE];
+}
+
+/** kernel_lock
+ * Takes the kernel lock unless this processor already holds it. Called by
+ * cli() and cli_and_save() and on every entry to the kernel.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Interrupts must be off. May park for vidmap_stop while
+ *               waiting
+ */
+void kernel_lock(void) {
+    int32_t me = this_cpu()->id;
+
+    if (klock_owner == me) return;
+    while (!spin_trylock(&klock)) {
+        while (klock.locked) {
+            vidmap_park();
+            asm volatile ("pause");
+        }
+    }
+    klock_owner = me;
+}
+
+/** kernel_unlock
+ * Gives the kernel lock back if this processor holds it. Called by sti()
+ * and restore_flags() before interrupts come back on.
+ * Inputs: none
+ * Return value: none
+ * Side effects: none
+ */
+void kernel_unlock(void) {
+    if (klock_owner != this_cpu()->id) return;
+    klock_owner = -1;
+    spin_unlock(&klock);
+}
+
+/** kernel_lock_held
+ * Inputs: none
+ * Return value: 1 if this processor holds the kernel lock
+ */
+int32_t kernel_lock_held(void) {
+    return klock_owner == this_cpu()->id;
+}
+
+/** vidmap_stop
+ * Parks every other processor running a program that has vidmap'd the
+ * video memory of either terminal, so nothing writes to it while the boot
+ * processor swaps the screens.
+ * Inputs: from -- Terminal that is visible now
+ *         to -- Terminal about to become visible
+ * Return value: none
+ * Side effects: Sends VIDMAP_VECTOR IPIs and waits until they are parked.
+ *               Must hold the kernel lock; call vidmap_resume after
+ */
+void vidmap_stop(int32_t from, int32_t to) {
+    int32_t i;
+    pcb_t *pcb;
+
+    for (i = 1; i < MAX_CPUS; i++) {
+        if (!cpus[i].online) continue;
+        pcb = get_pcb(cpus[i].pid);
+        if (pcb == NULL || !pcb->vidmap_active) continue;
+        if (pcb->terminal != from && pcb->terminal != to) continue;
+
+        cpus[i].vidmap_sync = VIDMAP_STOP;
+        lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_FIXED | VIDMAP_VECTOR);
+    }
+    for (i = 1; i < MAX_CPUS; i++) {
+        while (cpus[i].vidmap_sync == VIDMAP_STOP) asm volatile ("pause");
+    }
+}
+
+/** vidmap_resume
+ * Lets the processors vidmap_stop parked go on. Each remaps vidmap for the
+ * new visible terminal first.
+ * Inputs: none
+ * Return value: none
+ * Side effects: none
+ */
+void vidmap_resume(void) {
+    int32_t i;
+
+    for (i = 1; i < MAX_CPUS; i++) {
+        if (cpus[i].vidmap_sync == VIDMAP_PARKED) cpus[i].vidmap_sync = VIDMAP_RUN;
+    }
+}
+
+/** vidmap_park
+ * Waits out a visible terminal change if vidmap_stop asked this processor
+ * to, then points vidmap at the running program's new video memory.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Interrupts must be off. Flushes the TLB if it parked
+ */
+void vidmap_park(void) {
+    cpu_t *cpu = this_cpu();
+    pcb_t *pcb;
+
+    if (cpu->vidmap_sync != VIDMAP_STOP) return;
+
+    cpu->vidmap_sync = VIDMAP_PARKED;
+    while (cpu->vidmap_sync == VIDMAP_PARKED) asm volatile ("pause");
+
+    pcb = get_pcb(cpu->pid);
+    vidmap_paging(pcb != NULL && pcb->vidmap_active);
+}
+
+/** vidmap_ipi
+ * Handler for VIDMAP_VECTOR. It runs without the kernel lock, which the
+ * boot processor holds while it waits.
+ * Inputs: none
+ * Return value: none
+ * Side effects: May park
+ */
+void vidmap_ipi(void) {
+    lapic_eoi();
+    vidmap_park();
+}
+
+/** static delay_cycles
+ * Inputs: cycles -- TSC cycles to busy-wait
+ * Return value: none
+ */
+static void delay_cycles(uint32_t cycles) {
+    uint64_t start = rdtsc();
+
+    while (rdtsc() - start < cycles);
+}
+
+/** static trampoline_field
+ * Inputs: field -- A label in the trampoline in boot.S
+ * Return value: Where it is in the copy at AP_TRAMPOLINE_ADDR
+ */
+static uint8_t *trampoline_field(uint8_t *field) {
+    return (uint8_t*) AP_TRAMPOLINE_ADDR + (field - ap_trampoline);
+}
@@ -0,0 +1,98 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include "types.h"
+#include "x86_desc.h"
+#include "apic.h"
+
+#define IDLE_STACK_SIZE     0x2000      // idle stack of each processor
+
+/* cpu_t.vidmap_sync, while the boot processor changes the visible terminal */
+#define VIDMAP_RUN          0
+#define VIDMAP_STOP         1           // asked to stop using vidmap
+#define VIDMAP_PARKED       2           // waiting for the copy to finish
+
+/* What each processor is doing. A process runs on the processor picked
+ * when it was created (pcb->cpu) and never moves, so a processor's run
+ * queue is simply the processes in pidarray with its id. */
+typedef struct cpu {
+    int32_t id;                     // index in cpus[]
+    uint8_t apic_id;
+    volatile int32_t online;        // 1 once it can take processes
+    int32_t scheduling;             // 1 once its timer switches between processes
+    int32_t pid;                    // running process (curr_pid), -1 in the idle loop
+    int32_t terminal;               // terminal printf writes to (active_terminal)
+    tss_t* tss;
+    uint32_t idle_esp;              // idle loop's kernel stack while a process runs
+    uint32_t idle_ebp;
+    volatile int32_t wake_pid;      // process a reschedule IPI switches to, -1 if none
+    volatile int32_t vidmap_sync;   // VIDMAP_RUN, STOP or PARKED
+} cpu_t;
+
+typedef struct spinlock {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT   { 0 }
+
+extern cpu_t cpus[MAX_CPUS];
+
+extern void smp_init(void);
+extern void ap_main(void);
+extern uint32_t idle_stack_top(int32_t cpu);
+extern void kernel_lock(void);
+extern void kernel_unlock(void);
+extern int32_t kernel_lock_held(void);
+extern void vidmap_stop(int32_t from, int32_t to);
+extern void vidmap_resume(void);
+extern void vidmap_park(void);
+extern void vidmap_ipi(void);
+
+/* this_cpu
+ * Each processor loads its own TSS, so the task register tells them apart.
+ * Return value: The processor running this code
+ */
+static inline cpu_t* this_cpu(void) {
+    uint16_t sel;
+
+    asm volatile ("str %0" : "=r" (sel));
+    if (sel < AP_TSS_BASE) return &cpus[0];
+    return &cpus[((sel - AP_TSS_BASE) >> 3) + 1];
+}
+
+/* spin_lock
+ * Waits until the lock is free and takes it. Doesn't disable interrupts.
+ * Inputs: lock -- The lock
+ */
+static inline void spin_lock(spinlock_t* lock) {
+    uint32_t taken = 1;
+
+    while (1) {
+        asm volatile ("xchgl %0, %1" : "+r" (taken), "+m" (lock->locked) : : "memory");
+        if (!taken) return;
+        while (lock->locked) asm volatile ("pause");
+        taken = 1;
+    }
+}
+
+/* spin_trylock
+ * Takes the lock if it is free. Doesn't disable interrupts.
+ * Inputs: lock -- The lock
+ * Return value: 1 if taken, 0 if another processor holds it
+ */
+static inline int32_t spin_trylock(spinlock_t* lock) {
+    uint32_t taken = 1;
+
+    asm volatile ("xchgl %0, %1" : "+r" (taken), "+m" (lock->locked) : : "memory");
+    return !taken;
+}
+
+/* spin_unlock
+ * Inputs: lock -- A lock this processor holds
+ */
+static inline void spin_unlock(spinlock_t* lock) {
+    asm volatile ("" : : : "memory");
+    lock->locked = 0;
+}
+
+#endif
@@ -4,20 +4,27 @@
 #include "paging.h"
 #include "x86_desc.h"
 #include "terminal_driver.h"
+#include "scheduling.h"
+#include "pipe.h"
+#include "shm.h"
+#include "mmap.h"
+#include "signal.h"
 
-#define SYSCALL_UNIMPLEMENTED(s) \
-        printf(#s " syscall unimplemented\n"); return -1;
 
 
-
-int32_t pidarray[MAX_PROCESSES] = {FREE,FREE,FREE,FREE,FREE,FREE};   // keeps track of available PIDs
-int32_t curr_pid = -1;   // current running process
-uint32_t exit_code;
+int32_t pidarray[MAX_PROCESSES];   // FREE, USED or ZOMBIE for each PID
 
 
 // Private helper functions
 
-static int32_t alloc_fd(pcb_t *pcb);
+static file_desc_t** fd_slot(pcb_t *pcb, int32_t fd);
+static int32_t reserve_fd(pcb_t *pcb, int32_t fd);
+static void close_all_fds(pcb_t *pcb);
+static void process_entry(void);
+static int32_t wait_child(pcb_t *pcb, int32_t pid, int32_t* status, int32_t options);
+static void sleep_expired(timer_t *t);
+static uint64_t timespec_to_tsc(const timespec_t *ts);
+static void tsc_to_timespec(uint64_t cycles, timespec_t *ts);
 int8_t get_pid();
 pcb_t* get_pcb(int32_t pid);
 
@@ -27,30 +34,58 @@ pcb_t* get_pcb(int32_t pid);
  * Initialize the process control block.
  * Inputs: pcb_t* pcb - where to initialize
  *         int32_t pid - process id
+ *         pcb_t* parent - process starting it, NULL for a terminal's shell
  *         uint8_t file_name[DENTRY_NAME_LEN] - name of executable, parsed from command
  *         uint8_t arg[ARG_BUFF_SIZE] - argument string, parsed from command
  * Outputs: none
- * Side effects: Initializes file_descriptors
+ * Side effects: Initializes file_descriptors. The new process shares every
+ *               open file of the parent at the same descriptor, except those
+ *               set close-on-exec, so a parent can redirect stdin and stdout
+ *               into a file or a pipe. stdin and stdout are opened on the
+ *               terminal if the parent has none.
  */
-void pcb_init(pcb_t* pcb, int32_t pid, uint8_t file_name[DENTRY_NAME_LEN], uint8_t arg[ARG_BUFF_SIZE]) {
+void pcb_init(pcb_t* pcb, int32_t pid, pcb_t* parent, uint8_t file_name[DENTRY_NAME_LEN], uint8_t arg[ARG_BUFF_SIZE]) {
 
     int i;
-
-    for (i = 0; i < MAX_FILE_DESCRIPTORS; i++) {
-        pcb->file_descriptors[i].flags.open = 0;
-        if(i == 0 || i == 1){   // initialize stdin and stdout, which both just map to terminal
-            pcb->file_descriptors[i].inode = i;
-            pcb->file_descriptors[i].pos = 0;
-            pcb->file_descriptors[i].flags.open = 1;
-            pcb->file_descriptors[i].ftable = &stdinout;
+    pcb_t* current_pcb = parent;
+    file_desc_t *file;
+
+    fd_table_init(pcb);
+    for (i = 0; current_pcb != NULL && i < MAX_FILE_DESCRIPTORS; i++) {
+        // Skip words of the bitmap with no descriptors in use
+        if (current_pcb->fd_bitmap[i / 32] == 0) {
+            i += 31;
+            continue;
         }
+        file = get_fd(current_pcb, i);
+        if (file == NULL || (current_pcb->fd_cloexec[i / 32] & (1U << (i % 32)))) continue;
+        if (reserve_fd(pcb, i) == 0) install_fd(pcb, i, file_get(file));
+    }
 
+    for (i = 0; i < 2; i++) {
+        if (get_fd(pcb, i) != NULL) continue;
+
+        // initialize stdin and stdout, which both just map to terminal
+        file = file_alloc();
+        if (file == NULL) continue;
+        file->inode = i;
+        file->flags.open = 1;
+        file->ftable = &stdinout;
+        reserve_fd(pcb, i);
+        install_fd(pcb, i, file);
     }
 
 
     pcb->pid = pid;
-    pcb_t* current_pcb = get_pcb(curr_pid);
     pcb->parent = current_pcb;
+    signal_init(pcb);
+    timer_setup(&pcb->sleep_timer, sleep_expired, pcb);
+    pcb->vidmap_active = 0;
+    pcb->shm_attached = 0;
+    pcb->shm_table = NULL;
+    pcb->mmap_table = NULL;
+    pcb->mmap_pages = NULL;
+    pcb->mmap_npages = 0;
 
     
     for(i = 0; i < DENTRY_NAME_LEN; i++){
@@ -107,99 +142,89 @@ int8_t get_pid(){
 }
 
 /** halt(uint8_t status)
- * Halts the currently running process and switches back to parent process, or
- * restarts shell if currently running process is first shell.
- * Inputs: uint8_t status -- exit code of program (truncated to 8 bits)
- * Outputs: none (this function doesn't really return)
- * Side Effects: Changes paging back to parent process
+ * Ends the current process. See kill_current_proc.
+ * Inputs: uint8_t status -- exit code of program
+ * Outputs: none (this function doesn't return)
+ * Side Effects: Switches to another process
 */
 int32_t halt (uint32_t status) {
     return kill_current_proc(status & 0xFF);
 }
 
-/** halt(uint8_t status)
- * Halts the currently running process and switches back to parent process, or
- * restarts shell if currently running process is first shell.
- * Inputs: uint8_t status -- exit code of program
- * Outputs: none (this function doesn't really return)
- * Side Effects: Changes paging back to parent process
+/** kill_current_proc(uint32_t status)
+ * Ends the current process and switches to another one. Its parent gets
+ * status from wait(); a process without a parent is freed at once. A
+ * terminal it left in raw mode goes back to cooked mode, and a
+ * terminal's shell is started again.
+ * Inputs: uint32_t status -- exit code of program, 256 if killed
+ * Outputs: none (this function doesn't return)
+ * Side Effects: Frees the process's files and memory
 */
 int32_t kill_current_proc (uint32_t status) {
-    int i;
-    exit_code = status;
     pcb_t* pcb = get_pcb(curr_pid);
-    pcb_t* parent_pcb = pcb->parent;
+    pcb_t* child;
+    int32_t i;
 
-    int32_t parent_pid;
-    if (parent_pcb == NULL) {
-        parent_pid = -1;
-    } else {
-        parent_pid = pcb->parent->pid;
+    cli();
+    close_all_fds(pcb);
+    terminal_release(pcb->terminal, curr_pid);
+
+    shm_unmap_all(pcb);
+    mmap_unmap_all(pcb);
+    signal_set_alarm(pcb, 0, 0);
+    timer_del(&pcb->sleep_timer);
+
+    // Children outlive us: finished ones are freed, the others on exit
+    for (i = 0; i < MAX_PROCESSES; i++) {
+        child = get_pcb(i);
+        if (child == NULL || child->parent != pcb) continue;
+        child->parent = NULL;
+        if (pidarray[i] == ZOMBIE) pidarray[i] = FREE;
     }
 
-    // close all file descriptors
-    for(i = 0; i < MAX_FILE_DESCRIPTORS; i++){
-        if(pcb->file_descriptors[i].flags.open == 1){
-            pcb->file_descriptors[i].ftable->close( &(pcb->file_descriptors[i]) );
-        }
-        pcb->file_descriptors[i].flags.open = 0;
+    // Start the replacement shell before our PID can be reused, since we
+    // are still running on its kernel stack
+    if (terminal_data[pcb->terminal].shell_pid == curr_pid) {
+        terminal_data[pcb->terminal].shell_pid =
+            create_process((uint8_t*)"shell", NULL, pcb->terminal, 0);
     }
 
-    if (curr_pid > -1)
+    pcb->exit_status = status;
+    if (pcb->parent == NULL) {
         pidarray[curr_pid] = FREE;
-
-    if(parent_pid == -1){
-        // re-execute shell
-        curr_pid = parent_pid;
-        execute((uint8_t*)"shell");
-
-        printf("returned from shell in halt()");
-    }else{
-        //set page to parent
-        curr_pid = pcb->parent->pid; 
-        set_process_paging(parent_pid);
-        
-        tss.esp0 = pcb->tss_esp0;
-        tss.ss0 = KERNEL_DS;
-
-
+    } else {
+        pidarray[curr_pid] = ZOMBIE;
+        // The parent may be waiting for us on another processor
+        sched_wake(pcb->parent->pid);
     }
 
-    uint32_t saved_esp = pcb->esp_save;
-    uint32_t saved_ebp = pcb->ebp_save;
-    
-    // set regs to parent and return
-    asm volatile (
-        "movl %0, %%esp         \n"
-        "movl %1, %%ebp         \n"
-        "movl %2, %%eax         \n"
-        "leave                  \n"
-        "ret                    \n"
-        :
-        : "r" (saved_esp), "r" (saved_ebp), "r" (exit_code)
-    );
-    
-    
-    return 0;
+    schedule_next();
 
+    printf("returned to a finished process in halt()");
+    return -1;
 }
 
-
-
-/** execute(const uint8_t* command)
- * Executes a user program as given by command.
- * Inputs: uint8_t* command -- Tells us what program to execute and what args to execute with, separated by spaces
- * Outputs: int32_t exit_code (after program is halted)
- * Side Effects: Changes paging to add new process
+/** create_process(const uint8_t* command, pcb_t* parent, int32_t terminal, int32_t background)
+ * Creates a process for a user program, on the processor with the fewest
+ * processes. It starts running the next time that processor's scheduler
+ * picks it.
+ * Inputs: command -- Program path and arguments, separated by spaces
+ *         parent -- Process that can wait for it, NULL if none
+ *         terminal -- Terminal it reads and writes
+ *         background -- 1 if Ctrl+C shouldn't stop it
+ * Return value: PID of the new process, or -1 if failed
+ * Side Effects: Allocates a PID
 */
-int32_t execute (const uint8_t* command) {
-    cli();
-    int32_t new_pid;
+int32_t create_process (const uint8_t* command, pcb_t* parent, int32_t terminal, int32_t background) {
+    int32_t new_pid, cpu;
     uint8_t elf_buffer[ELF_BYTES]; //first 40 bytes of ELF
+    uint32_t *stack;
+    uint32_t flags;
     
     //-----------parse command to get filename and arguments ------------
-    uint8_t file_name[DENTRY_NAME_LEN];
+    uint8_t file_name[FS_PATH_LEN + 1];
     uint8_t file_args[ARG_BUFF_SIZE];
+    uint8_t *prog_name;
     dentry_t dentry_temp;
     
     int32_t i, j = 0; //for loops
@@ -211,19 +236,25 @@ int32_t execute (const uint8_t* command) {
     while(*command == ' '){     // get rid of leading spaces
         command++;
     }
-    for (i = 0; i < DENTRY_NAME_LEN; i++){
+    for (i = 0; i < FS_PATH_LEN; i++){
         if(command[i] != ' ' && command[i] != '\0' && command[i] != '\n'){
             file_name[i] = command[i];
         }else{break;}       
-    }if(i < DENTRY_NAME_LEN){
-        file_name[i] = '\0';
     }
+    file_name[i] = '\0';
+
+    // the program's name is the last part of its path
+    prog_name = file_name;
+    for (j = 0; j < i; j++){
+        if(file_name[j] == '/') prog_name = &file_name[j + 1];
+    }
+    j = 0;
     
     while(command[i] == ' '){   // skip spaces in between
         i++;
     }
     //parse for arguments
-    while(command[i] != '\0' && command[i] != '\n' && j < ARG_BUFF_SIZE){
+    while(command[i] != '\0' && command[i] != '\n' && j < ARG_BUFF_SIZE - 1){
         file_args[j] = command[i];
         j++;
         i++;
@@ -237,7 +268,7 @@ int32_t execute (const uint8_t* command) {
         return -1;   //file not found
     }
 
-    if(read_data(dentry_temp.inode, 0, elf_buffer, ELF_BYTES) == -1){
+    if(read_data(dentry_temp.inode, 0, elf_buffer, ELF_BYTES) != ELF_BYTES){
         return -1; 
     }
 
@@ -249,53 +280,203 @@ int32_t execute (const uint8_t* command) {
     }
 
     //----------- initialize pcb-------------------
+    cli_and_save(flags);
+    cpu = sched_pick_cpu();
     new_pid = get_pid();
-    if(new_pid < 0 || new_pid > MAX_PROCESSES){
+    if(new_pid < 0){
+        restore_flags(flags);
         return -1;
     }
     pcb_t* pcb = get_pcb(new_pid);
-    if(pcb == NULL){
-        return -1;
+    pcb_init(pcb, new_pid, parent, prog_name, file_args);
+    pcb->cpu = cpu;
+    pcb->terminal = terminal;
+    pcb->background = background;
+    pcb->inode = dentry_temp.inode;
+    // bytes 24-27 contain entry point
+    pcb->entry_point = ((uint32_t)elf_buffer[27] << 24) | ((uint32_t)elf_buffer[26] << 16) | ((uint32_t)elf_buffer[25] << 8) | (uint32_t)elf_buffer[24];
+
+    // The scheduler switches to it with "leave; ret", which lands in
+    // process_entry at the top of its kernel stack
+    stack = (uint32_t*)kernel_stack_top(new_pid);
+    stack[0] = 0;                           // return address of process_entry
+    stack[-1] = (uint32_t)process_entry;
+    stack[-2] = 0;                          // saved ebp
+    pcb->esp_save = (uint32_t)&stack[-2];
+    pcb->ebp_save = (uint32_t)&stack[-2];
+    restore_flags(flags);
+
+    return new_pid;
+}
+
+/** kernel_stack_top(int32_t pid)
+ * Inputs: pid -- A process
+ * Return value: The top of the process's kernel stack, for the TSS
+ */
+uint32_t kernel_stack_top (int32_t pid) {
+    return EIGHT_MB - (EIGHT_KB * pid + 4);  // 4 to get value above bottom of stack
+}
+
+/** execute(const uint8_t* command)
+ * Executes a user program as given by command and waits for it to finish.
+ * Inputs: uint8_t* command -- Tells us what program to execute and what args to execute with, separated by spaces
+ * Outputs: int32_t exit_code (after program is halted), 256 if it was
+ *          killed, -1 if it couldn't be started
+ * Side Effects: Runs other processes while waiting
+*/
+int32_t execute (const uint8_t* command) {
+    pcb_t *pcb = get_pcb(curr_pid);
+    int32_t pid, status;
+
+    if (bad_userspace_addr(command, 1)) return -1;
+
+    pid = create_process(command, pcb, pcb->terminal, 0);
+    if (pid < 0) return -1;
+
+    if (wait_child(pcb, pid, &status, 0) < 0) return -1;
+    return status;
+}
+
+/** spawn
+ * Start a user program without waiting for it.
+ * Inputs: command -- Program path and arguments, separated by spaces
+ *         flags -- SPAWN_BACKGROUND to keep Ctrl+C from stopping it
+ * Return value: PID of the new process, or -1 if it couldn't be started
+ * Side effects: The new process gets a copy of the caller's descriptors
+ */
+int32_t spawn (const uint8_t* command, int32_t flags) {
+    pcb_t *pcb = get_pcb(curr_pid);
+
+    if (bad_userspace_addr(command, 1)) return -1;
+    return create_process(command, pcb, pcb->terminal, (flags & SPAWN_BACKGROUND) != 0);
+}
+
+/** wait
+ * Wait for any child to finish. Same as waitpid(-1, status, 0).
+ * Inputs: status -- Where to store the child's exit status, may be NULL
+ * Return value: PID of the finished child, or -1 if there are no children
+ * Side effects: Frees the child's PID
+ */
+int32_t wait (int32_t* status) {
+    return waitpid(-1, status, 0);
+}
+
+/** waitpid
+ * Wait for a child to finish.
+ * Inputs: pid -- The child, or -1 for any child
+ *         status -- Where to store the child's exit status, may be NULL. It
+ *                   is what the child passed to halt, 256 if it was killed
+ *                   and -1 if its program couldn't be loaded
+ *         options -- WNOHANG to return at once if no child has finished
+ * Return value: PID of the finished child, or -1 if pid isn't a child of
+ *               the caller or, with WNOHANG, hasn't finished
+ * Side effects: Frees the child's PID
+ */
+int32_t waitpid (int32_t pid, int32_t* status, int32_t options) {
+    int32_t child_status, ret;
+
+    if (status != NULL && bad_userspace_write(status, sizeof(int32_t))) return -1;
+
+    ret = wait_child(get_pcb(curr_pid), pid, &child_status, options);
+    if (ret >= 0 && status != NULL) *status = child_status;
+    return ret;
+}
+
+/** kill_foreground(int32_t terminal)
+ * Stops what's running in the foreground of a terminal, for Ctrl+C: every
+ * process on it that isn't in the background or waiting for a foreground
+ * child. Each is sent INTERRUPT.
+ * Inputs: terminal -- The terminal
+ * Return value: none
+ * Side effects: Runs in interrupt context
+ */
+void kill_foreground(int32_t terminal) {
+    pcb_t *pcb, *child;
+    int32_t i, j, leaf;
+
+    for (i = 0; i < MAX_PROCESSES; i++) {
+        pcb = get_pcb(i);
+        if (pcb == NULL || pidarray[i] != USED) continue;
+        if (pcb->terminal != terminal || pcb->background) continue;
+
+        leaf = 1;
+        for (j = 0; j < MAX_PROCESSES; j++) {
+            child = get_pcb(j);
+            if (child != NULL && pidarray[j] == USED && child->parent == pcb && !child->background) {
+                leaf = 0;
+            }
+        }
+        if (leaf) send_signal(pcb, INTERRUPT);
     }
-    pcb_init(pcb, new_pid, file_name, file_args);
-    curr_pid = new_pid;
+}
 
-    //-----------------------set up paging---------------------------
-    set_process_paging(curr_pid);
+/** static wait_child
+ * Waits for a child to finish and frees it.
+ * Inputs: pcb -- The parent
+ *         pid -- The child, or -1 for any child
+ *         options -- WNOHANG to return at once if no child has finished
+ * Outputs: status -- The child's exit status
+ * Return value: PID of the child, or -1 if pid isn't a child of pcb or,
+ *               with WNOHANG, none has finished
+ * Side effects: Halts the CPU between interrupts while waiting
+ */
+static int32_t wait_child(pcb_t *pcb, int32_t pid, int32_t* status, int32_t options) {
+    pcb_t *child;
+    int32_t i, found;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while (1) {
+        found = 0;
+        for (i = 0; i < MAX_PROCESSES; i++) {
+            if (pid != -1 && pid != i) continue;
+            child = get_pcb(i);
+            if (child == NULL || child->parent != pcb) continue;
+
+            found = 1;
+            if (pidarray[i] == ZOMBIE) {
+                *status = child->exit_status;
+                pidarray[i] = FREE;
+                restore_flags(flags);
+                return i;
+            }
+        }
+        if (!found) {
+            restore_flags(flags);
+            return -1;
+        }
+        if (options & WNOHANG) {
+            restore_flags(flags);
+            return -1;
+        }
 
+        // Other processes run until the child halts
+        sti();
+        asm volatile ("hlt");
+        cli();
+    }
+}
 
-    //load to page
+/** static process_entry
+ * Where a new process starts: loads its program and enters user mode.
+ * Inputs: none
+ * Return value: none (this function doesn't return)
+ * Side effects: Runs with the new process's paging and kernel stack
+ */
+static void process_entry(void) {
+    pcb_t *pcb = get_pcb(curr_pid);
     uint32_t *buffer = (uint32_t *)(MB_128 + SYS_OFFSET);
     uint32_t *user_level = (uint32_t *)(MB_128 + FOUR_MB - 4);  // 4 to get value above bottom of stack
-    int32_t test;
-    // bytes 24-27 contain entry point
-    uint32_t entry_point = ((int32_t)elf_buffer[27] << 24) | ((int32_t)elf_buffer[26] << 16) | ((int32_t)elf_buffer[25] << 8) | (int32_t)elf_buffer[24];
-    test = read_data(dentry_temp.inode, (uint32_t)0, (uint8_t *)buffer, FOUR_MB);
-    if(test == -1){
-        if (curr_pid > -1)
-            pidarray[curr_pid] = FREE;
-        return -1;
-    }
 
-    //-----------------------TSS --------------------
-    pcb->tss_esp0 = tss.esp0;
-    tss.esp0 = (uint32_t)(EIGHT_MB - (EIGHT_KB * curr_pid + 4));  // 4 to get value above bottom of stack
-    tss.ss0 = KERNEL_DS;
-
-    //-------------------- Save regs to PCB ------------------------
-    uint32_t esp, ebp;
-    asm volatile
-    (
-        "\t movl %%esp, %0 \n"
-        "\t movl %%ebp, %1 \n"
-        :"=rm"(esp), "=rm"(ebp) // output
-    );
-    pcb->ebp_save = ebp;
-    pcb->esp_save = esp;
-    
+    if (read_data(pcb->inode, (uint32_t)0, (uint8_t *)buffer, FOUR_MB) == -1) {
+        kill_current_proc(-1);
+    }
 
     //----------------------context switch--------------------------
 
+    // The program runs with interrupts on, so without the kernel lock
+    kernel_unlock();
+
     // USER_PROGRAM_ESP 0x083ffffc = 128MB + 4MB - 4
     //STI is for setting interrupt flag
  
@@ -312,11 +493,9 @@ int32_t execute (const uint8_t* command) {
         pushl   %4              \n\
         "
                 :
-                : "g"(USER_DS), "g"(user_level), "g"(STI_), "g"(USER_CS), "g"((uint32_t*)entry_point)
+                : "g"(USER_DS), "g"(user_level), "g"(STI_), "g"(USER_CS), "g"((uint32_t*)pcb->entry_point)
                 : "eax", "memory");
     asm volatile("iret");
-
-    return exit_code;
 }
 
 
@@ -330,12 +509,12 @@ int32_t execute (const uint8_t* command) {
  * Side effects: Reads from the file descriptor
  */
 int32_t read (int32_t fd, void* buf, int32_t nbytes) {
-    if(fd < 0 || fd >= MAX_FILE_DESCRIPTORS){
+    file_desc_t *desc = get_fd(get_pcb(curr_pid), fd);
+
+    if (bad_userspace_write(buf, nbytes)) {
         return -1;
     }
-    file_desc_t *desc = &(get_pcb(curr_pid)->file_descriptors[fd]);
-
-    if (desc->flags.open) {
+    if (desc != NULL) {
         return desc->ftable->read(
             desc, buf, nbytes
         );
@@ -353,12 +532,12 @@ int32_t read (int32_t fd, void* buf, int32_t nbytes) {
  * Side effects: Writes to the file descriptor
  */
 int32_t write (int32_t fd, const void* buf, int32_t nbytes) {
-    if(fd < 0 || fd >= MAX_FILE_DESCRIPTORS){
+    file_desc_t *desc = get_fd(get_pcb(curr_pid), fd);
+
+    if (bad_userspace_addr(buf, nbytes)) {
         return -1;
     }
-    file_desc_t *desc = &(get_pcb(curr_pid)->file_descriptors[fd]);
-
-    if (desc->flags.open) {
+    if (desc != NULL) {
         return desc->ftable->write(
             desc, buf, nbytes
         );
@@ -383,43 +562,59 @@ int32_t open (const uint8_t* filename) {
 
     int32_t fd = alloc_fd(curr_pcb);
     if(fd < 0) return -1;
+    file_desc_t *file = file_alloc();
+    if (file == NULL) {
+        free_fd(curr_pcb, fd);
+        return -1;
+    }
 
     switch (de.type) {
         case FILE_REGULAR:
-            curr_pcb->file_descriptors[fd].ftable = &file_regular_ftable;
+            file->ftable = &file_regular_ftable;
             break;
         case FILE_DIRECTORY:
-            curr_pcb->file_descriptors[fd].ftable = &file_dir_ftable;
+            file->ftable = &file_dir_ftable;
             break;
         case FILE_RTC:
-            curr_pcb->file_descriptors[fd].ftable = &rtc_ftable;
+            file->ftable = &rtc_ftable;
             break;
         default:
-            return -1;
+            err = -1;
+            break;
     }
 
-    err = curr_pcb->file_descriptors[fd].ftable->open(&(curr_pcb->file_descriptors[fd]), filename);
-    curr_pcb->file_descriptors[fd].flags.open = 1;
-    if (err) return err;
+    if (file->ftable != NULL) {
+        err = file->ftable->open(file, filename);
+    }
+    if (err) {
+        // Not open, so putting it back doesn't call close
+        file_put(file);
+        free_fd(curr_pcb, fd);
+        return -1;
+    }
+    file->flags.open = 1;
 
+    install_fd(curr_pcb, fd, file);
     return fd;
 }
 
 /** close()
  * Close a file descriptor.
  * Inputs: fd -- Index of file descriptor
- * Return valueL 0 on success, -1 if already closed
+ * Return valueL 0 on success, -1 if already closed or stdin/stdout
  * Side effects: Initializes file_descriptors
  */
 int32_t close (int32_t fd) {
-    if(fd < 0 || fd >= MAX_FILE_DESCRIPTORS){
+    // stdin and stdout stay open for the life of the process
+    if(fd < 2){
         return -1;
     }
-    file_desc_t *desc = &(get_pcb(curr_pid)->file_descriptors[fd]);
+    pcb_t *pcb = get_pcb(curr_pid);
+    file_desc_t *desc = get_fd(pcb, fd);
 
-    if (desc->flags.open) {
-        int32_t rvalue = desc->ftable->close(desc);
-        return rvalue;
+    if (desc != NULL) {
+        free_fd(pcb, fd);
+        return file_put(desc);
     } else {
         return -1;
     }
@@ -487,25 +682,670 @@ int32_t vidmap (uint8_t** screen_start) {
 
 
 
-/** Unimplemented. */
-int32_t set_handler (int32_t signum, void* handler_address) {SYSCALL_UNIMPLEMENTED(set_handler)}
-/** Unimplemented. */
-int32_t sigreturn (void) {SYSCALL_UNIMPLEMENTED(sigreturn);}
+/** ioctl
+ * Change how a file descriptor behaves.
+ * Inputs: fd -- The file descriptor
+ *         request -- IOCTL_SET_NONBLOCK, IOCTL_SET_CLOEXEC, or a request
+ *                    specific to the file type
+ *         arg -- Argument for the request
+ * Return value: 0 on success, -1 if failed
+ * Side effects: Depends on request
+ */
+int32_t ioctl (int32_t fd, int32_t request, int32_t arg) {
+    file_desc_t *desc = get_fd(get_pcb(curr_pid), fd);
 
-/** alloc_fd()
- * Get an unused file descriptor.
+    if (desc == NULL) {
+        return -1;
+    }
+
+    if (request == IOCTL_SET_NONBLOCK) {
+        desc->flags.nonblock = (arg != 0);
+        return 0;
+    }
+    if (request == IOCTL_SET_CLOEXEC) {
+        // Belongs to the descriptor, not the open file it shares
+        pcb_t *pcb = get_pcb(curr_pid);
+        if (arg) {
+            pcb->fd_cloexec[fd / 32] |= 1U << (fd % 32);
+        } else {
+            pcb->fd_cloexec[fd / 32] &= ~(1U << (fd % 32));
+        }
+        return 0;
+    }
+
+    if (desc->ftable->ioctl == NULL) {
+        return -1;
+    }
+    return desc->ftable->ioctl(desc, request, arg);
+}
+
+/** poll
+ * Wait until at least one of several file descriptors is ready.
+ * Inputs: fds -- Array of pollfd_t, each with an fd and the events wanted.
+ *                Entries with a negative fd are skipped
+ *         nfds -- Number of entries in fds
+ *         timeout -- Milliseconds to wait, 0 to return at once, negative to wait forever
+ * Outputs: fds[i].revents -- Events ready on fds[i].fd, POLLNVAL if it
+ *                            isn't open
+ * Return value: Number of entries with events ready or POLLNVAL (0 on
+ *               timeout, or if a signal arrives that has to be acted on),
+ *               or -1 if failed
+ * Side effects: Halts the CPU between interrupts while waiting
+ */
+int32_t poll (pollfd_t* fds, int32_t nfds, int32_t timeout) {
+    pcb_t *pcb = get_pcb(curr_pid);
+    int32_t i, ready;
+    uint32_t deadline;
+
+    if (nfds < 0 || nfds > POLL_MAX_FDS) {
+        return -1;
+    }
+    if (bad_userspace_write(fds, nfds * sizeof(pollfd_t))) {
+        return -1;
+    }
+
+    // Round up to whole ticks; longer timeouts are cut first so this can't overflow
+    if (timeout > POLL_MAX_TIMEOUT) timeout = POLL_MAX_TIMEOUT;
+    deadline = pit_ticks + (timeout + MS_PER_TICK - 1) / MS_PER_TICK;
+
+    sti();
+    while (1) {
+        ready = 0;
+        for (i = 0; i < nfds; i++) {
+            file_desc_t *desc = (fds[i].fd < 0) ? NULL : get_fd(pcb, fds[i].fd);
+            int32_t events;
+
+            if (desc == NULL) {
+                fds[i].revents = (fds[i].fd < 0) ? 0 : POLLNVAL;
+            } else {
+                events = (desc->ftable->poll == NULL) ? (POLLIN | POLLOUT) : desc->ftable->poll(desc);
+                fds[i].revents = events & fds[i].events;
+            }
+            if (fds[i].revents) ready++;
+        }
+
+        if (ready > 0 || timeout == 0) break;
+        if (timeout > 0 && (int32_t)(pit_ticks - deadline) >= 0) break;
+        if (signal_pending(pcb)) break;
+
+        // Nothing to do until the next keyboard, RTC or PIT interrupt
+        asm volatile ("hlt");
+    }
+
+    return ready;
+}
+
+/** pipe
+ * Create a pipe and open both of its ends.
+ * Inputs: fds -- Array of two ints in user space
+ * Outputs: fds[0] -- Descriptor for the read end
+ *          fds[1] -- Descriptor for the write end
+ * Return value: 0 on success, -1 if failed
+ * Side effects: Allocates a pipe and two file descriptors
+ */
+int32_t pipe (int32_t* fds) {
+    pcb_t *pcb = get_pcb(curr_pid);
+    int32_t read_fd, write_fd;
+    file_desc_t *read_end, *write_end;
+
+    if (bad_userspace_write(fds, 2 * sizeof(int32_t))) {
+        return -1;
+    }
+
+    read_fd = alloc_fd(pcb);
+    if (read_fd < 0) return -1;
+
+    write_fd = alloc_fd(pcb);
+    if (write_fd < 0) {
+        free_fd(pcb, read_fd);
+        return -1;
+    }
+
+    read_end = file_alloc();
+    write_end = file_alloc();
+    if (read_end == NULL || write_end == NULL || pipe_alloc(read_end, write_end)) {
+        if (read_end != NULL) file_put(read_end);
+        if (write_end != NULL) file_put(write_end);
+        free_fd(pcb, read_fd);
+        free_fd(pcb, write_fd);
+        return -1;
+    }
+    install_fd(pcb, read_fd, read_end);
+    install_fd(pcb, write_fd, write_end);
+
+    fds[0] = read_fd;
+    fds[1] = write_fd;
+    return 0;
+}
+
+/** dup
+ * Make a second file descriptor for the file open on fd. Both share the
+ * file's position and flags.
+ * Inputs: fd -- The file descriptor to copy
+ * Return value: The new file descriptor, or -1 if failed
+ * Side effects: Allocates a file descriptor
+ */
+int32_t dup (int32_t fd) {
+    pcb_t *pcb = get_pcb(curr_pid);
+    file_desc_t *desc = get_fd(pcb, fd);
+    int32_t new_fd;
+
+    if(desc == NULL){
+        return -1;
+    }
+
+    new_fd = alloc_fd(pcb);
+    if (new_fd < 0) return -1;
+
+    install_fd(pcb, new_fd, file_get(desc));
+    return new_fd;
+}
+
+/** dup2
+ * Make new_fd refer to the same file as old_fd, closing new_fd first if it
+ * is open. Unlike close(), this can replace stdin and stdout.
+ * Inputs: old_fd -- The file descriptor to copy
+ *         new_fd -- The file descriptor to replace
+ * Return value: new_fd, or -1 if failed
+ * Side effects: May close new_fd
+ */
+int32_t dup2 (int32_t old_fd, int32_t new_fd) {
+    pcb_t *pcb = get_pcb(curr_pid);
+    file_desc_t *old_desc = get_fd(pcb, old_fd);
+    file_desc_t *desc;
+
+    if(old_desc == NULL){
+        return -1;
+    }
+    if(new_fd < 0 || new_fd >= MAX_FILE_DESCRIPTORS){
+        return -1;
+    }
+    if (old_fd == new_fd) return new_fd;
+
+    desc = get_fd(pcb, new_fd);
+    if (desc == NULL && reserve_fd(pcb, new_fd)) return -1;
+    pcb->fd_cloexec[new_fd / 32] &= ~(1U << (new_fd % 32));
+
+    install_fd(pcb, new_fd, file_get(old_desc));
+    if (desc != NULL) file_put(desc);
+    return new_fd;
+}
+
+/** shmmap
+ * Map a named shared memory segment, creating it if it doesn't exist. Every
+ * process that maps the same name sees the same memory at the same address.
+ * Inputs: name -- Null-terminated segment name, shorter than SHM_NAME_LEN
+ *         size -- Size in bytes, used only when creating the segment
+ *         addr -- Where to store the address of the segment
+ * Return value: Segment id, or -1 if failed
+ * Side effects: Changes the process's paging
+ */
+int32_t shmmap (const uint8_t* name, uint32_t size, uint8_t** addr) {
+    uint8_t kname[SHM_NAME_LEN];
+    int32_t i;
+
+    if (bad_userspace_write(addr, sizeof(uint8_t*))) {
+        return -1;
+    }
+    // Copy the name a byte at a time, so it can't run off the end of user memory
+    for (i = 0; i < SHM_NAME_LEN; i++) {
+        if (bad_userspace_addr(name + i, 1)) return -1;
+        kname[i] = name[i];
+        if (kname[i] == '\0') break;
+    }
+    if (i == SHM_NAME_LEN) return -1;
+
+    return shm_map(get_pcb(curr_pid), kname, size, addr);
+}
+
+/** shmunmap
+ * Unmap a shared memory segment. It is freed once no process has it mapped.
+ * Inputs: addr -- Address returned by shmmap
+ * Return value: 0 on success, -1 if failed
+ * Side effects: Changes the process's paging
+ */
+int32_t shmunmap (uint8_t* addr) {
+    return shm_unmap(get_pcb(curr_pid), addr);
+}
+
+/** mmap
+ * Map a file read-only into memory, starting at its first byte.
+ * Inputs: fd -- Descriptor of an open file
+ *         length -- Number of bytes to map; 0 or more than the file size maps the whole file
+ *         addr -- Where to store the address of the mapping
+ * Return value: Number of bytes mapped, or -1 if failed (including files
+ *               created at run time and mappings over MMAP_PROC_PAGES pages)
+ * Side effects: Changes the process's paging
+ */
+int32_t mmap (int32_t fd, uint32_t length, uint8_t** addr) {
+    pcb_t *pcb = get_pcb(curr_pid);
+    file_desc_t *desc;
+    int32_t size;
+
+    if (bad_userspace_write(addr, sizeof(uint8_t*))) {
+        return -1;
+    }
+    desc = get_fd(pcb, fd);
+    if (desc == NULL || desc->ftable != &file_regular_ftable) return -1;
+
+    size = fs_file_size(desc->inode);
+    if (size <= 0) return -1;
+    if (length == 0 || length > size) length = size;
+
+    if (mmap_map(pcb, desc->inode, length, addr)) return -1;
+    return length;
+}
+
+/** munmap
+ * Remove a mapping made by mmap.
+ * Inputs: addr -- Address returned by mmap
+ * Return value: 0 on success, -1 if failed
+ * Side effects: Changes the process's paging
+ */
+int32_t munmap (uint8_t* addr) {
+    return mmap_unmap(get_pcb(curr_pid), addr);
+}
+
+/** unlink
+ * Remove a file or empty directory created at run time. Files in the boot
+ * image can't be removed.
+ * Inputs: filename -- Null-terminated path
+ * Return value: 0 on success, -1 if failed
+ * Side effects: Frees the file's storage
+ */
+int32_t unlink (const uint8_t* filename) {
+    if (bad_userspace_addr(filename, 1)) return -1;
+    return fs_unlink(filename);
+}
+
+/** mkdir
+ * Create an empty directory.
+ * Inputs: dirname -- Null-terminated path of the new directory
+ * Return value: 0 on success, -1 if failed
+ * Side effects: Allocates an inode in the writable layer
+ */
+int32_t mkdir (const uint8_t* dirname) {
+    if (bad_userspace_addr(dirname, 1)) return -1;
+    return (fs_mkdir(dirname) < 0) ? -1 : 0;
+}
+
+/** getdents
+ * Read as many entries of an open directory as fit in buf, so a directory
+ * can be listed in one call.
+ * Inputs: fd -- Directory file descriptor
+ *         buf -- Buffer for the entries
+ *         nbytes -- Size of buf
+ * Return value: Number of bytes filled, 0 after the last entry, -1 if failed
+ * Side effects: Advances the descriptor's position
+ */
+int32_t getdents (int32_t fd, dirent_t* buf, int32_t nbytes) {
+    file_desc_t *desc;
+
+    if (nbytes < 0 || bad_userspace_write(buf, nbytes)) {
+        return -1;
+    }
+    desc = get_fd(get_pcb(curr_pid), fd);
+    if (desc == NULL || desc->ftable != &file_dir_ftable) return -1;
+
+    return dir_getdents(desc, buf, nbytes);
+}
+
+/** stat
+ * Get a file's type, inode, size and block count by path.
+ * Inputs: filename -- Null-terminated path
+ *         buf -- Where to store the metadata
+ * Return value: 0 on success, -1 if failed
+ * Side effects: none
+ */
+int32_t stat (const uint8_t* filename, stat_t* buf) {
+    dentry_t de;
+
+    if (bad_userspace_addr(filename, 1) || bad_userspace_write(buf, sizeof(stat_t))) return -1;
+    if (read_dentry_by_name(filename, &de)) return -1;
+
+    return fs_stat(de.inode, de.type, buf);
+}
+
+/** fstat
+ * Get the metadata of the file open on a descriptor. Only descriptors
+ * opened by name (files, directories and the RTC) have any.
+ * Inputs: fd -- File descriptor
+ *         buf -- Where to store the metadata
+ * Return value: 0 on success, -1 if failed
+ * Side effects: none
+ */
+int32_t fstat (int32_t fd, stat_t* buf) {
+    file_desc_t *desc;
+    uint32_t type;
+
+    if (bad_userspace_write(buf, sizeof(stat_t))) return -1;
+    desc = get_fd(get_pcb(curr_pid), fd);
+    if (desc == NULL) return -1;
+
+    if (desc->ftable == &file_regular_ftable) {
+        type = FILE_REGULAR;
+    } else if (desc->ftable == &file_dir_ftable) {
+        type = FILE_DIRECTORY;
+    } else if (desc->ftable == &rtc_ftable) {
+        type = FILE_RTC;
+    } else {
+        return -1;
+    }
+
+    return fs_stat(desc->inode, type, buf);
+}
+
+/** lseek
+ * Move the position of an open file or directory.
+ * Inputs: fd -- File descriptor
+ *         offset -- New position, relative to whence
+ *         whence -- SEEK_SET, SEEK_CUR or SEEK_END
+ * Return value: The new position, or -1 if failed
+ * Side effects: Changes the descriptor's position
+ */
+int32_t lseek (int32_t fd, int32_t offset, int32_t whence) {
+    file_desc_t *desc;
+
+    desc = get_fd(get_pcb(curr_pid), fd);
+    if (desc == NULL) return -1;
+    if (desc->ftable != &file_regular_ftable && desc->ftable != &file_dir_ftable) return -1;
+
+    return fs_lseek(desc, offset, whence);
+}
+
+/** pread
+ * Read from an open file at an offset, leaving its position alone.
+ * Inputs: fd -- File descriptor
+ *         buf -- Buffer to copy to
+ *         nbytes -- Number of bytes to copy
+ *         offset -- Byte offset to read from
+ * Return value: Number of bytes read, 0 at end of file, or -1 if failed
+ * Side effects: none
+ */
+int32_t pread (int32_t fd, void* buf, int32_t nbytes, int32_t offset) {
+    file_desc_t *desc;
+
+    if (nbytes < 0 || bad_userspace_write(buf, nbytes)) {
+        return -1;
+    }
+    desc = get_fd(get_pcb(curr_pid), fd);
+    if (desc == NULL || desc->ftable != &file_regular_ftable) return -1;
+
+    return file_pread(desc, buf, nbytes, offset);
+}
+
+/** set_handler
+ * Set the user function called when a signal arrives.
+ * Inputs: signum -- The signal
+ *         handler_address -- Function taking the signal number, or NULL
+ *                            for the default action
+ * Return value: 0 on success, -1 if failed
+ * Side effects: none
+ */
+int32_t set_handler (int32_t signum, void* handler_address) {
+    return signal_set_handler(get_pcb(curr_pid), signum, handler_address);
+}
+
+/** sigreturn
+ * Return from a signal handler to where the process was interrupted. Called
+ * by the code a handler returns into.
  * Inputs: none
- * Return value: File descriptor index, or -1 if none available
- * Side effects: None (Does not mark it as open)
+ * Return value: The process's eax from before the handler ran
+ * Side effects: Restores the registers saved on the user stack
+ */
+int32_t sigreturn (void) {
+    return signal_return(get_pcb(curr_pid));
+}
+
+/** alarm
+ * Send the caller ALARM once after a number of PIT ticks.
+ * Inputs: ticks -- Ticks to wait, 0 to cancel the alarm
+ * Return value: Ticks that were left on the alarm or interval timer it
+ *               replaces, 0 if none
+ * Side effects: none
+ */
+int32_t alarm (uint32_t ticks) {
+    return signal_set_alarm(get_pcb(curr_pid), ticks, 0);
+}
+
+/** setitimer
+ * Send the caller ALARM after a number of PIT ticks and then periodically.
+ * Inputs: ticks -- Ticks until the first ALARM, 0 to cancel the timer
+ *         interval -- Ticks between the ones after it, 0 for just one
+ * Return value: Ticks that were left on the timer it replaces, 0 if none
+ * Side effects: none
+ */
+int32_t setitimer (uint32_t ticks, uint32_t interval) {
+    return signal_set_alarm(get_pcb(curr_pid), ticks, interval);
+}
+
+/** nanosleep
+ * Wait for a length of time, measured with the TSC. The process sleeps
+ * on a kernel timer for the whole PIT ticks and spins for the rest, so it
+ * wakes up on time unless other processes are running.
+ * Inputs: req -- Time to wait
+ * Outputs: rem -- Time that was left if a signal ended the wait, may be NULL
+ * Return value: 0 once the time is up, -1 if a signal has to be acted on
+ *               first or an argument is invalid
+ * Side effects: Runs other processes while waiting
  */
-static int32_t alloc_fd(pcb_t *pcb) {
+int32_t nanosleep (const timespec_t* req, timespec_t* rem) {
+    pcb_t *pcb = get_pcb(curr_pid);
+    uint64_t deadline, left, ticks;
+    uint32_t flags;
+
+    if (bad_userspace_addr(req, sizeof(timespec_t)) || req->nsec >= NS_PER_SEC) return -1;
+    if (rem != NULL && bad_userspace_write(rem, sizeof(timespec_t))) return -1;
+
+    deadline = rdtsc() + timespec_to_tsc(req);
+
+    cli_and_save(flags);
+    while ((int64_t)(left = deadline - rdtsc()) > 0) {
+        if (signal_pending(pcb)) {
+            if (rem != NULL) tsc_to_timespec(left, rem);
+            restore_flags(flags);
+            return -1;
+        }
+
+        // Less than a tick left: spin with interrupts on
+        ticks = div64(left, tsc_per_tick);
+        if (ticks == 0) {
+            sti();
+            while ((int64_t)(deadline - rdtsc()) > 0 && !signal_pending(pcb));
+            cli();
+            continue;
+        }
+
+        // The timer fires after at most ticks whole ticks
+        timer_add(&pcb->sleep_timer, pit_ticks + (ticks > 0x7FFFFFFF ? 0x7FFFFFFF : (uint32_t)ticks));
+        while (pcb->sleep_timer.pending && !signal_pending(pcb)) {
+            sti();
+            asm volatile ("hlt");
+            cli();
+        }
+        timer_del(&pcb->sleep_timer);
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/** static sleep_expired
+ * Timer callback for nanosleep, which sees the timer has stopped.
+ * Inputs: t -- The process's sleep_timer
+ * Return value: none
+ * Side effects: none
+ */
+static void sleep_expired(timer_t *t) {
+}
+
+/** static timespec_to_tsc
+ * Inputs: ts -- A length of time
+ * Return value: TSC cycles in it
+ */
+static uint64_t timespec_to_tsc(const timespec_t *ts) {
+    return (uint64_t)ts->sec * tsc_khz * 1000 + div64((uint64_t)ts->nsec * tsc_khz, 1000000);
+}
+
+/** static tsc_to_timespec
+ * Inputs: cycles -- A number of TSC cycles
+ * Outputs: ts -- The time they take
+ * Return value: none
+ */
+static void tsc_to_timespec(uint64_t cycles, timespec_t *ts) {
+    uint64_t ms = div64(cycles, tsc_khz);
+    uint32_t rest = (uint32_t)(cycles - ms * tsc_khz);     // below one ms
+
+    ts->sec = (uint32_t)div64(ms, 1000);
+    ts->nsec = (uint32_t)(ms - (uint64_t)ts->sec * 1000) * 1000000 +
+               (uint32_t)div64((uint64_t)rest * 1000000, tsc_khz);
+}
+
+/** fd_table_init()
+ * Empty a process's file descriptor table.
+ * Inputs: pcb -- The process
+ * Return value: none
+ * Side effects: none
+ */
+void fd_table_init(pcb_t *pcb) {
     int i;
-    for (i = 0; i < MAX_FILE_DESCRIPTORS; i++) {
-        if (pcb->file_descriptors[i].flags.open == 0) {
-            return i;
-        };
+
+    memset(pcb->fd_bitmap, 0, sizeof(pcb->fd_bitmap));
+    memset(pcb->fd_cloexec, 0, sizeof(pcb->fd_cloexec));
+    for (i = 0; i < FD_INLINE; i++) {
+        pcb->fd_inline[i] = NULL;
     }
-    // None found
-    return -1;
+    for (i = 0; i < FD_TABLE_PAGES; i++) {
+        pcb->fd_pages[i] = NULL;
+    }
+}
+
+/** fd_table_free()
+ * Release the pages holding a process's file descriptors. The descriptors
+ * must already be closed.
+ * Inputs: pcb -- The process
+ * Return value: none
+ * Side effects: Empties the table
+ */
+void fd_table_free(pcb_t *pcb) {
+    int i;
+
+    for (i = 0; i < FD_TABLE_PAGES; i++) {
+        if (pcb->fd_pages[i] != NULL) free_page(pcb->fd_pages[i]);
+    }
+    fd_table_init(pcb);
+}
+
+/** alloc_fd()
+ * Get the lowest unused file descriptor, allocating a page of the table if
+ * it's the first descriptor used in that page.
+ * Inputs: pcb -- The process
+ * Return value: File descriptor index, or -1 if none available
+ * Side effects: Reserves the descriptor; install_fd gives it a file
+ */
+int32_t alloc_fd(pcb_t *pcb) {
+    int32_t fd = find_first_zero(pcb->fd_bitmap, MAX_FILE_DESCRIPTORS);
+
+    if (fd < 0 || reserve_fd(pcb, fd)) return -1;
+    return fd;
+}
+
+/** free_fd()
+ * Return a descriptor from alloc_fd to the table. Its reference to the open
+ * file, if it has one, is the caller's to drop.
+ * Inputs: pcb -- The process
+ *         fd -- The descriptor
+ * Return value: none
+ * Side effects: none
+ */
+void free_fd(pcb_t *pcb, int32_t fd) {
+    pcb->fd_bitmap[fd / 32] &= ~(1U << (fd % 32));
+    pcb->fd_cloexec[fd / 32] &= ~(1U << (fd % 32));
+    *fd_slot(pcb, fd) = NULL;
+}
+
+/** install_fd()
+ * Point a descriptor reserved by alloc_fd at an open file.
+ * Inputs: pcb -- The process
+ *         fd -- The descriptor
+ *         file -- Open file; the descriptor takes over the caller's reference
+ * Return value: none
+ * Side effects: none
+ */
+void install_fd(pcb_t *pcb, int32_t fd, file_desc_t *file) {
+    *fd_slot(pcb, fd) = file;
+}
+
+/** get_fd()
+ * Look up the file open on a descriptor.
+ * Inputs: pcb -- The process
+ *         fd -- Descriptor index from user space
+ * Return value: The open file, or NULL if fd is out of range or not open
+ * Side effects: none
+ */
+file_desc_t* get_fd(pcb_t *pcb, int32_t fd) {
+    if (fd < 0 || fd >= MAX_FILE_DESCRIPTORS) return NULL;
+    if (!(pcb->fd_bitmap[fd / 32] & (1U << (fd % 32)))) return NULL;
+
+    return *fd_slot(pcb, fd);
+}
+
+/** static fd_slot
+ * Inputs: pcb -- The process
+ *         fd -- Descriptor index, 0 <= fd < MAX_FILE_DESCRIPTORS
+ * Return value: Where descriptor fd is stored, allocating its page if
+ *               needed; NULL if out of memory
+ */
+static file_desc_t** fd_slot(pcb_t *pcb, int32_t fd) {
+    file_desc_t **page;
+
+    if (fd < FD_INLINE) return &pcb->fd_inline[fd];
+
+    fd -= FD_INLINE;
+    page = pcb->fd_pages[fd / FDS_PER_PAGE];
+    if (page == NULL) {
+        page = alloc_page();
+        if (page == NULL) return NULL;
+        memset(page, 0, FOUR_KB);
+        pcb->fd_pages[fd / FDS_PER_PAGE] = page;
+    }
+    return &page[fd % FDS_PER_PAGE];
+}
+
+/** static reserve_fd
+ * Marks a free descriptor in use, growing the table if its page isn't
+ * there yet.
+ * Inputs: pcb -- The process
+ *         fd -- Descriptor index, 0 <= fd < MAX_FILE_DESCRIPTORS
+ * Return value: 0 on success, -1 if out of memory
+ */
+static int32_t reserve_fd(pcb_t *pcb, int32_t fd) {
+    if (fd_slot(pcb, fd) == NULL) return -1;
+
+    pcb->fd_bitmap[fd / 32] |= 1U << (fd % 32);
+    pcb->fd_cloexec[fd / 32] &= ~(1U << (fd % 32));
+    *fd_slot(pcb, fd) = NULL;
+    return 0;
+}
+
+/** static close_all_fds
+ * Drops every descriptor of a process and frees its table.
+ * Inputs: pcb -- The process
+ * Return value: none
+ * Side effects: Closes files no other descriptor refers to
+ */
+static void close_all_fds(pcb_t *pcb) {
+    int32_t fd;
+    file_desc_t *file;
+
+    for (fd = 0; fd < MAX_FILE_DESCRIPTORS; fd++) {
+        // Skip words of the bitmap with no descriptors in use
+        if (pcb->fd_bitmap[fd / 32] == 0) {
+            fd += 31;
+            continue;
+        }
+        file = get_fd(pcb, fd);
+        if (file != NULL) file_put(file);
+    }
+    fd_table_free(pcb);
 }
 
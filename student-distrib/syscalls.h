@@ -4,9 +4,12 @@
 #include "lib.h"
 #include "filedescriptor.h"
 #include "fs.h"
+#include "paging.h"
+#include "timer.h"
+#include "smp.h"
 
-#define MAX_FILE_DESCRIPTORS 8
-#define SYSCALL_COUNT 10
+#define MAX_FILE_DESCRIPTORS 512
+#define SYSCALL_COUNT 32
 #define ARG_BUFF_SIZE 128
 #define ELF_BYTES 40
 #define ELF_HEADER_BYTES 4
@@ -14,7 +17,7 @@
 #define ELF1         0x45
 #define ELF2          0x4C
 #define ELF3        0x46
-#define MAX_PROCESSES 6
+#define MAX_PROCESSES 12
 #define PHYSICAL_START 2
 #define EIGHT_KB      0x002000
 #define FOUR_KB      0x001000
@@ -33,38 +36,105 @@
 
 #define USED    1
 #define FREE    0
+#define ZOMBIE  2       // halted, waiting for its parent to collect the status
+
+#define SPAWN_BACKGROUND    1   // spawn(): Ctrl+C doesn't stop the process
+#define WNOHANG             1   // waitpid(): don't wait if no child has finished
+
+/* Signal numbers, as user programs see them */
+#define DIV_ZERO    0
+#define SEGFAULT    1
+#define INTERRUPT   2
+#define ALARM       3
+#define USER1       4
+#define NUM_SIGNALS 5
+
 #define USER_ENTRY_ADDRESS  0x08048018
 
 #define ENTRY_POINT_INDEX 24
 
+#define POLL_MAX_FDS  MAX_FILE_DESCRIPTORS
+#define POLL_MAX_TIMEOUT  (0x7FFFFFFF - MS_PER_TICK)  // ms, so rounding up to ticks can't overflow
+#define NS_PER_SEC    1000000000
+
+/* The first FD_INLINE descriptors live in the PCB. The rest are kept in
+ * pages allocated the first time a descriptor in them is needed. */
+#define FD_INLINE       8
+#define FDS_PER_PAGE    (FOUR_KB / sizeof(file_desc_t*))
+#define FD_TABLE_PAGES  ((MAX_FILE_DESCRIPTORS - FD_INLINE + FDS_PER_PAGE - 1) / FDS_PER_PAGE)
+
+/* One entry of the array passed to poll() */
+typedef struct pollfd {
+    int32_t fd;
+    int16_t events;     // POLLIN/POLLOUT bits the caller is waiting for
+    int16_t revents;    // bits that are ready, or POLLNVAL, filled in by poll()
+} pollfd_t;
+
 
 
+/* A length of time, for nanosleep() */
+typedef struct timespec {
+    uint32_t sec;
+    uint32_t nsec;      // below NS_PER_SEC
+} timespec_t;
+
 typedef struct pcb{
     // process info
-    file_desc_t file_descriptors[MAX_FILE_DESCRIPTORS];
-    struct pcb* parent;
+    // File descriptors: bit i of fd_bitmap is set while descriptor i is in
+    // use, and its slot points to the open file once there is one
+    uint32_t fd_bitmap[MAX_FILE_DESCRIPTORS / 32];
+    uint32_t fd_cloexec[MAX_FILE_DESCRIPTORS / 32];    // not passed on by execute
+    file_desc_t* fd_inline[FD_INLINE];
+    file_desc_t** fd_pages[FD_TABLE_PAGES];
+    struct pcb* parent;     // NULL if no process waits for this one
     int32_t pid;
-    // int32_t state;   // maybe need for scheduling later
-
-    // registers saved before running process, restored if process halted
+    int32_t terminal;       // terminal the process reads and writes
+    int32_t background;     // 1 if Ctrl+C doesn't stop it
+    int32_t cpu;            // processor it runs on
+    uint32_t exit_status;   // for wait(), once the process is a ZOMBIE
+
+    // Signals: bit i is set while signal i is waiting or held back
+    uint32_t sig_pending;
+    uint32_t sig_blocked;
+    void* sig_handler[NUM_SIGNALS];     // NULL for the default action
+    timer_t alarm_timer;                // sends ALARM
+    uint32_t alarm_interval;            // ticks between ALARMs, 0 for one
+    timer_t sleep_timer;                // wakes it from nanosleep()
+
+    // Program to load when the process first runs
+    uint32_t inode;
+    uint32_t entry_point;
+
+    // Kernel stack registers saved while another process runs
     uint32_t esp_save;
     uint32_t ebp_save;
 
-    // TSS data
-    uint32_t tss_esp0;
-
     uint8_t file_name[DENTRY_NAME_LEN];
     uint8_t args[ARG_BUFF_SIZE];
 
     // 1 if process has called vidmap(), 0 otherwise
     int vidmap_active;
+
+    // Shared memory: bit i set if segment i is mapped, page table for SHM_PAGE
+    uint32_t shm_attached;
+    pagetable_entry_t* shm_table;
+
+    // Memory mapped files: page table for MMAP_PAGE, cache page behind each entry
+    pagetable_entry_t* mmap_table;
+    struct pcache_page** mmap_pages;
+    uint32_t mmap_npages;
 } pcb_t;
 
-extern void pcb_init(pcb_t* pcb, int32_t pid, uint8_t file_name[DENTRY_NAME_LEN], uint8_t arg[ARG_BUFF_SIZE]);
+extern void pcb_init(pcb_t* pcb, int32_t pid, pcb_t* parent, uint8_t file_name[DENTRY_NAME_LEN], uint8_t arg[ARG_BUFF_SIZE]);
 
-extern int32_t curr_pid;
+/* Process running on this processor, -1 if none */
+#define curr_pid (this_cpu()->pid)
+extern int32_t pidarray[MAX_PROCESSES];
 
 extern int32_t kill_current_proc (uint32_t status);
+extern int32_t create_process (const uint8_t* command, pcb_t* parent, int32_t terminal, int32_t background);
+extern uint32_t kernel_stack_top (int32_t pid);
+extern void kill_foreground (int32_t terminal);
 
 extern int32_t halt (uint32_t status);
 extern int32_t execute (const uint8_t* command);
@@ -76,7 +146,36 @@ extern int32_t getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t vidmap (uint8_t** screen_start);
 extern int32_t set_handler (int32_t signum, void* handler_address);
 extern int32_t sigreturn (void);
+extern int32_t ioctl (int32_t fd, int32_t request, int32_t arg);
+extern int32_t poll (pollfd_t* fds, int32_t nfds, int32_t timeout);
+extern int32_t pipe (int32_t* fds);
+extern int32_t dup (int32_t fd);
+extern int32_t dup2 (int32_t old_fd, int32_t new_fd);
+extern int32_t shmmap (const uint8_t* name, uint32_t size, uint8_t** addr);
+extern int32_t shmunmap (uint8_t* addr);
+extern int32_t unlink (const uint8_t* filename);
+extern int32_t mmap (int32_t fd, uint32_t length, uint8_t** addr);
+extern int32_t munmap (uint8_t* addr);
+extern int32_t mkdir (const uint8_t* dirname);
+extern int32_t getdents (int32_t fd, dirent_t* buf, int32_t nbytes);
+extern int32_t stat (const uint8_t* filename, stat_t* buf);
+extern int32_t fstat (int32_t fd, stat_t* buf);
+extern int32_t lseek (int32_t fd, int32_t offset, int32_t whence);
+extern int32_t pread (int32_t fd, void* buf, int32_t nbytes, int32_t offset);
+extern int32_t spawn (const uint8_t* command, int32_t flags);
+extern int32_t wait (int32_t* status);
+extern int32_t waitpid (int32_t pid, int32_t* status, int32_t options);
+extern int32_t alarm (uint32_t ticks);
+extern int32_t setitimer (uint32_t ticks, uint32_t interval);
+extern int32_t nanosleep (const timespec_t* req, timespec_t* rem);
 
 extern pcb_t* get_pcb(int32_t pid);
 
+extern void fd_table_init(pcb_t* pcb);
+extern void fd_table_free(pcb_t* pcb);
+extern int32_t alloc_fd(pcb_t* pcb);
+extern void free_fd(pcb_t* pcb, int32_t fd);
+extern void install_fd(pcb_t* pcb, int32_t fd, file_desc_t* file);
+extern file_desc_t* get_fd(pcb_t* pcb, int32_t fd);
+
 #endif
@@ -5,11 +5,9 @@
 #include "syscalls.h"
 #include "paging.h"
 #include "x86_desc.h"
-#include "rtc.h"
 
 int target_visible_terminal = 0;
 int visible_terminal = 0;
-int active_terminal = 0;
 
 terms_t terminal_data[MAX_TERMINALS];
 char term_vidmem[MAX_TERMINALS][FOUR_KB] __attribute__((aligned (0x1000)));
@@ -17,31 +15,58 @@ char term_vidmem[MAX_TERMINALS][FOUR_KB] __attribute__((aligned (0x1000)));
 
 
 
+/* static iq_put
+ * Inputs: q - input queue to append to
+ *         c - byte to append
+ * Return Value: 1 if queued, 0 if the queue is full
+ * Function: Appends one byte to a terminal input queue */
+static int32_t iq_put(input_queue_t *q, char c) {
+    if (q->tail - q->head >= INPUT_QUEUE_SIZE)
+        return 0;
+
+    q->buf[q->tail & (INPUT_QUEUE_SIZE - 1)] = c;
+    q->tail++;
+    if (c == '\n')
+        q->lines++;
+    return 1;
+}
+
 /* int32_t add_char_to_tbuff(char kb_char);
  * Inputs: kb_char - char entered from keyboard to be added to terminal buffer
- * Return Value: 1 if successful, 0 otherwise
- * Function: Add new char entered to the terminal buffer */
+ * Return Value: 1 if the char should be echoed, 0 otherwise
+ * Function: Add new char entered to the visible terminal. In cooked mode the
+ *           char edits the current line, and ENTER moves the whole line into
+ *           the input queue. In raw mode the char is queued immediately. */
 int32_t add_char_to_tbuff(char kb_char) {
+    terms_t *term = &terminal_data[visible_terminal];
+    int i;
+
+    if (term->mode == TERM_MODE_RAW) {
+        if (kb_char == BACKSPACE)
+            kb_char = '\b';
+        iq_put(&term->input, kb_char);
+        return 0;
+    }
 
     if(kb_char == '\n') {
-        terminal_data[visible_terminal].enter_flag = 1;
-        if(terminal_data[visible_terminal].char_idx >= BUFFER_SIZE)
-            terminal_data[visible_terminal].term_buffer[BUFFER_SIZE - 1] = '\n';
-        else
-            terminal_data[visible_terminal].term_buffer[terminal_data[visible_terminal].char_idx] = '\n';
-        
+        // Line plus newline has to fit, otherwise keep editing until a reader drains the queue
+        if (term->input.tail - term->input.head + term->char_idx + 1 > INPUT_QUEUE_SIZE)
+            return 0;
+
+        for (i = 0; i < term->char_idx; i++)
+            iq_put(&term->input, term->line_buffer[i]);
+        iq_put(&term->input, '\n');
+        term->char_idx = 0;
         return 1;
     } else if(kb_char == BACKSPACE) {
-        if(terminal_data[visible_terminal].char_idx > 0){
-            if(terminal_data[visible_terminal].char_idx <= BUFFER_SIZE)
-                terminal_data[visible_terminal].term_buffer[terminal_data[visible_terminal].char_idx - 1] = ' ';
-            --terminal_data[visible_terminal].char_idx;
+        if(term->char_idx > 0){
+            --term->char_idx;
             return 1;
         }
         return 0;
-    } else if(terminal_data[visible_terminal].char_idx < (BUFFER_SIZE - 1)){
-        terminal_data[visible_terminal].term_buffer[terminal_data[visible_terminal].char_idx] = kb_char;
-        ++terminal_data[visible_terminal].char_idx;
+    } else if(term->char_idx < (BUFFER_SIZE - 1)){
+        term->line_buffer[term->char_idx] = kb_char;
+        ++term->char_idx;
         return 1;
     }
     else{
@@ -51,51 +76,50 @@ int32_t add_char_to_tbuff(char kb_char) {
 
 
 /* int32_t terminal_read(const void* buf, int32_t nbytes);
- * Inputs: buf - buffer of keyboard input
+ * Inputs: buf - buffer to copy keyboard input into
            nbytes - number of bytes for buffer
- * Return Value: None
- * Function: Add new char entered to the terminal buffer */
+ * Return Value: number of bytes copied, -1 on failure
+ * Function: In cooked mode, waits for a completed line and copies it up to and
+ *           including the newline. In raw mode, waits for any input. At most
+ *           nbytes are consumed; anything left stays queued for the next read. */
 int32_t terminal_read(file_desc_t *fd, void* buf, int32_t nbytes){
     // Can't read from stdout
     if (fd->inode == 1) return -1;
+    if (buf == NULL || nbytes < 0) return -1;
 
-    sti();
+    terms_t *term = &terminal_data[active_terminal];
+    input_queue_t *q = &term->input;
     int read_bytes = 0;
-    int i;
+    char c;
 
-    while(terminal_data[active_terminal].enter_flag == 0){}
+    // Non-blocking reads return 0 when nothing is ready yet
+    if (fd->flags.nonblock) {
+        if (term->mode == TERM_MODE_RAW && q->tail == q->head) return 0;
+        if (term->mode == TERM_MODE_COOKED && q->lines == 0) return 0;
+    }
 
-    cli(); //start of critical section
-    
-    if(nbytes >= BUFFER_SIZE) { //check if larger than buffer
-        for(i = 0; i < BUFFER_SIZE; ++i) {
-            ((char*) buf)[i] = terminal_data[active_terminal].term_buffer[i];
-            terminal_data[active_terminal].term_buffer[i] = ' ';       //clear
-            if(((char*)buf)[i] == '\n') {
-                read_bytes = i + 1;
-                break;
-            }
-        }
+    sti();
+
+    if (term->mode == TERM_MODE_RAW) {
+        while (q->tail == q->head) {}
     } else {
-        for(i = 0; i < nbytes; ++i) {
-            ((char*) buf)[i] = terminal_data[active_terminal].term_buffer[i];
-            terminal_data[active_terminal].term_buffer[i] = ' ';           
-            if(((char*)buf)[i] == '\n') {
-                read_bytes = i + 1;
-                break;
-            }
-            if((i == (nbytes - 1)) && (((char*)buf)[i] != '\n')){  //buffer has to end in ENTER
-                ((char*) buf)[i] = '\n';
-                read_bytes = i + 1;
-                break;
-            }
-        }
+        while (q->lines == 0) {}
     }
 
+    cli(); //start of critical section
 
+    while (read_bytes < nbytes && q->head != q->tail) {
+        c = q->buf[q->head & (INPUT_QUEUE_SIZE - 1)];
+        q->head++;
+        ((char*) buf)[read_bytes++] = c;
 
-    terminal_data[active_terminal].char_idx = 0;  
-    terminal_data[active_terminal].enter_flag = 0;
+        if (c == '\n') {
+            q->lines--;
+            // Cooked reads return at most one line
+            if (term->mode == TERM_MODE_COOKED)
+                break;
+        }
+    }
 
     sti(); //end critical section
 
@@ -136,13 +160,85 @@ int32_t terminal_open(file_desc_t *fd, const uint8_t* filename) {
 }
 
 /* terminal_close
- * does nothing as of now
+ * closes a terminal descriptor. Closing the last reference to stdin
+ * puts the terminal back in cooked mode; a program that exits in raw
+ * mode, even killed, is handled by terminal_release
  * Inputs: file descriptor
- * Outputs: -1
+ * Outputs: 0
  *   
  */
 int32_t terminal_close(file_desc_t *fd) {
-    return -1;
+    if (fd->inode == 0)
+        terminal_set_mode(TERM_MODE_COOKED);
+    fd->flags.open = 0;
+    return 0;
+}
+
+/* terminal_ioctl
+ * terminal-specific control requests
+ * Inputs: fd - file descriptor
+ *         request - IOCTL_TERM_SET_MODE
+ *         arg - argument for the request
+ * Outputs: 0 on success, -1 on failure
+ *
+ */
+int32_t terminal_ioctl(file_desc_t *fd, int32_t request, int32_t arg) {
+    switch (request) {
+        case IOCTL_TERM_SET_MODE:
+            return terminal_set_mode(arg);
+        default:
+            return -1;
+    }
+}
+
+/* terminal_poll
+ * reports whether stdin has input ready; stdout never waits
+ * Inputs: fd - file descriptor
+ * Outputs: POLLIN if a read would not wait, POLLOUT for stdout
+ *
+ */
+int32_t terminal_poll(file_desc_t *fd) {
+    terms_t *term = &terminal_data[active_terminal];
+
+    if (fd->inode == 1)
+        return POLLOUT;
+
+    if (term->mode == TERM_MODE_RAW)
+        return (term->input.tail != term->input.head) ? POLLIN : 0;
+    return (term->input.lines > 0) ? POLLIN : 0;
+}
+
+/* terminal_set_mode
+ * switches the active terminal between cooked and raw input, and
+ * remembers which process asked for raw mode
+ * Inputs: mode - TERM_MODE_COOKED or TERM_MODE_RAW
+ * Outputs: 0 on success, -1 on bad mode
+ *
+ */
+int32_t terminal_set_mode(int32_t mode) {
+    if (mode != TERM_MODE_COOKED && mode != TERM_MODE_RAW)
+        return -1;
+
+    terminal_data[active_terminal].mode = mode;
+    terminal_data[active_terminal].raw_pid = (mode == TERM_MODE_RAW) ? curr_pid : -1;
+    return 0;
+}
+
+/* terminal_release
+ * hands the terminal back in cooked mode if the process leaving it is
+ * the one that switched it to raw mode. Children share their parent's
+ * stdin, so closing it isn't enough when one of them exits
+ * Inputs: terminal - terminal the process used
+ *         pid - process that is ending
+ * Outputs: none
+ *
+ */
+void terminal_release(int32_t terminal, int32_t pid) {
+    if (terminal_data[terminal].raw_pid != pid)
+        return;
+
+    terminal_data[terminal].mode = TERM_MODE_COOKED;
+    terminal_data[terminal].raw_pid = -1;
 }
 
 /* terminal_init
@@ -156,12 +252,13 @@ void terminal_init(){
     for(i = 0; i < MAX_TERMINALS; i++){
         terminal_data[i].cursor_x = 0;
         terminal_data[i].cursor_y = 0;
-        terminal_data[i].curr_pid = -1;
-        terminal_data[i].enter_flag = 0;
+        terminal_data[i].shell_pid = -1;
         terminal_data[i].char_idx = 0;
-        terminal_data[i].rtc_counter = 0;
-        terminal_data[i].rtc_divider = RTC_RATE / 2;
-        terminal_data[i].rtc_interrupt_received = 0;
+        terminal_data[i].input.head = 0;
+        terminal_data[i].input.tail = 0;
+        terminal_data[i].input.lines = 0;
+        terminal_data[i].mode = TERM_MODE_COOKED;
+        terminal_data[i].raw_pid = -1;
     }
 }
 
@@ -10,6 +10,14 @@
 
 #define MAX_TERMINALS 3
 
+#define INPUT_QUEUE_SIZE 1024   // must be a power of 2
+
+#define TERM_MODE_COOKED 0      // line-buffered, echoed, backspace edits the line
+#define TERM_MODE_RAW    1      // every keystroke is queued as-is and not echoed
+
+/* Terminal ioctl requests */
+#define IOCTL_TERM_SET_MODE 2   // arg: TERM_MODE_COOKED or TERM_MODE_RAW
+
 
 //descriptions in terminal_driver.c
 extern int32_t add_char_to_tbuff(char kb_char);
@@ -17,31 +25,39 @@ extern int32_t terminal_read(file_desc_t *fd, void* buf, int32_t nbytes);
 extern int32_t terminal_write(file_desc_t *fd, const void* buf, int32_t nbytes);
 extern int32_t terminal_open(file_desc_t *fd, const uint8_t* filename);
 extern int32_t terminal_close(file_desc_t *fd);
+extern int32_t terminal_ioctl(file_desc_t *fd, int32_t request, int32_t arg);
+extern int32_t terminal_poll(file_desc_t *fd);
+extern int32_t terminal_set_mode(int32_t mode);
+extern void terminal_release(int32_t terminal, int32_t pid);
 void switch_visible_terminal(int32_t num);
 
 extern int target_visible_terminal;
-extern int active_terminal;
 extern int visible_terminal;
 
+/* Terminal of the process running on this processor, which printf writes to */
+#define active_terminal (this_cpu()->terminal)
+
+
+/* Bytes typed on a terminal that are ready to be read. head and tail are
+ * free-running counters, masked with INPUT_QUEUE_SIZE - 1 to index buf. */
+typedef struct input_queue{
+    char buf[INPUT_QUEUE_SIZE];
+    volatile uint32_t head;     // next byte to be read
+    volatile uint32_t tail;     // next free slot
+    volatile int lines;         // number of '\n' bytes currently queued
+}input_queue_t;
 
 typedef struct term_struct{
     int cursor_x;
     int cursor_y;
-    int32_t curr_pid;
-    char term_buffer[BUFFER_SIZE];
-    volatile int enter_flag;
-    int char_idx;
-
-    uint32_t tss_esp0;
-    uint32_t esp_save;
-    uint32_t ebp_save;
+    int32_t shell_pid;          // -1 if the shell couldn't be started
 
-    // RTC
-    int rtc_divider;
-    int rtc_counter;
-    volatile int rtc_interrupt_received;    // set to 1 after interrupt received
-
-    int halt_flag;
+    // Input: line being edited (cooked mode) and bytes ready to be read
+    char line_buffer[BUFFER_SIZE];
+    int char_idx;
+    input_queue_t input;
+    int mode;                   // TERM_MODE_COOKED or TERM_MODE_RAW
+    int32_t raw_pid;            // process that switched to raw mode, -1 if none
 
 }terms_t;
 
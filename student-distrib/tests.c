@@ -5,6 +5,17 @@
 #include "fs.h"
 #include "syscalls.h"
 #include "terminal_driver.h"
+#include "pipe.h"
+#include "tmpfs.h"
+#include "pcache.h"
+#include "mmap.h"
+#include "ata.h"
+#include "blkq.h"
+#include "signal.h"
+#include "timer.h"
+#include "scheduling.h"
+#include "apic.h"
+#include "smp.h"
 
 #define PASS 1
 #define FAIL 0
@@ -157,18 +168,18 @@ int rtc_test(){
 	TEST_HEADER;
 	int i;
 	int buf;
-	rtc_open(NULL, 0);
+	file_desc_t rtc;
+	rtc_open(&rtc, 0);
 	for(buf = 1; buf <= RTC_RATE; buf*=2){
 		printf("\n%d Hz\n", buf);
-		rtc_write(0, &buf, 4);
+		rtc_write(&rtc, &buf, 4);
 		for(i = 0; i < 2*buf; i++){
 			// receive 2*freq interrupts, shuld take 2 sec
-			rtc_read(0, 0, 0);
+			rtc_read(&rtc, 0, 0);
 		}
 	}
 	printf("\n");
-	buf = 2;
-	rtc_write(0, &buf, 4);
+	rtc_close(&rtc);
 	return PASS;
 }
 
@@ -348,6 +359,818 @@ int test_system_call_close(){
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/* Pipe test - Passes data through a pipe and checks end of file
+ * Expectation: Bytes come out in order; a non-blocking read of the empty
+ *              pipe returns -1, and read returns 0 once the writer closes
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Allocates and frees a pipe
+ * Coverage: pipe_alloc, pipe_read, pipe_write, pipe_close, pipe_poll
+ * Files: pipe.c/h
+ */
+int pipe_test(){
+	TEST_HEADER;
+	int result = PASS;
+	file_desc_t rd, wr;
+	uint8_t buf[8];
+
+	if (pipe_alloc(&rd, &wr)) return FAIL;
+
+	if (pipe_poll(&rd) != 0) result = FAIL;
+	rd.flags.nonblock = 1;
+	if (pipe_read(&rd, buf, 4) != -1) result = FAIL;	// empty, not end of file
+	rd.flags.nonblock = 0;
+	if (pipe_write(&wr, "abcdef", 6) != 6) result = FAIL;
+	if (pipe_poll(&rd) != POLLIN) result = FAIL;
+	if (pipe_read(&rd, buf, 4) != 4 || strncmp((int8_t*)buf, "abcd", 4)) result = FAIL;
+	if (pipe_read(&wr, buf, 4) != -1) result = FAIL;
+
+	pipe_close(&wr);
+	if (pipe_read(&rd, buf, 8) != 2 || strncmp((int8_t*)buf, "ef", 2)) result = FAIL;
+	if (pipe_read(&rd, buf, 8) != 0) result = FAIL;
+	pipe_close(&rd);
+
+	return result;
+}
+
+/* Writable filesystem test - Creates, writes, reads back and removes a file
+ * Expectation: Data spanning a block boundary reads back intact; the file
+ *              disappears after fs_unlink
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Creates and removes "scratch.tmp"
+ * Coverage: fs_create, fs_unlink, read_dentry_by_name, read_data, tmpfs_write
+ * Files: fs.c/h, tmpfs.c/h
+ */
+int tmpfs_test(){
+	TEST_HEADER;
+	int result = PASS;
+	dentry_t d;
+	uint8_t buf[8];
+	int32_t inode = fs_create((uint8_t*)"scratch.tmp");
+
+	if (inode < 0) return FAIL;
+	if (fs_create((uint8_t*)".") != -1) result = FAIL;
+
+	if (tmpfs_write(inode, DATA_BLOCK_SIZE - 3, (uint8_t*)"abcdef", 6) != 6) result = FAIL;
+	if (fs_file_size(inode) != DATA_BLOCK_SIZE + 3) result = FAIL;
+	if (read_data(inode, DATA_BLOCK_SIZE - 3, buf, 8) != 6 || strncmp((int8_t*)buf, "abcdef", 6)) result = FAIL;
+
+	// The hole before the data reads as zeros
+	if (read_data(inode, 0, buf, 1) != 1 || buf[0] != 0) result = FAIL;
+
+	if (read_dentry_by_name((uint8_t*)"scratch.tmp", &d) || d.inode != inode) result = FAIL;
+	if (fs_unlink((uint8_t*)"scratch.tmp")) result = FAIL;
+	if (read_dentry_by_name((uint8_t*)"scratch.tmp", &d) != -1) result = FAIL;
+
+	return result;
+}
+
+/* Directory test - Builds and removes a small tree in the writable layer
+ * Expectation: Paths with "/", "." and ".." resolve through the tree, a
+ *              directory can't be removed until it is empty, and removed
+ *              names stop resolving
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Creates and removes "tdir"
+ * Coverage: fs_mkdir, fs_create, fs_unlink, read_dentry_by_name, dir_dentry_by_index
+ * Files: fs.c/h, tmpfs.c/h
+ */
+int dir_tree_test(){
+	TEST_HEADER;
+	int result = PASS;
+	dentry_t d;
+	int32_t dir, sub, file;
+
+	dir = fs_mkdir((uint8_t*)"tdir");
+	sub = fs_mkdir((uint8_t*)"tdir/sub");
+	file = fs_create((uint8_t*)"/tdir/sub/f.txt");
+	if (dir < 0 || sub < 0 || file < 0) return FAIL;
+
+	if (fs_mkdir((uint8_t*)"tdir") != -1) result = FAIL;
+	if (fs_mkdir((uint8_t*)"frame0.txt") != -1) result = FAIL;
+	if (fs_create((uint8_t*)"nodir/f.txt") != -1) result = FAIL;
+	if (fs_create((uint8_t*)"frame0.txt/f.txt") != -1) result = FAIL;
+
+	if (read_dentry_by_name((uint8_t*)"tdir/sub/f.txt", &d) || d.inode != file) result = FAIL;
+	if (read_dentry_by_name((uint8_t*)"tdir/./sub/../sub/f.txt", &d) || d.inode != file) result = FAIL;
+	if (read_dentry_by_name((uint8_t*)"tdir/..", &d) || d.inode != ROOT_DIR_INODE) result = FAIL;
+	if (read_dentry_by_name((uint8_t*)"tdir/f.txt", &d) != -1) result = FAIL;
+	if (read_dentry_by_name((uint8_t*)"tdir/sub", &d) || d.type != FILE_DIRECTORY) result = FAIL;
+
+	if (dir_dentry_by_index(sub, 0, &d) || d.inode != file) result = FAIL;
+	if (dir_dentry_by_index(sub, 1, &d) != -1) result = FAIL;
+
+	if (fs_unlink((uint8_t*)"tdir") != -1) result = FAIL;
+	if (fs_unlink((uint8_t*)"tdir/sub/f.txt")) result = FAIL;
+	if (fs_unlink((uint8_t*)"tdir/sub")) result = FAIL;
+	if (fs_unlink((uint8_t*)"tdir")) result = FAIL;
+	if (read_dentry_by_name((uint8_t*)"tdir/sub/f.txt", &d) != -1) result = FAIL;
+	if (read_dentry_by_name((uint8_t*)"tdir", &d) != -1) result = FAIL;
+
+	return result;
+}
+
+/* Directory listing test - Lists the root with dir_getdents and dir_read
+ * Expectation: Both list the same names in the same order, and sizes of
+ *              regular files match fs_file_size
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: dir_getdents, dir_read, dir_dentry_by_index
+ * Files: fs.c/h
+ */
+int getdents_test(){
+	TEST_HEADER;
+	int result = PASS;
+	file_desc_t batch, single;
+	dirent_t ents[3];
+	uint8_t name[DENTRY_NAME_LEN + 1];
+	int32_t cnt, i, total = 0;
+
+	if (file_dir_ftable.open(&batch, (uint8_t*)".")) return FAIL;
+	if (file_dir_ftable.open(&single, (uint8_t*)".")) return FAIL;
+
+	if (dir_getdents(&batch, ents, sizeof(dirent_t) - 1) != -1) result = FAIL;
+
+	while ((cnt = dir_getdents(&batch, ents, sizeof(ents))) > 0) {
+		if (cnt % sizeof(dirent_t) != 0) result = FAIL;
+		for (i = 0; i < cnt / sizeof(dirent_t); i++) {
+			int32_t len = file_dir_ftable.read(&single, name, DENTRY_NAME_LEN);
+			name[len] = '\0';
+			if (strncmp((int8_t*)name, (int8_t*)ents[i].name, DENTRY_NAME_LEN + 1)) result = FAIL;
+			if (ents[i].type == FILE_REGULAR && ents[i].size != fs_file_size(ents[i].inode)) result = FAIL;
+			total++;
+		}
+	}
+	if (cnt != 0 || total == 0) result = FAIL;
+	if (file_dir_ftable.read(&single, name, DENTRY_NAME_LEN) != 0) result = FAIL;
+
+	file_dir_ftable.close(&batch);
+	file_dir_ftable.close(&single);
+	return result;
+}
+
+/* Stat test - Describes a regular file and the root directory
+ * Expectation: The file's size and block count match its contents, and
+ *              the directory has no size
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: fs_stat, fs_file_size
+ * Files: fs.c/h
+ */
+int stat_test(){
+	TEST_HEADER;
+	int result = PASS;
+	dentry_t d;
+	stat_t st;
+
+	if (read_dentry_by_name((uint8_t*)"fish", &d)) return FAIL;
+	if (fs_stat(d.inode, d.type, &st)) return FAIL;
+	if (st.type != FILE_REGULAR || st.inode != d.inode) result = FAIL;
+	if (st.size != fs_file_size(d.inode) || st.size == 0) result = FAIL;
+	if (st.blocks != (st.size + DATA_BLOCK_SIZE - 1) / DATA_BLOCK_SIZE) result = FAIL;
+
+	if (read_dentry_by_name((uint8_t*)".", &d)) return FAIL;
+	if (fs_stat(d.inode, d.type, &st)) return FAIL;
+	if (st.type != FILE_DIRECTORY || st.size != 0 || st.blocks != 0) result = FAIL;
+
+	return result;
+}
+
+/* Compares n bytes, returns 1 if they are the same */
+static int same_bytes(const uint8_t* a, const uint8_t* b, int32_t n){
+	int32_t i;
+	for (i = 0; i < n; i++) {
+		if (a[i] != b[i]) return 0;
+	}
+	return 1;
+}
+
+/* Seek test - Reads a file out of order with fs_lseek and file_pread
+ * Expectation: Reads after a seek and positional reads return the same
+ *              bytes as read_data, and pread leaves the position alone
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: fs_lseek, file_pread, file_read
+ * Files: fs.c/h
+ */
+int lseek_test(){
+	TEST_HEADER;
+	int result = PASS;
+	file_desc_t fd;
+	uint8_t buf[16], expect[16];
+	int32_t size;
+
+	if (file_regular_ftable.open(&fd, (uint8_t*)"fish")) return FAIL;
+	size = fs_file_size(fd.inode);
+	if (size < DATA_BLOCK_SIZE + 16) return FAIL;
+
+	if (fs_lseek(&fd, DATA_BLOCK_SIZE, SEEK_SET) != DATA_BLOCK_SIZE) result = FAIL;
+	if (file_regular_ftable.read(&fd, buf, 16) != 16) result = FAIL;
+	if (read_data(fd.inode, DATA_BLOCK_SIZE, expect, 16) != 16 || !same_bytes(buf, expect, 16)) result = FAIL;
+
+	if (fs_lseek(&fd, -16, SEEK_END) != size - 16) result = FAIL;
+	if (fs_lseek(&fd, 4, SEEK_CUR) != size - 12) result = FAIL;
+	if (file_regular_ftable.read(&fd, buf, 16) != 12) result = FAIL;
+	if (fs_lseek(&fd, -size - 1, SEEK_END) != -1 || fd.pos != size) result = FAIL;
+	if (fs_lseek(&fd, 0, 7) != -1) result = FAIL;
+
+	if (file_pread(&fd, buf, 16, 100) != 16 || fd.pos != size) result = FAIL;
+	if (read_data(fd.inode, 100, expect, 16) != 16 || !same_bytes(buf, expect, 16)) result = FAIL;
+	if (file_pread(&fd, buf, 16, size) != 0) result = FAIL;
+
+	file_regular_ftable.close(&fd);
+	return result;
+}
+
+/* File descriptor table test - Fills a table to the limit
+ * Expectation: Descriptors come out lowest first past the ones kept in the
+ *              PCB, the table refuses one more when full, and a freed
+ *              descriptor is the next one handed out
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: alloc_fd, free_fd, get_fd, fd_table_free
+ * Files: syscalls.c/h
+ */
+static pcb_t fd_test_pcb;
+int fd_table_test(){
+	TEST_HEADER;
+	int result = PASS;
+	int32_t i;
+
+	fd_table_init(&fd_test_pcb);
+	for (i = 0; i < MAX_FILE_DESCRIPTORS; i++) {
+		if (alloc_fd(&fd_test_pcb) != i) {
+			fd_table_free(&fd_test_pcb);
+			return FAIL;
+		}
+	}
+	if (alloc_fd(&fd_test_pcb) != -1) result = FAIL;
+	if (get_fd(&fd_test_pcb, 300) != NULL) result = FAIL;	// reserved, not open
+
+	free_fd(&fd_test_pcb, 300);
+	free_fd(&fd_test_pcb, 9);
+	if (alloc_fd(&fd_test_pcb) != 9 || alloc_fd(&fd_test_pcb) != 300) result = FAIL;
+	if (get_fd(&fd_test_pcb, -1) != NULL || get_fd(&fd_test_pcb, MAX_FILE_DESCRIPTORS) != NULL) result = FAIL;
+
+	fd_table_free(&fd_test_pcb);
+	if (alloc_fd(&fd_test_pcb) != 0) result = FAIL;
+	fd_table_free(&fd_test_pcb);
+	return result;
+}
+
+/* Open file test - Shares one open file between two references
+ * Expectation: Reads through either reference move the same position, and
+ *              the file is only closed when the last reference is dropped
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: file_alloc, file_get, file_put
+ * Files: filedescriptor.c/h
+ */
+int open_file_test(){
+	TEST_HEADER;
+	int result = PASS;
+	file_desc_t *file;
+	uint8_t buf[16];
+
+	file = file_alloc();
+	if (file == NULL || file->refcount != 1) return FAIL;
+	file->ftable = &file_regular_ftable;
+	if (file->ftable->open(file, (uint8_t*)"frame0.txt")) return FAIL;
+	file->flags.open = 1;
+
+	file_get(file);
+	if (file->ftable->read(file, buf, 16) != 16 || file->pos != 16) result = FAIL;
+	if (file_put(file) != 0 || !file->flags.open) result = FAIL;
+	if (file->ftable->read(file, buf, 16) != 16 || file->pos != 32) result = FAIL;
+
+	file_put(file);
+	if (file->refcount != 0) result = FAIL;
+	if (file_alloc() != file) result = FAIL;	// reused first
+	file_put(file);
+	return result;
+}
+
+/* Page cache test - Reads the same file twice through read_data
+ * Expectation: The first read can miss, the second read only hits
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Caches the blocks of "frame0.txt"
+ * Coverage: read_data, pcache_get, pcache_put, pcache_get_stats
+ * Files: fs.c/h, pcache.c/h
+ */
+int pcache_test(){
+	TEST_HEADER;
+	int result = PASS;
+	dentry_t d;
+	uint8_t buf[64];
+	pcache_stats_t before, after;
+
+	if (read_dentry_by_name((uint8_t*)"frame0.txt", &d)) return FAIL;
+
+	if (read_data(d.inode, 0, buf, 64) <= 0) result = FAIL;
+	pcache_get_stats(&before);
+	if (read_data(d.inode, 0, buf, 64) <= 0) result = FAIL;
+	pcache_get_stats(&after);
+
+	if (after.misses != before.misses || after.hits != before.hits + 1) result = FAIL;
+	printf("hits %d misses %d evictions %d\n", after.hits, after.misses, after.evictions);
+
+	return result;
+}
+
+/* Readahead test - Reads a large file sequentially in small pieces
+ * Expectation: The data matches read_data. When the image is on disk,
+ *              blocks are read ahead and later reads find them cached
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Drops and re-caches the blocks of "fish"
+ * Coverage: file_read, readahead, pcache_start_load, pcache_end_load
+ * Files: fs.c/h, pcache.c/h
+ */
+int readahead_test(){
+	TEST_HEADER;
+	int result = PASS;
+	file_desc_t fd;
+	uint8_t buf[1000], expect[1000];
+	pcache_stats_t before, after;
+	int32_t count, i, offset = 0;
+
+	if (file_regular_ftable.open(&fd, (uint8_t*)"fish")) return FAIL;
+	pcache_invalidate(fd.inode);
+	pcache_get_stats(&before);
+
+	while ((count = file_regular_ftable.read(&fd, buf, sizeof(buf))) > 0) {
+		if (read_data(fd.inode, offset, expect, count) != count) result = FAIL;
+		for (i = 0; i < count; i++) {
+			if (buf[i] != expect[i]) result = FAIL;
+		}
+		offset += count;
+	}
+	if (count < 0 || offset != fs_file_size(fd.inode)) result = FAIL;
+
+	pcache_get_stats(&after);
+	if (after.readahead > before.readahead && after.readahead_hits == before.readahead_hits) result = FAIL;
+	printf("read ahead %d blocks, %d used\n", after.readahead - before.readahead,
+		after.readahead_hits - before.readahead_hits);
+
+	file_regular_ftable.close(&fd);
+	return result;
+}
+
+/* Mapped page test - Checks the page mmap would map for a small file
+ * Expectation: The page matches read_data and is zero past end of file
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Caches the first block of "frame0.txt"
+ * Coverage: fs_get_page, fill_block, pcache_put
+ * Files: fs.c/h, pcache.c/h
+ */
+int mmap_page_test(){
+	TEST_HEADER;
+	int result = PASS;
+	dentry_t d;
+	uint8_t buf[64];
+	int32_t size, i;
+	pcache_page_t *page;
+
+	if (read_dentry_by_name((uint8_t*)"frame0.txt", &d)) return FAIL;
+	size = fs_file_size(d.inode);
+	if (size <= 0 || size >= DATA_BLOCK_SIZE) return FAIL;
+
+	page = fs_get_page(d.inode, 0);
+	if (page == NULL) return FAIL;
+
+	if (read_data(d.inode, 0, buf, 64) != 64 || strncmp((int8_t*)buf, (int8_t*)page->data, 64)) result = FAIL;
+	for (i = size; i < DATA_BLOCK_SIZE; i++) {
+		if (page->data[i] != 0) result = FAIL;
+	}
+	if (fs_get_page(d.inode, 1) != NULL) result = FAIL;
+
+	pcache_put(page);
+	return result;
+}
+
+/* Mapping limit test - Checks mmap refuses to pin more cache pages than a process may
+ * Expectation: Mappings past MMAP_PROC_PAGES fail before touching the page tables
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: mmap_map
+ * Files: mmap.c/h
+ */
+int mmap_limit_test(){
+	TEST_HEADER;
+	int result = PASS;
+	static pcb_t pcb;
+	uint8_t *addr;
+
+	pcb.mmap_table = NULL;
+	pcb.mmap_pages = NULL;
+	pcb.mmap_npages = MMAP_PROC_PAGES;
+	if (mmap_map(&pcb, 0, 1, &addr) != -1) result = FAIL;
+
+	pcb.mmap_npages = MMAP_PROC_PAGES - 1;
+	if (mmap_map(&pcb, 0, 2 * PAGETABLE_STEP, &addr) != -1) result = FAIL;
+	if (pcb.mmap_table != NULL || pcb.mmap_npages != MMAP_PROC_PAGES - 1) result = FAIL;
+
+	return result;
+}
+
+/* ATA test - Reads the boot sector of the primary master
+ * Expectation: The sector ends with the 0x55 0xAA boot signature
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: ata_init, ata_start, ata_handler, blk_read
+ * Files: ata.c/h, blkq.c/h
+ */
+int ata_test(){
+	TEST_HEADER;
+	static uint8_t sector[ATA_SECTOR_SIZE];
+
+	if (!ata_present(ATA_MASTER)) return FAIL;
+	if (blk_read(ATA_MASTER, 0, 1, sector)) return FAIL;
+	if (sector[510] != 0x55 || sector[511] != 0xAA) return FAIL;
+
+	return PASS;
+}
+
+static int blkq_callbacks;
+
+static void blkq_test_callback(blk_request_t* req){
+	blkq_callbacks++;
+}
+
+/* Block queue test - Reads four neighbouring sectors as separate requests
+ * Expectation: Each request is either merged or sent to the drive, every
+ *              callback runs, and the data matches one large read
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: blk_submit, blk_wait, merging, callbacks, blk_get_stats
+ * Files: blkq.c/h
+ */
+int blkq_test(){
+	TEST_HEADER;
+	static uint8_t whole[4 * ATA_SECTOR_SIZE];
+	static uint8_t parts[4 * ATA_SECTOR_SIZE];
+	static blk_request_t reqs[4];
+	blk_stats_t before, after;
+	uint32_t flags;
+	int i;
+
+	if (!ata_present(ATA_MASTER)) return FAIL;
+	if (blk_read(ATA_MASTER, 0, 4, whole)) return FAIL;
+
+	blk_get_stats(&before);
+	blkq_callbacks = 0;
+
+	// Submit together so the later ones queue behind the first
+	cli_and_save(flags);
+	for (i = 0; i < 4; i++) {
+		reqs[i].drive = ATA_MASTER;
+		reqs[i].lba = i;
+		reqs[i].count = 1;
+		reqs[i].buf = parts + i * ATA_SECTOR_SIZE;
+		reqs[i].callback = blkq_test_callback;
+		reqs[i].private = NULL;
+		if (blk_submit(&reqs[i])) {
+			restore_flags(flags);
+			return FAIL;
+		}
+	}
+	restore_flags(flags);
+
+	for (i = 0; i < 4; i++) {
+		blk_wait(&reqs[i]);
+		if (reqs[i].error) return FAIL;
+	}
+	blk_get_stats(&after);
+
+	if (blkq_callbacks != 4) return FAIL;
+	if (after.completed - before.completed != 4) return FAIL;
+	if ((after.merged - before.merged) + (after.dispatched - before.dispatched) != 4) return FAIL;
+	for (i = 0; i < sizeof(whole); i++) {
+		if (whole[i] != parts[i]) return FAIL;
+	}
+
+	return PASS;
+}
+
+/* Signal test - Sends signals to a process that isn't running
+ * Expectation: A pending signal is fatal only if it isn't blocked, has no
+ *              handler and kills by default
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: signal_init, send_signal, signal_fatal, signal_set_handler
+ * Files: signal.c/h
+ */
+static pcb_t signal_test_pcb;
+int signal_test(){
+	TEST_HEADER;
+	int result = PASS;
+	pcb_t *pcb = &signal_test_pcb;
+
+	signal_init(pcb);
+	send_signal(pcb, ALARM);
+	if (signal_fatal(pcb)) result = FAIL;		// ignored by default
+	send_signal(pcb, INTERRUPT);
+	if (!signal_fatal(pcb)) result = FAIL;
+
+	pcb->sig_blocked = 1 << INTERRUPT;
+	if (signal_fatal(pcb)) result = FAIL;
+	pcb->sig_blocked = 0;
+
+	if (signal_set_handler(pcb, INTERRUPT, (void*)USER_ENTRY_ADDRESS) != 0) result = FAIL;
+	if (signal_fatal(pcb)) result = FAIL;
+	if (signal_set_handler(pcb, NUM_SIGNALS, NULL) != -1) result = FAIL;
+	if (signal_set_handler(pcb, SEGFAULT, (void*)KERNEL_PAGE) != -1) result = FAIL;
+
+	signal_init(pcb);
+	if (pcb->sig_pending != 0 || pcb->sig_handler[INTERRUPT] != NULL) result = FAIL;
+	return result;
+}
+
+
+/* Timer test - Runs two timers in the same wheel slot, a turn apart
+ * Expectation: The near one fires on its tick, the far one is still
+ *              waiting and can be stopped
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Waits for the PIT with interrupts on
+ * Coverage: timer_setup, timer_add, timer_del, timer_tick
+ * Files: timer.c/h
+ */
+static volatile uint32_t timer_test_fired;
+static void timer_test_callback(timer_t* t){
+	if (t->expires == pit_ticks) timer_test_fired++;
+}
+int timer_test(){
+	TEST_HEADER;
+	int result = PASS;
+	timer_t near, far;
+	uint32_t start = pit_ticks;
+
+	timer_test_fired = 0;
+	timer_setup(&near, timer_test_callback, NULL);
+	timer_setup(&far, timer_test_callback, NULL);
+	timer_add(&near, start + 2);
+	timer_add(&far, start + 2 + TIMER_WHEEL_SLOTS);
+
+	while (pit_ticks - start < 4) {
+		asm volatile ("hlt");
+	}
+	if (timer_test_fired != 1 || near.pending || !far.pending) result = FAIL;
+	if (timer_del(&far) == 0 || far.pending) result = FAIL;
+	if (timer_del(&near) != 0) result = FAIL;
+	return result;
+}
+
+
+/* TSC test - Checks div64 and times PIT ticks with the TSC
+ * Expectation: Quotients match, and 5 PIT ticks take about 5 times the
+ *              cycles measured at boot
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Waits for the PIT with interrupts on
+ * Coverage: div64, rdtsc, tsc_init
+ * Files: lib.c/h, timer.c/h
+ */
+int tsc_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint64_t start, cycles;
+	uint32_t tick;
+
+	if (div64(0x123456789ULL, 3) != 0x61172283ULL) result = FAIL;
+	if (div64(0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFF) != 0x100000001ULL) result = FAIL;
+	if (tsc_per_tick == 0 || tsc_khz == 0) return FAIL;
+
+	tick = pit_ticks;
+	while (pit_ticks == tick) asm volatile ("hlt");
+	start = rdtsc();
+	tick = pit_ticks;
+	while (pit_ticks - tick < 5) asm volatile ("hlt");
+	cycles = rdtsc() - start;
+
+	if (cycles < 4 * (uint64_t)tsc_per_tick || cycles > 6 * (uint64_t)tsc_per_tick) result = FAIL;
+	printf("TSC %d kHz\n", tsc_khz);
+	return result;
+}
+
+
+/* RTC deadline test - Runs two rtc files at different rates at once
+ * Expectation: The 512 Hz file gets 8 virtual interrupts for each one of
+ *              the 64 Hz file
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Waits for the RTC with interrupts on
+ * Coverage: rtc_open, rtc_write, rtc_read, rtc_poll, rtc_close, rtc_handler
+ * Files: rtc.c/h
+ */
+int rtc_deadline_test(){
+	TEST_HEADER;
+	file_desc_t fast, slow;
+	int32_t rate, n = 0, i;
+
+	rtc_open(&fast, 0);
+	rtc_open(&slow, 0);
+	rate = 512;
+	rtc_write(&fast, &rate, 4);
+	rate = 64;
+	rtc_write(&slow, &rate, 4);
+
+	for (i = 0; i < 4; i++) {
+		while (rtc_poll(&slow) == 0) {
+			if (rtc_poll(&fast)) {
+				rtc_read(&fast, 0, 0);
+				n++;
+			}
+		}
+		rtc_read(&slow, 0, 0);
+	}
+	rtc_close(&fast);
+	rtc_close(&slow);
+
+	printf("%d fast interrupts\n", n);
+	return (n >= 31 && n <= 33) ? PASS : FAIL;
+}
+
+/* APIC test - Checks the interrupt path the kernel chose at boot
+ * Expectation: With the APIC, the boot processor is listed first and its
+ *              timer counts down within one tick; either way the scheduler
+ *              tick still comes PIT_HZ times a second
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Waits 6 ticks with interrupts on
+ * Coverage: apic_init, apic_timer_init, pit_init, send_eoi
+ * Files: apic.c/h, i8259.c/h
+ */
+int apic_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint64_t start, cycles;
+	uint32_t tick;
+
+	if (apic_enabled) {
+		if (apic_num_cpus == 0 || apic_cpu_ids[0] != lapic_read(LAPIC_ID) >> 24) result = FAIL;
+		if (lapic_timer_count == 0 || lapic_read(LAPIC_TIMER_CUR) > lapic_timer_count) result = FAIL;
+		printf("APIC: %d CPUs, timer %d per tick\n", apic_num_cpus, lapic_timer_count);
+	} else {
+		printf("No APIC, using the 8259\n");
+	}
+
+	tick = pit_ticks;
+	while (pit_ticks == tick) asm volatile ("hlt");
+	start = rdtsc();
+	tick = pit_ticks;
+	while (pit_ticks - tick < 5) asm volatile ("hlt");
+	cycles = rdtsc() - start;
+
+	if (cycles < 4 * (uint64_t)tsc_per_tick || cycles > 6 * (uint64_t)tsc_per_tick) result = FAIL;
+	return result;
+}
+
+/* SMP test - Checks the processors started at boot and the kernel lock
+ * Expectation: The tests run on the boot processor, every processor the
+ *              firmware lists is online with its own TSS, and the kernel
+ *              lock is held exactly while interrupts are off
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Turns interrupts off for a moment
+ * Coverage: smp_init, ap_main, this_cpu, kernel_lock, kernel_unlock,
+ *           cli_and_save, restore_flags, sched_pick_cpu
+ * Files: smp.c/h, lib.h, scheduling.c/h
+ */
+int smp_test(){
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t flags, n = 0;
+	int32_t i, cpu;
+
+	if (this_cpu() != &cpus[0]) result = FAIL;
+	for (i = 0; i < MAX_CPUS; i++) {
+		if (!cpus[i].online) continue;
+		n++;
+		if (cpus[i].id != i) result = FAIL;
+		if (i > 0 && (!cpus[i].scheduling || cpus[i].tss == cpus[0].tss)) result = FAIL;
+	}
+	if (apic_enabled && n != apic_num_cpus) result = FAIL;
+
+	// Interrupts are on here, so the lock is free until cli
+	if (kernel_lock_held()) result = FAIL;
+	cli_and_save(flags);
+	if (!kernel_lock_held()) result = FAIL;
+	cli();
+	if (!kernel_lock_held()) result = FAIL;
+	cpu = sched_pick_cpu();
+	restore_flags(flags);
+	if (kernel_lock_held()) result = FAIL;
+
+	if (cpu < 0 || cpu >= MAX_CPUS || !cpus[cpu].online) result = FAIL;
+	printf("%d processors online\n", n);
+	return result;
+}
+
+/* IPI test - Parks each other processor with the vidmap IPI and lets it go
+ * Expectation: Every other processor parks within 10ms and runs again
+ *              after vidmap_resume
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Clears vidmap on the other processors, which run no process yet
+ * Coverage: asm_vidmap, vidmap_ipi, vidmap_park, vidmap_resume
+ * Files: smp.c/h, asm_linkage.S, init_idt.c
+ */
+int ipi_test(){
+	TEST_HEADER;
+	int result = PASS;
+	int32_t i;
+	uint64_t start;
+
+	for (i = 1; i < MAX_CPUS; i++) {
+		if (!cpus[i].online) continue;
+
+		cpus[i].vidmap_sync = VIDMAP_STOP;
+		lapic_send_ipi(cpus[i].apic_id, LAPIC_ICR_FIXED | VIDMAP_VECTOR);
+		start = rdtsc();
+		while (cpus[i].vidmap_sync == VIDMAP_STOP && rdtsc() - start < (uint64_t) tsc_khz * 10);
+		if (cpus[i].vidmap_sync != VIDMAP_PARKED) result = FAIL;
+
+		vidmap_resume();
+		cpus[i].vidmap_sync = VIDMAP_RUN;
+	}
+	return result;
+}
+
+/* Terminal mode test - A child killed in raw mode hands the terminal back
+ * Expectation: Only the process that switched to raw mode puts the terminal
+ *              back in cooked mode when it ends
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Changes the active terminal's mode for a moment
+ * Coverage: terminal_set_mode, terminal_release
+ * Files: terminal_driver.c/h
+ */
+int terminal_mode_test(){
+	TEST_HEADER;
+	int result = PASS;
+	terms_t *term = &terminal_data[active_terminal];
+	int32_t child = MAX_PROCESSES - 1;
+
+	if (terminal_set_mode(TERM_MODE_RAW) || term->raw_pid != curr_pid) result = FAIL;
+	if (terminal_set_mode(TERM_MODE_COOKED) || term->raw_pid != -1) result = FAIL;
+
+	// What kill_current_proc does for a child that Ctrl+C stopped in raw mode
+	term->mode = TERM_MODE_RAW;
+	term->raw_pid = child;
+	terminal_release(active_terminal, child - 1);
+	if (term->mode != TERM_MODE_RAW) result = FAIL;
+	terminal_release(active_terminal, child);
+	if (term->mode != TERM_MODE_COOKED || term->raw_pid != -1) result = FAIL;
+
+	return result;
+}
+
+/* Unlink while open test - Removes a file that a descriptor still has open
+ * Expectation: The name goes away at once, but the open file keeps reading
+ *              its own data and the inode is only freed on the last close
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Creates and removes "held.tmp"
+ * Coverage: fs_unlink, tmpfs_open, tmpfs_close, file_open, file_close
+ * Files: fs.c/h, tmpfs.c/h
+ */
+int unlink_open_test(){
+	TEST_HEADER;
+	int result = PASS;
+	file_desc_t file;
+	dentry_t d;
+	uint8_t buf[8];
+	int32_t inode = fs_create((uint8_t*)"held.tmp");
+
+	if (inode < 0) return FAIL;
+	file.ftable = &file_regular_ftable;
+	if (file.ftable->open(&file, (uint8_t*)"held.tmp")) return FAIL;
+	if (file.ftable->write(&file, "abcd", 4) != 4) result = FAIL;
+
+	if (fs_unlink((uint8_t*)"held.tmp")) result = FAIL;
+	if (read_dentry_by_name((uint8_t*)"held.tmp", &d) != -1) result = FAIL;
+	if (tmpfs_size(inode) != 4) result = FAIL;
+	if (file.ftable->read(&file, buf, 8) != 0) result = FAIL;	// at the end
+	if (file_pread(&file, buf, 8, 0) != 4 || strncmp((int8_t*)buf, "abcd", 4)) result = FAIL;
+
+	file.ftable->close(&file);
+	if (tmpfs_size(inode) != -1) result = FAIL;
+
+	return result;
+}
 
 /* Test suite entry point */
 void launch_tests(){
@@ -363,6 +1186,29 @@ void launch_tests(){
 	//TEST_OUTPUT("pagefault_test", pagefault_test());
 	//TEST_OUTPUT("rtc_test", rtc_test());
 	//TEST_OUTPUT("terminal_driver_test", terminal_driver_test());
+	//TEST_OUTPUT("pipe_test", pipe_test());
+	//TEST_OUTPUT("tmpfs_test", tmpfs_test());
+	//TEST_OUTPUT("dir_tree_test", dir_tree_test());
+	//TEST_OUTPUT("getdents_test", getdents_test());
+	//TEST_OUTPUT("stat_test", stat_test());
+	//TEST_OUTPUT("lseek_test", lseek_test());
+	//TEST_OUTPUT("fd_table_test", fd_table_test());
+	//TEST_OUTPUT("open_file_test", open_file_test());
+	//TEST_OUTPUT("pcache_test", pcache_test());
+	//TEST_OUTPUT("readahead_test", readahead_test());
+	//TEST_OUTPUT("mmap_page_test", mmap_page_test());
+	//TEST_OUTPUT("ata_test", ata_test());
+	//TEST_OUTPUT("blkq_test", blkq_test());
+	//TEST_OUTPUT("signal_test", signal_test());
+	//TEST_OUTPUT("timer_test", timer_test());
+	//TEST_OUTPUT("tsc_test", tsc_test());
+	//TEST_OUTPUT("rtc_deadline_test", rtc_deadline_test());
+	//TEST_OUTPUT("apic_test", apic_test());
+	//TEST_OUTPUT("smp_test", smp_test());
+	//TEST_OUTPUT("terminal_mode_test", terminal_mode_test());
+	//TEST_OUTPUT("unlink_open_test", unlink_open_test());
+	//TEST_OUTPUT("mmap_limit_test", mmap_limit_test());
+	//TEST_OUTPUT("ipi_test", ipi_test());
 
 
 	clear_reset_cursor(); //clear screen
@@ -0,0 +1,163 @@
+/* timer.c - Kernel timers
+ * A wheel of TIMER_WHEEL_SLOTS lists driven by the PIT. A timer waits in
+ * the list for its expiry tick modulo the wheel size; each tick walks the
+ * one list for the current tick and fires the timers that are due, so
+ * timers further away than one turn of the wheel just stay put. */
+
+#include "timer.h"
+#include "lib.h"
+#include "scheduling.h"
+
+#define PIT_CH2_DATA    0x42
+#define PIT_CH2_MODE    0xB0    // channel 2, low then high byte, mode 0 (count down once)
+#define PIT_CH2_PORT    0x61    // bit 0 gates channel 2, bit 1 drives the speaker from it
+#define PIT_CH2_OUT     0x20    // channel 2 output, high once the count is done
+
+static timer_t* wheel[TIMER_WHEEL_SLOTS];
+
+uint32_t tsc_per_tick;
+uint32_t tsc_khz;
+
+// Private helper functions
+static void timer_unlink(timer_t *t);
+
+/** timer_init
+ * Empties the wheel.
+ * Inputs: none
+ * Return value: none
+ * Side effects: none
+ */
+void timer_init(void) {
+    int32_t i;
+
+    for (i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+        wheel[i] = NULL;
+    }
+}
+
+/** timer_setup
+ * Prepares a timer that isn't in the wheel.
+ * Inputs: t -- The timer
+ *         callback -- Function to run when it fires
+ *         data -- For the callback
+ * Return value: none
+ * Side effects: none
+ */
+void timer_setup(timer_t* t, void (*callback)(timer_t* t), void* data) {
+    t->callback = callback;
+    t->data = data;
+    t->pending = 0;
+    t->next = NULL;
+    t->prev = NULL;
+}
+
+/** timer_add
+ * Starts a timer, or moves it if it's already running.
+ * Inputs: t -- A timer set up with timer_setup
+ *         expires -- Tick to fire at. A tick that has already come fires
+ *                    on the next one
+ * Return value: none
+ * Side effects: Safe in interrupt context, including the timer's callback
+ */
+void timer_add(timer_t* t, uint32_t expires) {
+    uint32_t flags;
+    timer_t **slot;
+
+    cli_and_save(flags);
+    if (t->pending) timer_unlink(t);
+
+    if ((int32_t)(expires - pit_ticks) <= 0) expires = pit_ticks + 1;
+    t->expires = expires;
+    t->pending = 1;
+
+    slot = &wheel[expires & (TIMER_WHEEL_SLOTS - 1)];
+    t->prev = NULL;
+    t->next = *slot;
+    if (*slot != NULL) (*slot)->prev = t;
+    *slot = t;
+    restore_flags(flags);
+}
+
+/** timer_del
+ * Stops a timer.
+ * Inputs: t -- A timer set up with timer_setup
+ * Return value: Ticks it had left, 0 if it wasn't running
+ * Side effects: none
+ */
+uint32_t timer_del(timer_t* t) {
+    uint32_t flags, left = 0;
+
+    cli_and_save(flags);
+    if (t->pending) {
+        left = t->expires - pit_ticks;
+        timer_unlink(t);
+    }
+    restore_flags(flags);
+    return left;
+}
+
+/** timer_tick
+ * Fires the timers due at the current tick. Called by the PIT handler
+ * after counting the tick.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Runs in interrupt context with interrupts off
+ */
+void timer_tick(void) {
+    timer_t *t;
+    uint32_t now = pit_ticks;
+
+    // One at a time from the head, since a callback may add or remove timers
+    do {
+        for (t = wheel[now & (TIMER_WHEEL_SLOTS - 1)]; t != NULL; t = t->next) {
+            if (t->expires == now) break;
+        }
+        if (t != NULL) {
+            timer_unlink(t);
+            t->callback(t);
+        }
+    } while (t != NULL);
+}
+
+/** tsc_init
+ * Measures the TSC rate: counts the cycles while PIT channel 2 counts
+ * down one tick's worth.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Busy-waits for 10 ms. Uses channel 2, which only drives
+ *               the PC speaker
+ */
+void tsc_init(void) {
+    uint32_t port = inb(PIT_CH2_PORT);
+    uint64_t start;
+
+    outb((port & ~0x02) | 0x01, PIT_CH2_PORT);     // gate on, speaker off
+    outb(PIT_CH2_MODE, PIT_CMD);
+    outb(DIV_HZ & 0xFF, PIT_CH2_DATA);
+    outb(DIV_HZ >> 8, PIT_CH2_DATA);
+
+    start = rdtsc();
+    while (!(inb(PIT_CH2_PORT) & PIT_CH2_OUT));
+    tsc_per_tick = (uint32_t)(rdtsc() - start);
+    tsc_khz = tsc_per_tick / MS_PER_TICK;
+
+    outb(port, PIT_CH2_PORT);
+}
+
+/** static timer_unlink
+ * Removes a timer from its wheel slot.
+ * Inputs: t -- A pending timer
+ * Return value: none
+ * Side effects: Interrupts must be off
+ */
+static void timer_unlink(timer_t *t) {
+    if (t->prev != NULL) {
+        t->prev->next = t->next;
+    } else {
+        wheel[t->expires & (TIMER_WHEEL_SLOTS - 1)] = t->next;
+    }
+    if (t->next != NULL) t->next->prev = t->prev;
+    t->pending = 0;
+    t->next = NULL;
+    t->prev = NULL;
+}
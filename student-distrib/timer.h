@@ -0,0 +1,32 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "types.h"
+
+#define TIMER_WHEEL_SLOTS   64      // power of two
+
+/* A callback run from the PIT interrupt once pit_ticks reaches expires.
+ * Timers are kept in a wheel of lists by expires % TIMER_WHEEL_SLOTS, so
+ * adding and removing one takes constant time and each tick only looks
+ * at one list. */
+typedef struct timer {
+    uint32_t expires;               // pit_ticks value it fires at
+    void (*callback)(struct timer* t);  // called with interrupts off
+    void* data;                     // for the callback
+    int32_t pending;                // 1 while it's in the wheel
+    struct timer* next;
+    struct timer* prev;
+} timer_t;
+
+/* TSC cycles in a PIT tick and in a millisecond, measured at boot */
+extern uint32_t tsc_per_tick;
+extern uint32_t tsc_khz;
+
+extern void timer_init(void);
+extern void timer_setup(timer_t* t, void (*callback)(timer_t* t), void* data);
+extern void timer_add(timer_t* t, uint32_t expires);
+extern uint32_t timer_del(timer_t* t);
+extern void timer_tick(void);
+extern void tsc_init(void);
+
+#endif
@@ -0,0 +1,498 @@
+#include "tmpfs.h"
+#include "lib.h"
+
+#define BITMAP_WORDS (TMPFS_BLOCKS / 32)
+#define ROOT_SLOT TMPFS_MAX_INODES  // name index of the root directory
+
+/** Inodes of the writable layer. Array index i is inode TMPFS_INODE_BASE + i. */
+tmpfs_inode_t tmpfs_inodes[TMPFS_MAX_INODES];
+/** Directory entries of the writable layer. Entry i names inode i, and is
+ *  free when its name is empty. The directory holding it is the inode's parent. */
+static dentry_t tmpfs_entries[TMPFS_MAX_INODES];
+/** Name index of each directory: a hash table of its entries. Slot i belongs
+ *  to directory inode i, slot ROOT_SLOT to the root. Buckets and chains hold
+ *  entry + 1, so 0 ends a chain. */
+static uint16_t dir_index[TMPFS_MAX_INODES + 1][TMPFS_DIR_BUCKETS];
+static uint16_t entry_next[TMPFS_MAX_INODES];
+
+/** Data blocks in use - bit i set if block i is allocated */
+static uint32_t block_bitmap[BITMAP_WORDS];
+/** Bitmap word where the next block search starts */
+static uint32_t block_hint;
+/** Inode where the next inode search starts, so freed inodes aren't reused right away */
+static uint32_t inode_hint;
+
+// Private helper functions
+static tmpfs_inode_t *get_inode(uint32_t inode);
+static uint8_t *get_block(uint16_t id);
+static int32_t alloc_block(void);
+static void free_block(uint16_t id);
+static int32_t dir_slot(uint32_t dir);
+static uint32_t bucket(const uint8_t* fname);
+static void index_add(int32_t slot, int32_t i);
+static void index_remove(int32_t slot, int32_t i);
+static int32_t find_entry(uint32_t dir, const uint8_t* fname);
+static void free_inode(int32_t i);
+
+/** tmpfs_init
+ * Initialize the writable layer with no files.
+ * Inputs: none
+ * Return value: none
+ * Side effects: Clears all inodes, entries and blocks
+ */
+void tmpfs_init(void) {
+    memset(tmpfs_inodes, 0, sizeof(tmpfs_inodes));
+    memset(tmpfs_entries, 0, sizeof(tmpfs_entries));
+    memset(dir_index, 0, sizeof(dir_index));
+    memset(entry_next, 0, sizeof(entry_next));
+    memset(block_bitmap, 0, sizeof(block_bitmap));
+    block_hint = 0;
+    inode_hint = 0;
+}
+
+/** tmpfs_lookup
+ * Reads the directory entry of a file in the writable layer.
+ * Inputs: dir -- Directory inode (ROOT_DIR_INODE or a writable directory)
+ *         fname -- Null-terminated filename
+ * Outputs: dentry -- Buffer to store the resulting dentry_t
+ * Return value: 0 on success, -1 if there is no such file
+ * Side effects: Overwrites dentry
+ */
+int32_t tmpfs_lookup(uint32_t dir, const uint8_t* fname, dentry_t* dentry) {
+    int32_t i = find_entry(dir, fname);
+    if (i < 0) return -1;
+
+    memcpy(dentry, &tmpfs_entries[i], sizeof(dentry_t));
+    return 0;
+}
+
+/** tmpfs_dentry_by_index
+ * Reads the index-th file of a directory in the writable layer, counting
+ * only used entries.
+ * Inputs: dir -- Directory inode (ROOT_DIR_INODE or a writable directory)
+ *         index -- Index of the file
+ * Outputs: dentry -- Buffer to store the resulting dentry_t
+ * Return value: 0 on success, -1 if there are not that many files
+ * Side effects: Overwrites dentry
+ */
+int32_t tmpfs_dentry_by_index(uint32_t dir, uint32_t index, dentry_t* dentry) {
+    int32_t i;
+
+    for (i = 0; i < TMPFS_MAX_INODES; i++) {
+        if (tmpfs_entries[i].name[0] == '\0' || tmpfs_inodes[i].parent != dir) continue;
+        if (index-- == 0) {
+            memcpy(dentry, &tmpfs_entries[i], sizeof(dentry_t));
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/** tmpfs_create
+ * Creates an empty regular file or directory. If a regular file of that
+ * name already exists and a regular file is wanted, it is truncated instead.
+ * Inputs: dir -- Directory to create it in (ROOT_DIR_INODE or a writable directory)
+ *         fname -- Null-terminated filename, at most DENTRY_NAME_LEN characters
+ *         type -- FILE_REGULAR or FILE_DIRECTORY
+ * Return value: Inode number of the file, or -1 if failed
+ * Side effects: May allocate an inode, or free the file's blocks
+ */
+int32_t tmpfs_create(uint32_t dir, const uint8_t* fname, uint32_t type) {
+    uint32_t flags, len;
+    int32_t i, n, slot;
+
+    len = strlen((const int8_t*) fname);
+    if (len == 0 || len > DENTRY_NAME_LEN) return -1;
+    if (type != FILE_REGULAR && type != FILE_DIRECTORY) return -1;
+
+    slot = dir_slot(dir);
+    if (slot < 0) return -1;
+
+    i = find_entry(dir, fname);
+    if (i >= 0) {
+        if (type != FILE_REGULAR || tmpfs_inodes[i].type != FILE_REGULAR) return -1;
+        tmpfs_truncate(TMPFS_INODE_BASE + i, 0);
+        return TMPFS_INODE_BASE + i;
+    }
+
+    cli_and_save(flags);
+    for (n = 0; n < TMPFS_MAX_INODES; n++) {
+        i = (inode_hint + n) % TMPFS_MAX_INODES;
+        if (!tmpfs_inodes[i].used) break;
+    }
+    if (n >= TMPFS_MAX_INODES) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    tmpfs_inodes[i].used = 1;
+    tmpfs_inodes[i].nopen = 0;
+    tmpfs_inodes[i].unlinked = 0;
+    tmpfs_inodes[i].type = type;
+    tmpfs_inodes[i].parent = dir;
+    tmpfs_inodes[i].nentries = 0;
+    tmpfs_inodes[i].size = 0;
+    tmpfs_inodes[i].nblocks = 0;
+    if (type == FILE_DIRECTORY) memset(dir_index[i], 0, sizeof(dir_index[i]));
+
+    memset(&tmpfs_entries[i], 0, sizeof(dentry_t));
+    strncpy(tmpfs_entries[i].name, (const int8_t*) fname, DENTRY_NAME_LEN);
+    tmpfs_entries[i].type = type;
+    tmpfs_entries[i].inode = TMPFS_INODE_BASE + i;
+
+    index_add(slot, i);
+    if (slot != ROOT_SLOT) tmpfs_inodes[slot].nentries++;
+
+    inode_hint = (i + 1) % TMPFS_MAX_INODES;
+    restore_flags(flags);
+
+    return TMPFS_INODE_BASE + i;
+}
+
+/** tmpfs_unlink
+ * Removes a file or an empty directory from the writable layer and frees
+ * its blocks. A file that is still open keeps its inode and blocks until
+ * the last open file using it is closed, so its inode number can't be
+ * given to a new file while descriptors still name it.
+ * Inputs: dir -- Directory holding the file
+ *         fname -- Null-terminated filename
+ * Return value: 0 on success, -1 if there is no such file or the
+ *               directory isn't empty
+ * Side effects: Frees the file's inode and blocks, or marks it unlinked
+ */
+int32_t tmpfs_unlink(uint32_t dir, const uint8_t* fname) {
+    uint32_t flags;
+    int32_t i = find_entry(dir, fname);
+    int32_t slot = dir_slot(dir);
+    if (i < 0) return -1;
+    if (tmpfs_inodes[i].type == FILE_DIRECTORY && tmpfs_inodes[i].nentries > 0) return -1;
+
+    cli_and_save(flags);
+    index_remove(slot, i);
+    if (slot != ROOT_SLOT) tmpfs_inodes[slot].nentries--;
+    tmpfs_entries[i].name[0] = '\0';
+    if (tmpfs_inodes[i].nopen > 0) {
+        tmpfs_inodes[i].unlinked = 1;
+    } else {
+        free_inode(i);
+    }
+    restore_flags(flags);
+
+    return 0;
+}
+
+/** tmpfs_open
+ * Counts an open file using an inode of the writable layer.
+ * Inputs: inode -- Inode number of the file or directory
+ * Return value: none
+ * Side effects: Keeps the inode from being freed until tmpfs_close
+ */
+void tmpfs_open(uint32_t inode) {
+    tmpfs_inode_t *file = get_inode(inode);
+    uint32_t flags;
+
+    if (file == NULL) return;
+    cli_and_save(flags);
+    file->nopen++;
+    restore_flags(flags);
+}
+
+/** tmpfs_close
+ * Drops an open file counted by tmpfs_open. The last one to go frees an
+ * inode that was unlinked while open.
+ * Inputs: inode -- Inode number of the file or directory
+ * Return value: none
+ * Side effects: May free the inode and its blocks
+ */
+void tmpfs_close(uint32_t inode) {
+    tmpfs_inode_t *file = get_inode(inode);
+    uint32_t flags;
+
+    if (file == NULL) return;
+    cli_and_save(flags);
+    if (file->nopen > 0 && --file->nopen == 0 && file->unlinked) {
+        free_inode(inode - TMPFS_INODE_BASE);
+    }
+    restore_flags(flags);
+}
+
+/** tmpfs_parent
+ * Get the directory holding a directory. The root is its own parent.
+ * Inputs: dir -- Directory inode (ROOT_DIR_INODE or a writable directory)
+ * Return value: Inode of the parent directory, or -1 if dir isn't a directory
+ * Side effects: none
+ */
+int32_t tmpfs_parent(uint32_t dir) {
+    int32_t slot = dir_slot(dir);
+
+    if (slot < 0) return -1;
+    if (slot == ROOT_SLOT) return ROOT_DIR_INODE;
+    return tmpfs_inodes[slot].parent;
+}
+
+/** tmpfs_truncate
+ * Shrinks a file, freeing the blocks past its new end.
+ * Inputs: inode -- Inode number of the file
+ *         size -- New size in bytes; larger than the file does nothing
+ * Return value: 0 on success, -1 if bad inode
+ * Side effects: Frees blocks
+ */
+int32_t tmpfs_truncate(uint32_t inode, uint32_t size) {
+    tmpfs_inode_t *file = get_inode(inode);
+    uint32_t keep;
+
+    if (file == NULL) return -1;
+    if (size >= file->size) return 0;
+
+    keep = (size + DATA_BLOCK_SIZE - 1) / DATA_BLOCK_SIZE;
+    while (file->nblocks > keep) {
+        free_block(file->blocks[--file->nblocks]);
+    }
+
+    // Clear the tail of the last block so growing the file again reads zeros
+    if (size % DATA_BLOCK_SIZE != 0) {
+        uint8_t *block = get_block(file->blocks[keep - 1]);
+        memset(block + size % DATA_BLOCK_SIZE, 0, DATA_BLOCK_SIZE - size % DATA_BLOCK_SIZE);
+    }
+
+    file->size = size;
+    return 0;
+}
+
+/** tmpfs_read
+ * Reads data from a file in the writable layer, stopping at end of file.
+ * Inputs: inode -- Inode number of the file
+ *         offset -- The byte offset to begin reading
+ *         length -- The number of bytes to read
+ * Outputs: buf -- Buffer to store the resulting data
+ * Return value: The number of bytes actually read, or -1 if bad inode
+ * Side effects: Overwrites buf
+ */
+int32_t tmpfs_read(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length) {
+    tmpfs_inode_t *file = get_inode(inode);
+    uint32_t count = 0;
+
+    if (file == NULL) return -1;
+    if (offset >= file->size) return 0;
+    if (length > file->size - offset) length = file->size - offset;
+
+    while (count < length) {
+        uint32_t blockoffset = (offset + count) % DATA_BLOCK_SIZE;
+        uint32_t readlen = length - count;
+        uint8_t *block = get_block(file->blocks[(offset + count) / DATA_BLOCK_SIZE]);
+
+        if (readlen > DATA_BLOCK_SIZE - blockoffset)
+            readlen = DATA_BLOCK_SIZE - blockoffset;
+
+        memcpy(buf + count, block + blockoffset, readlen);
+        count += readlen;
+    }
+
+    return count;
+}
+
+/** tmpfs_write
+ * Writes data to a file in the writable layer, growing it as needed.
+ * Writing past the end of the file leaves a hole of zeros.
+ * Inputs: inode -- Inode number of the file
+ *         offset -- The byte offset to begin writing
+ *         buf -- Data to write
+ *         length -- The number of bytes to write
+ * Return value: The number of bytes written (less than length if the file
+ *               or the layer is full), or -1 if nothing could be written
+ * Side effects: May allocate blocks
+ */
+int32_t tmpfs_write(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length) {
+    tmpfs_inode_t *file = get_inode(inode);
+    uint32_t count = 0;
+    uint32_t end;
+
+    if (file == NULL) return -1;
+    if (length == 0) return 0;
+    if (offset >= TMPFS_MAX_FILE_SIZE) return -1;
+    if (length > TMPFS_MAX_FILE_SIZE - offset) length = TMPFS_MAX_FILE_SIZE - offset;
+
+    // Allocate every block up to the end of the write
+    end = offset + length;
+    while (file->nblocks * DATA_BLOCK_SIZE < end) {
+        int32_t id = alloc_block();
+        if (id < 0) break;
+        memset(get_block(id), 0, DATA_BLOCK_SIZE);
+        file->blocks[file->nblocks++] = id;
+    }
+
+    // Out of blocks: write what fits
+    if (end > file->nblocks * DATA_BLOCK_SIZE) end = file->nblocks * DATA_BLOCK_SIZE;
+    if (offset >= end) return -1;
+    length = end - offset;
+
+    while (count < length) {
+        uint32_t blockoffset = (offset + count) % DATA_BLOCK_SIZE;
+        uint32_t writelen = length - count;
+        uint8_t *block = get_block(file->blocks[(offset + count) / DATA_BLOCK_SIZE]);
+
+        if (writelen > DATA_BLOCK_SIZE - blockoffset)
+            writelen = DATA_BLOCK_SIZE - blockoffset;
+
+        memcpy(block + blockoffset, buf + count, writelen);
+        count += writelen;
+    }
+
+    if (end > file->size) file->size = end;
+    return count;
+}
+
+/** tmpfs_size
+ * Get the size of a file in the writable layer.
+ * Inputs: inode -- Inode number of the file
+ * Return value: File size in bytes, or -1 if bad inode
+ * Side effects: none
+ */
+int32_t tmpfs_size(uint32_t inode) {
+    tmpfs_inode_t *file = get_inode(inode);
+    if (file == NULL) return -1;
+    return file->size;
+}
+
+/** static get_inode
+ * Get a pointer to an inode of the writable layer.
+ * Inputs: inode -- Inode number
+ * Return value: Pointer to the inode, or null if out of range or free.
+ * Side effects: none
+ */
+static tmpfs_inode_t *get_inode(uint32_t inode) {
+    if (!IS_TMPFS_INODE(inode) || inode - TMPFS_INODE_BASE >= TMPFS_MAX_INODES) return NULL;
+    if (!tmpfs_inodes[inode - TMPFS_INODE_BASE].used) return NULL;
+    return &tmpfs_inodes[inode - TMPFS_INODE_BASE];
+}
+
+/** static get_block
+ * Get a pointer to a data block of the writable layer.
+ * Inputs: id -- Block number
+ * Return value: Pointer to the block
+ * Side effects: none
+ */
+static uint8_t *get_block(uint16_t id) {
+    return (uint8_t*) (TMPFS_START + id * DATA_BLOCK_SIZE);
+}
+
+/** static alloc_block
+ * Allocate a data block. The search starts at the word where the last
+ * block was found, so a run of allocations doesn't rescan full words.
+ * Inputs: none
+ * Return value: Block number, or -1 if every block is in use
+ * Side effects: Marks the block as used; contents are not cleared
+ */
+static int32_t alloc_block(void) {
+    uint32_t flags;
+    int32_t id;
+
+    cli_and_save(flags);
+    id = find_first_zero(&block_bitmap[block_hint], (BITMAP_WORDS - block_hint) * 32);
+    if (id >= 0) {
+        id += block_hint * 32;
+    } else {
+        // Wrap around to the words before the hint
+        id = find_first_zero(block_bitmap, block_hint * 32);
+    }
+
+    if (id >= 0) {
+        block_bitmap[id / 32] |= (1 << (id % 32));
+        block_hint = id / 32;
+    }
+    restore_flags(flags);
+
+    return id;
+}
+
+/** static free_block
+ * Return a data block to the free bitmap.
+ * Inputs: id -- Block number from alloc_block()
+ * Return value: none
+ * Side effects: Marks the block as free
+ */
+static void free_block(uint16_t id) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    block_bitmap[id / 32] &= ~(1 << (id % 32));
+    restore_flags(flags);
+}
+
+/** static dir_slot
+ * Get the name index slot of a directory.
+ * Inputs: dir -- Directory inode
+ * Return value: Slot in dir_index, or -1 if dir isn't a directory or
+ *               was unlinked
+ * Side effects: none
+ */
+static int32_t dir_slot(uint32_t dir) {
+    tmpfs_inode_t *inode;
+
+    if (dir == ROOT_DIR_INODE) return ROOT_SLOT;
+    inode = get_inode(dir);
+    if (inode == NULL || inode->type != FILE_DIRECTORY || inode->unlinked) return -1;
+    return dir - TMPFS_INODE_BASE;
+}
+
+/** static bucket
+ * Name index bucket of a filename.
+ */
+static uint32_t bucket(const uint8_t* fname) {
+    return strnhash((const int8_t*) fname, DENTRY_NAME_LEN) & (TMPFS_DIR_BUCKETS - 1);
+}
+
+/** static index_add
+ * Add entry i to a directory's name index. Interrupts must be off.
+ */
+static void index_add(int32_t slot, int32_t i) {
+    uint16_t *head = &dir_index[slot][bucket((const uint8_t*) tmpfs_entries[i].name)];
+
+    entry_next[i] = *head;
+    *head = i + 1;
+}
+
+/** static index_remove
+ * Remove entry i from a directory's name index. Interrupts must be off.
+ */
+static void index_remove(int32_t slot, int32_t i) {
+    uint16_t *link = &dir_index[slot][bucket((const uint8_t*) tmpfs_entries[i].name)];
+
+    while (*link != i + 1) link = &entry_next[*link - 1];
+    *link = entry_next[i];
+    entry_next[i] = 0;
+}
+
+/** static find_entry
+ * Find the directory entry of a file in the writable layer through the
+ * directory's name index.
+ * Inputs: dir -- Directory inode
+ *         fname -- Null-terminated filename
+ * Return value: Entry index, or -1 if not found
+ * Side effects: none
+ */
+static int32_t find_entry(uint32_t dir, const uint8_t* fname) {
+    uint32_t len = strlen((const int8_t*) fname);
+    int32_t slot = dir_slot(dir);
+    uint16_t e;
+
+    if (len == 0 || len > DENTRY_NAME_LEN || slot < 0) return -1;
+
+    for (e = dir_index[slot][bucket(fname)]; e != 0; e = entry_next[e - 1]) {
+        if (strnlen(tmpfs_entries[e - 1].name, DENTRY_NAME_LEN) == len &&
+            strncmp(tmpfs_entries[e - 1].name, (const int8_t*) fname, DENTRY_NAME_LEN) == 0) {
+            return e - 1;
+        }
+    }
+    return -1;
+}
+
+/** static free_inode
+ * Frees inode i and its blocks. Interrupts must be off.
+ */
+static void free_inode(int32_t i) {
+    tmpfs_truncate(TMPFS_INODE_BASE + i, 0);
+    tmpfs_inodes[i].used = 0;
+    tmpfs_inodes[i].nopen = 0;
+    tmpfs_inodes[i].unlinked = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include "types.h"
+#include "fs.h"
+#include "paging.h"
+
+/* The writable layer keeps its data blocks in a 4MB region of its own,
+ * identity mapped for the kernel only. */
+#define TMPFS_PAGE          18      // page directory entry of the block region
+#define TMPFS_START         (TMPFS_PAGE * PAGEDIR_STEP)
+#define TMPFS_BLOCKS        (PAGEDIR_STEP / DATA_BLOCK_SIZE)
+
+#define TMPFS_MAX_INODES    128
+#define TMPFS_FILE_BLOCKS   128     // max blocks in one file
+#define TMPFS_MAX_FILE_SIZE (TMPFS_FILE_BLOCKS * DATA_BLOCK_SIZE)
+#define TMPFS_DIR_BUCKETS   16      // name index buckets per directory, must be a power of 2
+
+/* Inode numbers from TMPFS_INODE_BASE up belong to the writable layer,
+ * everything below is an inode in the boot image. */
+#define TMPFS_INODE_BASE    0x10000
+#define IS_TMPFS_INODE(i)   ((uint32_t) (i) >= TMPFS_INODE_BASE)
+
+typedef struct tmpfs_inode {
+    uint32_t used;                          // 0 if the inode is free
+    uint32_t nopen;                         // open files using the inode
+    uint32_t unlinked;                      // 1 if removed while open, freed on the last close
+    uint32_t type;                          // FILE_REGULAR or FILE_DIRECTORY
+    uint32_t parent;                        // directory holding the inode's entry
+    uint32_t nentries;                      // entries in a directory
+    uint32_t size;                          // file size in bytes
+    uint32_t nblocks;                       // number of entries in blocks
+    uint16_t blocks[TMPFS_FILE_BLOCKS];     // data blocks, in file order
+} tmpfs_inode_t;
+
+extern void tmpfs_init(void);
+
+extern int32_t tmpfs_lookup(uint32_t dir, const uint8_t* fname, dentry_t* dentry);
+extern int32_t tmpfs_dentry_by_index(uint32_t dir, uint32_t index, dentry_t* dentry);
+extern int32_t tmpfs_create(uint32_t dir, const uint8_t* fname, uint32_t type);
+extern int32_t tmpfs_unlink(uint32_t dir, const uint8_t* fname);
+extern int32_t tmpfs_parent(uint32_t dir);
+extern int32_t tmpfs_truncate(uint32_t inode, uint32_t size);
+extern void tmpfs_open(uint32_t inode);
+extern void tmpfs_close(uint32_t inode);
+
+extern int32_t tmpfs_read(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+extern int32_t tmpfs_write(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length);
+extern int32_t tmpfs_size(uint32_t inode);
+
+#endif
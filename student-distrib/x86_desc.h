@@ -15,10 +15,15 @@
 #define USER_DS     0x002B
 #define KERNEL_TSS  0x0030
 #define KERNEL_LDT  0x0038
+#define AP_TSS_BASE 0x0040  /* TSS of the second processor; the next ones follow */
+#define AP_TSS_COUNT 7      /* MAX_CPUS - 1 */
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
 
+/* Page below 1MB where the other processors start (boot.S, smp.c) */
+#define AP_TRAMPOLINE_ADDR 0x8000
+
 /* Number of vectors in the interrupt descriptor table (IDT) */
 #define NUM_VEC     256
 
@@ -123,6 +128,7 @@ extern uint32_t ldt;
 extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
+extern seg_desc_t ap_tss_desc_ptr[AP_TSS_COUNT];
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \
@@ -4,19 +4,50 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
-#define SBUFSIZE 33
+#define NENTRIES 16
 
-int32_t
-do_one_file (const char* s, const char* fname) 
+/* 
+ * Searches a file mapped with mmap. The mapping is read-only, so lines
+ * are compared and printed in place rather than NUL-terminated.
+ */
+static void
+search_mapped (const char* s, const char* fname, const uint8_t* data, int32_t cnt)
 {
-    int32_t fd, cnt, last, line_start, line_end, check, s_len;
-    uint8_t data[BUFSIZE+1];
+    int32_t line_start, line_end, len, check, s_len;
 
     s_len = ece391_strlen ((uint8_t*)s);
-    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
-        ece391_fdputs (1, (uint8_t*)"file open failed\n");
-        return -1;
+    for (line_start = 0; line_start < cnt; line_start = line_end + 1) {
+        line_end = line_start;
+	while (line_end < cnt && '\n' != data[line_end])
+	    line_end++;
+	for (check = line_start; check + s_len <= line_end; check++) {
+	    if (s[0] == data[check] && 
+		0 == ece391_strncmp (data + check, (uint8_t*)s, s_len)) {
+		/* print like ece391_fdputs would, up to any NUL */
+		len = 0;
+		while (line_start + len < line_end && '\0' != data[line_start + len])
+		    len++;
+		ece391_fdputs (1, (uint8_t*)fname);
+		ece391_fdputs (1, (uint8_t*)":");
+		ece391_write (1, data + line_start, len);
+		ece391_fdputs (1, (uint8_t*)"\n");
+		break;
+	    }
+	}
     }
+}
+
+/* 
+ * Searches a file BUFSIZE bytes at a time with read. Returns -1 if a
+ * read fails.
+ */
+static int32_t
+search_read (const char* s, const char* fname, int32_t fd)
+{
+    int32_t cnt, last, line_start, line_end, check, s_len;
+    uint8_t data[BUFSIZE+1];
+
+    s_len = ece391_strlen ((uint8_t*)s);
     last = 0;
     while (1) {
         cnt = ece391_read (fd, data + last, BUFSIZE - last);
@@ -58,6 +89,26 @@ do_one_file (const char* s, const char* fname)
 	if (0 == cnt)
 	    break;
     }
+    return 0;
+}
+
+int32_t
+do_one_file (const char* s, const char* fname) 
+{
+    int32_t fd, cnt;
+    uint8_t* data;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
+        ece391_fdputs (1, (uint8_t*)"file open failed\n");
+        return -1;
+    }
+    /* Regular files can be searched in place, without copying */
+    if (-1 != (cnt = ece391_mmap (fd, 0, &data))) {
+	search_mapped (s, fname, data, cnt);
+	ece391_munmap (data);
+    } else if (-1 == search_read (s, fname, fd)) {
+	return -1;
+    }
     if (-1 == ece391_close (fd)) {
         ece391_fdputs (1, (uint8_t*)"file close failed\n");
         return -1;
@@ -67,8 +118,8 @@ do_one_file (const char* s, const char* fname)
 
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, i;
+    struct ece391_dirent ents[NENTRIES];
     uint8_t search[BUFSIZE];
 
     if (0 != ece391_getargs (search, BUFSIZE)) {
@@ -81,16 +132,17 @@ int main ()
 	return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    while (0 != (cnt = ece391_getdents (fd, ents, sizeof (ents)))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	    return 3;
 	}
-	if ('.' == buf[0]) /* a directory... */
-	    continue;
-	buf[cnt] = '\0';
-	if (0 != do_one_file ((char*)search, (char*)buf))
-	    return 3;
+	for (i = 0; i < cnt / sizeof (struct ece391_dirent); i++) {
+	    if (2 != ents[i].type) /* only regular files */
+		continue;
+	    if (0 != do_one_file ((char*)search, (char*)ents[i].name))
+		return 3;
+	}
     }
 
     return 0;
@@ -3,26 +3,37 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
+#define NENTRIES 16
 #define SBUFSIZE 33
 
+/* "ls -l" also prints each file's size */
 int main ()
 {
-    int32_t fd, cnt;
+    int32_t fd, cnt, i, sizes;
+    struct ece391_dirent ents[NENTRIES];
     uint8_t buf[SBUFSIZE];
 
+    sizes = (0 == ece391_getargs (buf, SBUFSIZE) &&
+             0 == ece391_strcmp (buf, (uint8_t*)"-l"));
+
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
         return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    while (0 != (cnt = ece391_getdents (fd, ents, sizeof (ents)))) {
         if (-1 == cnt) {
 	        ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	        return 3;
 	    }
-	    buf[cnt] = '\n';
-	    if (-1 == ece391_write (1, buf, cnt + 1))
-	        return 3;
+	    for (i = 0; i < cnt / sizeof (struct ece391_dirent); i++) {
+	        ece391_fdputs (1, ents[i].name);
+	        if (sizes) {
+	            ece391_fdputs (1, (uint8_t*)" ");
+	            ece391_fdputs (1, ece391_itoa (ents[i].size, buf, 10));
+	        }
+	        ece391_fdputs (1, (uint8_t*)"\n");
+	    }
     }
 
     return 0;
@@ -4,14 +4,24 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define MAX_STAGES 8
+#define NULL 0
+
+static void report (int32_t rval);
+static void reap_jobs (void);
+static int32_t parse_redirects (uint8_t* cmd, uint8_t** in, uint8_t** out);
+static int32_t open_output (uint8_t* name);
+static void redirect (int32_t new_fd, int32_t fd);
+static void run_pipeline (uint8_t* cmd, int32_t background);
 
 int main ()
 {
-    int32_t cnt, rval;
+    int32_t cnt, background;
     uint8_t buf[BUFSIZE];
     ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
 
     while (1) {
+        reap_jobs ();
         ece391_fdputs (1, (uint8_t*)"391OS> ");
 	if (-1 == (cnt = ece391_read (0, buf, BUFSIZE-1))) {
 	    ece391_fdputs (1, (uint8_t*)"read from keyboard failed\n");
@@ -19,18 +29,244 @@ int main ()
 	}
 	if (cnt > 0 && '\n' == buf[cnt - 1])
 	    cnt--;
+	/* a trailing '&' runs the command in the background */
+	background = 0;
+	while (cnt > 0 && ' ' == buf[cnt - 1])
+	    cnt--;
+	if (cnt > 0 && '&' == buf[cnt - 1]) {
+	    background = 1;
+	    for (cnt--; cnt > 0 && ' ' == buf[cnt - 1]; cnt--);
+	}
 	buf[cnt] = '\0';
 	if (0 == ece391_strcmp (buf, (uint8_t*)"exit"))
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
-	rval = ece391_execute (buf);
-	if (-1 == rval)
-	    ece391_fdputs (1, (uint8_t*)"no such command\n");
-	else if (256 == rval)
-	    ece391_fdputs (1, (uint8_t*)"program terminated by exception\n");
-	else if (0 != rval)
-	    ece391_fdputs (1, (uint8_t*)"program terminated abnormally\n");
+	run_pipeline (buf, background);
+    }
+}
+
+static void
+report (int32_t rval)
+{
+    if (-1 == rval)
+	ece391_fdputs (1, (uint8_t*)"no such command\n");
+    else if (256 == rval)
+	ece391_fdputs (1, (uint8_t*)"program terminated by exception\n");
+    else if (0 != rval)
+	ece391_fdputs (1, (uint8_t*)"program terminated abnormally\n");
+}
+
+/*
+ * Reports background jobs that have finished since the last prompt.
+ */
+static void
+reap_jobs (void)
+{
+    uint8_t num[16];
+    int32_t pid, status;
+
+    while (-1 != (pid = ece391_waitpid (-1, &status, WNOHANG))) {
+        ece391_fdputs (1, (uint8_t*)"[");
+	ece391_fdputs (1, ece391_itoa (pid, num, 10));
+	ece391_fdputs (1, (uint8_t*)"] done\n");
     }
 }
 
+/*
+ * Pulls "< file" and "> file" out of a command, leaving just the program
+ * and its arguments. Redirections come after the arguments. Returns -1
+ * if one has no file name.
+ */
+static int32_t
+parse_redirects (uint8_t* cmd, uint8_t** in, uint8_t** out)
+{
+    uint8_t* start = cmd;
+    uint8_t** target;
+    uint8_t* end;
+
+    *in = NULL;
+    *out = NULL;
+    for (; '\0' != *cmd; cmd++) {
+        if ('<' != *cmd && '>' != *cmd)
+	    continue;
+	target = ('<' == *cmd ? in : out);
+	for (end = cmd; end > start && ' ' == end[-1]; )
+	    *--end = '\0';
+	*cmd++ = '\0';
+	while (' ' == *cmd)
+	    cmd++;
+	if ('\0' == *cmd || '<' == *cmd || '>' == *cmd)
+	    return -1;
+	*target = cmd;
+	while ('\0' != *cmd && ' ' != *cmd && '<' != *cmd && '>' != *cmd)
+	    cmd++;
+	if ('\0' == *cmd)
+	    break;
+	if (' ' == *cmd)
+	    *cmd = '\0';
+	else
+	    cmd--;	/* the loop looks at the next '<' or '>' */
+    }
+    return 0;
+}
+
+/*
+ * Opens a file for "> file", creating it or emptying it first. Files are
+ * created by writing their name to the directory they go in.
+ */
+static int32_t
+open_output (uint8_t* name)
+{
+    uint8_t dir[BUFSIZE];
+    uint8_t* base = name;
+    uint8_t* p;
+    int32_t fd;
+
+    for (p = name; '\0' != *p; p++)
+        if ('/' == *p)
+	    base = p + 1;
+    if (base == name) {
+        ece391_strcpy (dir, (uint8_t*)".");
+    } else if (base == name + 1) {
+        ece391_strcpy (dir, (uint8_t*)"/");
+    } else {
+        ece391_strcpy (dir, name);
+	dir[base - name - 1] = '\0';
+    }
+
+    if (-1 == (fd = ece391_open (dir)))
+        return -1;
+    if ((int32_t)ece391_strlen (base) != ece391_write (fd, base, ece391_strlen (base))) {
+        ece391_close (fd);
+	return -1;
+    }
+    ece391_close (fd);
+    return ece391_open (name);
+}
+
+/*
+ * Makes fd refer to the file opened on new_fd, and closes new_fd.
+ */
+static void
+redirect (int32_t new_fd, int32_t fd)
+{
+    ece391_dup2 (new_fd, fd);
+    ece391_close (new_fd);
+}
+
+/*
+ * Runs "cmd1 < in | cmd2 | ... > out", in the background if asked. Each
+ * command's stdout is a pipe that becomes the next command's stdin, and
+ * every command can also take its stdin from a file or send its stdout to
+ * one. Programs get the shell's descriptors 0 and 1 when they start. All
+ * the commands run at once, so a pipe only has to hold what the next
+ * command hasn't read yet.
+ */
+static void
+run_pipeline (uint8_t* cmd, int32_t background)
+{
+    uint8_t* stage[MAX_STAGES];
+    uint8_t* in[MAX_STAGES];
+    uint8_t* out[MAX_STAGES];
+    int32_t pid[MAX_STAGES];
+    uint8_t num[16];
+    uint8_t* end;
+    int32_t n_stages, i, fd, rval;
+    int32_t fds[2], saved_in, saved_out;
+
+    /* split at '|', dropping the spaces before it */
+    n_stages = 1;
+    stage[0] = cmd;
+    for (; '\0' != *cmd; cmd++) {
+        if ('|' != *cmd)
+	    continue;
+	if (MAX_STAGES == n_stages) {
+	    ece391_fdputs (1, (uint8_t*)"too many pipes\n");
+	    return;
+	}
+	*cmd = '\0';
+	for (end = cmd; end > stage[n_stages - 1] && ' ' == end[-1]; )
+	    *--end = '\0';
+	stage[n_stages++] = cmd + 1;
+    }
+
+    for (i = 0; i < n_stages; i++) {
+        if (-1 == parse_redirects (stage[i], &in[i], &out[i])) {
+	    ece391_fdputs (1, (uint8_t*)"missing file name\n");
+	    return;
+	}
+    }
+
+    if (!background && 1 == n_stages && NULL == in[0] && NULL == out[0]) {
+        report (ece391_execute (stage[0]));
+	return;
+    }
+
+    /* keep the terminal out of the programs' hands while they run */
+    if (-1 == (saved_in = ece391_dup (0)) ||
+        -1 == (saved_out = ece391_dup (1))) {
+	ece391_fdputs (1, (uint8_t*)"out of file descriptors\n");
+	return;
+    }
+    ece391_ioctl (saved_in, IOCTL_SET_CLOEXEC, 1);
+    ece391_ioctl (saved_out, IOCTL_SET_CLOEXEC, 1);
+
+    for (i = 0; i < n_stages; i++) {
+        pid[i] = -1;
+        fds[0] = -1;
+        if (i < n_stages - 1) {
+	    if (-1 == ece391_pipe (fds)) {
+		ece391_fdputs (1, (uint8_t*)"pipe failed\n");
+		break;
+	    }
+	    ece391_ioctl (fds[0], IOCTL_SET_CLOEXEC, 1);
+	    redirect (fds[1], 1);
+	}
+	rval = 0;
+	if (NULL != in[i]) {
+	    if (-1 == (fd = ece391_open (in[i])))
+		rval = -2;
+	    else
+		redirect (fd, 0);
+	}
+	if (NULL != out[i] && 0 == rval) {
+	    if (-1 == (fd = open_output (out[i])))
+		rval = -3;
+	    else
+		redirect (fd, 1);
+	}
+
+	if (0 == rval)
+	    pid[i] = ece391_spawn (stage[i], background ? SPAWN_BACKGROUND : 0);
+
+	/* only the program holds the write end now, so the next stage sees EOF */
+	ece391_dup2 (saved_out, 1);
+	ece391_dup2 (saved_in, 0);
+	if (-1 != fds[0])
+	    redirect (fds[0], 0);
+
+	if (-2 == rval)
+	    ece391_fdputs (1, (uint8_t*)"can't open input\n");
+	else if (-3 == rval)
+	    ece391_fdputs (1, (uint8_t*)"can't create output\n");
+	else if (-1 == pid[i])
+	    report (-1);
+    }
+
+    ece391_dup2 (saved_in, 0);
+    ece391_close (saved_in);
+    ece391_close (saved_out);
+
+    for (i = 0; i < n_stages; i++) {
+        if (-1 == pid[i])
+	    continue;
+	if (background) {
+	    ece391_fdputs (1, (uint8_t*)"[");
+	    ece391_fdputs (1, ece391_itoa (pid[i], num, 10));
+	    ece391_fdputs (1, (uint8_t*)"]\n");
+	} else if (-1 != ece391_waitpid (pid[i], &rval, 0)) {
+	    report (rval);
+	}
+    }
+}
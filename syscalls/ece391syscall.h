@@ -21,6 +21,125 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_ioctl (int32_t fd, int32_t request, int32_t arg);
+
+/* poll waits for any fd in the array to be ready; timeout in ms, < 0 waits forever */
+struct ece391_pollfd {
+	int32_t fd;
+	int16_t events;		/* POLLIN/POLLOUT wanted */
+	int16_t revents;	/* POLLIN/POLLOUT ready, or POLLNVAL, set by the kernel */
+};
+#if !defined(POLLIN)
+#define POLLIN	0x1
+#define POLLOUT	0x4
+#define POLLNVAL	0x20	/* fd isn't open; entries with fd < 0 are skipped */
+#endif
+
+extern int32_t ece391_poll (struct ece391_pollfd* fds, int32_t nfds, int32_t timeout);
+
+/* fds[0] is the read end, fds[1] the write end */
+extern int32_t ece391_pipe (int32_t fds[2]);
+extern int32_t ece391_dup (int32_t fd);
+extern int32_t ece391_dup2 (int32_t old_fd, int32_t new_fd);
+
+/* 
+ * Maps the named shared memory segment (created with the given size if it
+ * doesn't exist yet) and stores its address in *addr. Every process that
+ * maps a name gets the same memory at the same address.
+ */
+extern int32_t ece391_shmmap (const uint8_t* name, uint32_t size, uint8_t** addr);
+extern int32_t ece391_shmunmap (uint8_t* addr);
+
+/* 
+ * Files are created by writing their name to an open directory ("."),
+ * and removed with unlink. Only files created at run time can be removed.
+ */
+extern int32_t ece391_unlink (const uint8_t* filename);
+
+/* 
+ * Maps the first length bytes of an open file read-only (0 maps the whole
+ * file) and stores the address in *addr. Returns the number of bytes mapped,
+ * or -1 if it can't be mapped. A process can map at most 128KB at a time,
+ * and less while other programs hold mappings; read the file instead.
+ */
+extern int32_t ece391_mmap (int32_t fd, uint32_t length, uint8_t** addr);
+extern int32_t ece391_munmap (uint8_t* addr);
+
+/*
+ * Paths name files below the root: "dir/file", "/dir/file", with "." and
+ * "..". mkdir creates an empty directory; unlink removes it once empty.
+ */
+extern int32_t ece391_mkdir (const uint8_t* dirname);
+
+/*
+ * getdents fills buf with as many entries of an open directory as fit and
+ * returns the number of bytes filled, 0 once every entry has been read.
+ */
+struct ece391_dirent {
+	uint32_t inode;
+	uint32_t type;		/* 0 rtc, 1 directory, 2 regular file */
+	uint32_t size;		/* bytes in a regular file, 0 otherwise */
+	uint8_t name[33];	/* null-terminated */
+};
+
+extern int32_t ece391_getdents (int32_t fd, struct ece391_dirent* buf, int32_t nbytes);
+
+/* stat and fstat describe a file by path or by open descriptor */
+struct ece391_stat {
+	uint32_t inode;
+	uint32_t type;		/* 0 rtc, 1 directory, 2 regular file */
+	uint32_t size;		/* bytes in a regular file, 0 otherwise */
+	uint32_t blocks;	/* 4KB data blocks */
+};
+
+extern int32_t ece391_stat (const uint8_t* filename, struct ece391_stat* buf);
+extern int32_t ece391_fstat (int32_t fd, struct ece391_stat* buf);
+
+/*
+ * lseek moves a file's position (a directory's entry index) and returns
+ * the new position. pread reads at offset without moving the position.
+ */
+#define SEEK_SET	0	/* offset from the start */
+#define SEEK_CUR	1	/* offset from the current position */
+#define SEEK_END	2	/* offset from the end of a file */
+
+extern int32_t ece391_lseek (int32_t fd, int32_t offset, int32_t whence);
+extern int32_t ece391_pread (int32_t fd, void* buf, int32_t nbytes, int32_t offset);
+
+/*
+ * spawn starts a program like execute but returns its pid at once; the
+ * program runs alongside the caller. wait and waitpid (pid -1 for any
+ * child) collect a finished child's status: what it passed to halt, 256
+ * if it was killed, -1 if it couldn't be loaded.
+ */
+#define SPAWN_BACKGROUND	1	/* Ctrl+C doesn't stop the program */
+#define WNOHANG		1	/* waitpid returns -1 if no child has finished */
+
+extern int32_t ece391_spawn (const uint8_t* command, int32_t flags);
+extern int32_t ece391_wait (int32_t* status);
+extern int32_t ece391_waitpid (int32_t pid, int32_t* status, int32_t options);
+
+/*
+ * alarm sends the caller ALARM after ticks PIT ticks (100 per second);
+ * setitimer sends it again every interval ticks after that. Either one
+ * replaces the timer set before and returns the ticks it had left. 0
+ * ticks stops the timer. A blocking poll returns 0 when a handler is
+ * waiting to run.
+ */
+extern int32_t ece391_alarm (uint32_t ticks);
+extern int32_t ece391_setitimer (uint32_t ticks, uint32_t interval);
+
+/*
+ * nanosleep waits for the time in req. If a signal has to be acted on
+ * first, it returns -1 and stores the time that was left in rem, which
+ * may be NULL.
+ */
+struct ece391_timespec {
+	uint32_t sec;
+	uint32_t nsec;		/* 0 to 999999999 */
+};
+
+extern int32_t ece391_nanosleep (const struct ece391_timespec* req, struct ece391_timespec* rem);
 
 enum signums {
 	DIV_ZERO = 0,
@@ -31,5 +150,17 @@ enum signums {
 	NUM_SIGNALS
 };
 
+/* ioctl requests */
+enum ioctls {
+	IOCTL_SET_NONBLOCK = 1,	/* arg: 1 = reads that would wait return 0 on a terminal, -1 on a pipe */
+	IOCTL_TERM_SET_MODE,	/* arg: one of term_modes */
+	IOCTL_SET_CLOEXEC	/* arg: 1 = children started by execute don't get the fd */
+};
+
+enum term_modes {
+	TERM_MODE_COOKED = 0,	/* line-buffered and echoed */
+	TERM_MODE_RAW		/* each keystroke, unechoed */
+};
+
 #endif /* ECE391SYSCALL_H */
 
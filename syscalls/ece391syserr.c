@@ -7,6 +7,7 @@
 #define BIG_FD 1073741823
 #define BIG_NUM 1073741823
 #define NEG_NUM -1073741823
+#define MAX_FDS 512	/* size of a process's descriptor table */
 
 /* call_sys
  * This function calls the system call #(num)
@@ -91,29 +92,34 @@ int err_big_fd(void) {
 
 
 /* TEST 3 err_open_lots
- * calls open correctly seven times
+ * opens files until the descriptor table is full
  * prints "[TEST_NAME]: PASS" if behavior is EXPECTED
  *     and then returns 0
  * prints "[TEST_NAME]: FAIL" if behavior is UNEXPECTED
  *     and then returns 2
  */
 int err_open_lots(void) {
-    int32_t i, cnt = 0;
+    int32_t i, fd, cnt = 0, last = 1;
 	
-	// fd = 0,1 taken, so we should be able to open 6 files (2,3,4,5,6,7)
-	// the last file open should fail
-    for (i = 0; i < 7; i++) {
-	    if (-1 == ece391_open ((uint8_t*)".")) {
+	// fd = 0,1 taken, so we should be able to open MAX_FDS - 2 files
+	// and get them in order; the next open should fail
+    for (i = 0; i < MAX_FDS - 1; i++) {
+	    fd = ece391_open ((uint8_t*)".");
+	    if (-1 == fd) {
 			cnt++;
-        }
+        } else if (fd != last + 1) {
+			cnt = -MAX_FDS;
+		} else {
+			last = fd;
+		}
     }
     //close all fds that were just opened.
-    for(i = 2; i < 8; i++)
+    for(i = 2; i <= last; i++)
     {
     	ece391_close(i);
     }
     
-	if (cnt == 1) {
+	if (cnt == 1 && last == MAX_FDS - 1) {
 		ece391_fdputs(1, (uint8_t*)"err_open_lots: PASS\n");
 		return 0;
 	} else {
@@ -11,5 +11,27 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_IOCTL   11
+#define SYS_POLL    12
+#define SYS_PIPE    13
+#define SYS_SHMMAP  14
+#define SYS_SHMUNMAP 15
+#define SYS_UNLINK  16
+#define SYS_MMAP    17
+#define SYS_MUNMAP  18
+#define SYS_MKDIR   19
+#define SYS_GETDENTS 20
+#define SYS_STAT    21
+#define SYS_FSTAT   22
+#define SYS_LSEEK   23
+#define SYS_PREAD   24
+#define SYS_DUP     25
+#define SYS_DUP2    26
+#define SYS_SPAWN   27
+#define SYS_WAIT    28
+#define SYS_WAITPID 29
+#define SYS_ALARM   30
+#define SYS_SETITIMER 31
+#define SYS_NANOSLEEP 32
 
 #endif /* ECE391SYSNUM_H */